@@ -13,6 +13,9 @@ common="-O0 -g -D NISK_DEBUG=1 -lm"
 nisk_platform_src="$location/code/linux_platform.c"
 nisk_game_src="$location/code/nisk.c"
 nisk_server_src="$location/code/linux_server.c"
+nisk_bot_src="$location/code/linux_bot.c"
+nisk_metrics_src="$location/code/linux_metrics.c"
+nisk_level_tool_src="$location/code/level_tool.c"
 
 # External headers/libraries
 inc_dir="$location/external/include"
@@ -26,6 +29,9 @@ external_flags="$sdl_flags $sdl_image_flags -Wl,-rpath,$ORIGIN$sdl_lib,-rpath,$O
 mkdir -p build
 cd build
 
-gcc $nisk_platform_src -o nisk.out $common $warnings -ldl $external_flags
+gcc $nisk_platform_src -o nisk.out $common $warnings -ldl -lpthread $external_flags
 gcc $nisk_game_src -o nisk.so -shared $common
-gcc $nisk_server_src -o server.out $common $warnings
\ No newline at end of file
+gcc $nisk_server_src -o server.out $common $warnings -lpthread
+gcc $nisk_bot_src -o bot.out $common $warnings -lpthread
+gcc $nisk_metrics_src -o metrics.out $common $warnings
+gcc $nisk_level_tool_src -o level.out $common $warnings
\ No newline at end of file
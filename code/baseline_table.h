@@ -0,0 +1,117 @@
+/* date = October 17th 2026 1:40 pm */
+
+#ifndef BASELINE_TABLE_H
+#define BASELINE_TABLE_H
+
+// Server side bookkeeping for delta compressed snapshots. Every SNAPSHOT
+// datagram sent to a client is remembered as a SentPacket listing the
+// entities it carried. Once the client acknowledges the datagram those
+// entity states become baselines, the BaselineTable maps an entity index
+// to the newest acknowledged tick of that entity.
+
+// tracks the same datagrams as the channel of the client, see nisk.h
+#define SENT_PACKET_COUNT RELIABLE_SENT_PACKET_COUNT
+#define BASELINE_TABLE_SIZE 512 // power of two
+
+typedef struct SentPacket
+{
+    bool pending; // sent, not acknowledged yet
+    uint16_t sequence;
+    uint16_t tick;
+    uint16_t entity_count;
+    uint16_t entity_idx[MAX_ENTITY_UPDATES_PER_PACKET];
+} SentPacket;
+
+typedef struct EntityBaseline
+{
+    uint16_t key; // entity index + 1, zero means empty
+    uint16_t tick;
+} EntityBaseline;
+
+typedef struct BaselineTable
+{
+    EntityBaseline slots[BASELINE_TABLE_SIZE];
+    unsigned int used_count;
+} BaselineTable;
+
+// The oldest slot of the history is left out, the worker owning the
+// entity already overwrites it with the next tick while other workers may
+// still be sending this one (see World)
+bool BaselineIsUsable(uint16_t baseline_tick, uint16_t current_tick)
+{
+    uint16_t age = (uint16_t)(current_tick - baseline_tick);
+    bool result = (age > 0 && age < ENTITY_HISTORY_SIZE - 1);
+    return result;
+}
+
+EntityBaseline *BaselineTableFind(BaselineTable *table, uint16_t entity_idx)
+{
+    uint16_t key = (uint16_t)(entity_idx + 1);
+    unsigned int mask = BASELINE_TABLE_SIZE - 1;
+    unsigned int slot_idx = (key * 2654435761u) & mask;
+    for(unsigned int probe = 0; probe < BASELINE_TABLE_SIZE; ++probe)
+    {
+        EntityBaseline *slot = table->slots + slot_idx;
+        if(slot->key == key)
+            return slot;
+        if(slot->key == 0)
+            break;
+        slot_idx = (slot_idx + 1) & mask;
+    }
+    return 0;
+}
+
+// Entries never get removed one by one, instead the table is rebuilt
+// without the baselines that got too old to be used
+void BaselineTableCompact(BaselineTable *table, uint16_t current_tick)
+{
+    EntityBaseline live[BASELINE_TABLE_SIZE];
+    unsigned int live_count = 0;
+    for(unsigned int slot_idx = 0; slot_idx < BASELINE_TABLE_SIZE; ++slot_idx)
+    {
+        EntityBaseline *slot = table->slots + slot_idx;
+        if(slot->key != 0 && BaselineIsUsable(slot->tick, current_tick))
+            live[live_count++] = *slot;
+    }
+    
+    MEMORY_SET(table, 0, sizeof(BaselineTable));
+    
+    // still too crowded, every entity simply falls back to a full update
+    if(live_count > BASELINE_TABLE_SIZE / 2)
+        return;
+    
+    unsigned int mask = BASELINE_TABLE_SIZE - 1;
+    for(unsigned int live_idx = 0; live_idx < live_count; ++live_idx)
+    {
+        unsigned int slot_idx = (live[live_idx].key * 2654435761u) & mask;
+        while(table->slots[slot_idx].key != 0)
+            slot_idx = (slot_idx + 1) & mask;
+        table->slots[slot_idx] = live[live_idx];
+    }
+    table->used_count = live_count;
+}
+
+void BaselineTablePut(BaselineTable *table, uint16_t entity_idx, uint16_t tick, uint16_t current_tick)
+{
+    EntityBaseline *slot = BaselineTableFind(table, entity_idx);
+    if(slot)
+    {
+        if(SequenceIsNewer(tick, slot->tick))
+            slot->tick = tick;
+        return;
+    }
+    
+    if(table->used_count >= (BASELINE_TABLE_SIZE / 4) * 3)
+        BaselineTableCompact(table, current_tick);
+    
+    uint16_t key = (uint16_t)(entity_idx + 1);
+    unsigned int mask = BASELINE_TABLE_SIZE - 1;
+    unsigned int slot_idx = (key * 2654435761u) & mask;
+    while(table->slots[slot_idx].key != 0)
+        slot_idx = (slot_idx + 1) & mask;
+    table->slots[slot_idx].key = key;
+    table->slots[slot_idx].tick = tick;
+    ++table->used_count;
+}
+
+#endif //BASELINE_TABLE_H
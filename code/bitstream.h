@@ -0,0 +1,235 @@
+/* date = October 17th 2026 3:10 pm */
+
+#ifndef BITSTREAM_H
+#define BITSTREAM_H
+
+// Bit packed reader/writer over a byte buffer. The same Serialize*
+// functions are used to read and write, the stream knows which one it is
+// doing, so every message is described exactly once. Values are written
+// least significant bit first. Reading past the end of the buffer or
+// reading a value outside of its declared range sets the error flag
+// instead of touching memory, once set every further read returns zero.
+
+typedef struct BitStream
+{
+    uint8_t *data;
+    size_t size; // in bytes
+    size_t bit_idx;
+    bool writing;
+    bool error;
+} BitStream;
+
+BitStream BitStreamWriter(void *data, size_t size)
+{
+    BitStream result = {0};
+    result.data = (uint8_t *)data;
+    result.size = size;
+    result.writing = true;
+    return result;
+}
+
+BitStream BitStreamReader(void *data, size_t size)
+{
+    BitStream result = {0};
+    result.data = (uint8_t *)data;
+    result.size = size;
+    result.writing = false;
+    return result;
+}
+
+size_t BitStreamBytesUsed(BitStream *stream)
+{
+    size_t result = (stream->bit_idx + 7) / 8;
+    return result;
+}
+
+size_t BitStreamBitsLeft(BitStream *stream)
+{
+    size_t result = stream->size*8 - stream->bit_idx;
+    return result;
+}
+
+unsigned int BitsRequired(uint32_t max_value)
+{
+    unsigned int result = 0;
+    while(result < 32 && (max_value >> result) != 0)
+        ++result;
+    return result;
+}
+
+void BitStreamWriteBits(BitStream *stream, uint32_t value, unsigned int bit_count)
+{
+    ASSERT(bit_count <= 32);
+    if(stream->error || bit_count > BitStreamBitsLeft(stream))
+    {
+        stream->error = true;
+        return;
+    }
+    
+    while(bit_count > 0)
+    {
+        size_t byte_idx = stream->bit_idx >> 3;
+        unsigned int bit_offset = (unsigned int)(stream->bit_idx & 7);
+        unsigned int bits = MIN(8 - bit_offset, bit_count);
+        uint8_t mask = (uint8_t)(((1u << bits) - 1) << bit_offset);
+        
+        // bits past the end of the stream get cleared as well, the
+        // padding of the last byte has to be zero for SerializeAlign
+        uint8_t byte = (uint8_t)(stream->data[byte_idx] & ((1u << bit_offset) - 1));
+        byte = (uint8_t)(byte | ((value << bit_offset) & mask));
+        stream->data[byte_idx] = byte;
+        
+        value = (bits < 32 ? value >> bits : 0);
+        bit_count -= bits;
+        stream->bit_idx += bits;
+    }
+}
+
+uint32_t BitStreamReadBits(BitStream *stream, unsigned int bit_count)
+{
+    ASSERT(bit_count <= 32);
+    if(stream->error || bit_count > BitStreamBitsLeft(stream))
+    {
+        stream->error = true;
+        return 0;
+    }
+    
+    uint32_t result = 0;
+    unsigned int bits_read = 0;
+    while(bits_read < bit_count)
+    {
+        size_t byte_idx = stream->bit_idx >> 3;
+        unsigned int bit_offset = (unsigned int)(stream->bit_idx & 7);
+        unsigned int bits = MIN(8 - bit_offset, bit_count - bits_read);
+        uint32_t chunk = ((uint32_t)stream->data[byte_idx] >> bit_offset) & ((1u << bits) - 1);
+        result |= chunk << bits_read;
+        
+        bits_read += bits;
+        stream->bit_idx += bits;
+    }
+    return result;
+}
+
+// Overwrites bits written earlier, e.g. a count that is only known once
+// the rest of the packet is written
+void BitStreamPatchBits(BitStream *stream, size_t bit_idx, uint32_t value, unsigned int bit_count)
+{
+    ASSERT(stream->writing && bit_idx + bit_count <= stream->bit_idx);
+    
+    // keep the bits that follow the patched ones in their byte
+    size_t end_bit_idx = bit_idx + bit_count;
+    uint8_t *end_byte = stream->data + (end_bit_idx >> 3);
+    uint8_t after_mask = (uint8_t)(0xFFu << (end_bit_idx & 7));
+    uint8_t after = ((end_bit_idx & 7) ? (uint8_t)(*end_byte & after_mask) : 0);
+    
+    size_t saved_bit_idx = stream->bit_idx;
+    stream->bit_idx = bit_idx;
+    BitStreamWriteBits(stream, value, bit_count);
+    stream->bit_idx = saved_bit_idx;
+    
+    if(end_bit_idx & 7)
+        *end_byte = (uint8_t)((*end_byte & ~after_mask) | after);
+}
+
+void SerializeBits(BitStream *stream, uint32_t *value, unsigned int bit_count)
+{
+    if(stream->writing)
+        BitStreamWriteBits(stream, *value, bit_count);
+    else
+        *value = BitStreamReadBits(stream, bit_count);
+}
+
+void SerializeBool(BitStream *stream, bool *value)
+{
+    uint32_t bit = (*value ? 1 : 0);
+    SerializeBits(stream, &bit, 1);
+    *value = (bit != 0);
+}
+
+// Integer known to be in [min, max], only takes as many bits as the range.
+// Out of range values are clamped on write.
+void SerializeInt(BitStream *stream, int32_t *value, int32_t min, int32_t max)
+{
+    ASSERT(min < max);
+    uint32_t range = (uint32_t)((int64_t)max - (int64_t)min);
+    unsigned int bit_count = BitsRequired(range);
+    uint32_t relative = 0;
+    if(stream->writing)
+    {
+        relative = (uint32_t)((int64_t)CLAMP(min, *value, max) - (int64_t)min);
+    }
+    
+    SerializeBits(stream, &relative, bit_count);
+    
+    if(!stream->writing)
+    {
+        if(relative > range)
+        {
+            stream->error = true;
+            relative = 0;
+        }
+        *value = (int32_t)((int64_t)min + (int64_t)relative);
+    }
+}
+
+void SerializeUint16(BitStream *stream, uint16_t *value)
+{
+    uint32_t value32 = *value;
+    SerializeBits(stream, &value32, 16);
+    *value = (uint16_t)value32;
+}
+
+void SerializeUint32(BitStream *stream, uint32_t *value)
+{
+    SerializeBits(stream, value, 32);
+}
+
+// Float known to be in [min, max], sent as an integer number of
+// resolution sized steps. Out of range values are clamped on write.
+void SerializeFloatQuantized(BitStream *stream, float *value, float min, float max, float resolution)
+{
+    ASSERT(min < max && resolution > 0);
+    uint32_t max_step = (uint32_t)ceilf((max - min) / resolution);
+    unsigned int bit_count = BitsRequired(max_step);
+    uint32_t step = 0;
+    if(stream->writing)
+    {
+        float clamped = CLAMP(min, *value, max);
+        step = (uint32_t)floorf((clamped - min) / resolution + 0.5f);
+        step = MIN(step, max_step);
+    }
+    
+    SerializeBits(stream, &step, bit_count);
+    
+    if(!stream->writing)
+    {
+        if(step > max_step)
+        {
+            stream->error = true;
+            step = 0;
+        }
+        *value = CLAMP(min, min + (float)step * resolution, max);
+    }
+}
+
+// Moves on to the next byte boundary, the bits skipped over are zero
+void SerializeAlign(BitStream *stream)
+{
+    unsigned int bit_count = (unsigned int)((8 - (stream->bit_idx & 7)) & 7);
+    uint32_t padding = 0;
+    SerializeBits(stream, &padding, bit_count);
+    if(padding != 0)
+        stream->error = true;
+}
+
+void SerializeBytes(BitStream *stream, uint8_t *bytes, size_t count)
+{
+    for(size_t idx = 0; idx < count; ++idx)
+    {
+        uint32_t byte = bytes[idx];
+        SerializeBits(stream, &byte, 8);
+        bytes[idx] = (uint8_t)byte;
+    }
+}
+
+#endif //BITSTREAM_H
@@ -0,0 +1,248 @@
+/* date = October 17th 2026 10:02 am */
+
+#ifndef CLIENT_TABLE_H
+#define CLIENT_TABLE_H
+
+// Connection table of the server. Clients live in a fixed array sized at
+// startup, an open addressing hash on (address, port) maps a sender to
+// its client and a dense list of active clients is what the tick loops
+// iterate over. Nicknames have to be unique across workers, the World
+// keeps them (WorldClaimNickname). Client indices are stable while the
+// client is connected, offset by the first entity index of the worker
+// they are what clients see in Snapshot.idx (see World).
+
+#define CLIENT_TABLE_MAX_CAPACITY 65535
+
+#define CLIENT_SLOT_EMPTY     0
+#define CLIENT_SLOT_TOMBSTONE 0xFFFFFFFF
+
+typedef struct Client
+{
+    bool connected;
+    Nickname nickname;
+    Address address;
+    float time_since_last_packet;
+    InputBuffer inputs;
+    float view_delay; // in seconds, how far behind it shows other entities
+    int interest_radius; // in units, see InterestGrid
+    
+    // what this client has been sent and has acknowledged
+    ReliableChannel channel;
+    SentPacket sent_packets[SENT_PACKET_COUNT];
+    BaselineTable baselines;
+    
+    unsigned int active_idx; // position in ClientTable.active
+} Client;
+
+typedef struct ClientTable
+{
+    Client *clients;
+    unsigned int capacity;
+    
+    // slots hold client index + 1, so zero is free to mean empty
+    uint32_t *slots;
+    unsigned int slot_count; // power of two
+    unsigned int tombstone_count;
+    
+    unsigned int *active;
+    unsigned int active_count;
+    
+    unsigned int *free_list;
+    unsigned int free_count;
+} ClientTable;
+
+uint32_t AddressHash(Address address)
+{
+    uint64_t key = ((uint64_t)address.address << 16) | address.port;
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDULL;
+    key ^= key >> 33;
+    key *= 0xC4CEB9FE1A85EC53ULL;
+    key ^= key >> 33;
+    return (uint32_t)key;
+}
+
+uint32_t NicknameHash(Nickname *nickname)
+{
+    // FNV-1a
+    uint32_t result = 2166136261u;
+    for(unsigned int idx = 0; idx < nickname->size; ++idx)
+    {
+        result ^= (uint8_t)nickname->str[idx];
+        result *= 16777619u;
+    }
+    return result;
+}
+
+unsigned int ClientTableSlotCount(unsigned int capacity)
+{
+    // keep the load factor at or below one half
+    unsigned int result = 1;
+    while(result < 2*capacity)
+        result <<= 1;
+    return result;
+}
+
+size_t ClientTableMemorySize(unsigned int capacity)
+{
+    size_t result = (capacity * sizeof(Client)
+                     + ClientTableSlotCount(capacity) * sizeof(uint32_t)
+                     + 2 * capacity * sizeof(unsigned int));
+    return result;
+}
+
+void ClientTableInit(ClientTable *table, MemoryArena *arena, unsigned int capacity)
+{
+    ASSERT(capacity > 0 && capacity <= CLIENT_TABLE_MAX_CAPACITY);
+    MEMORY_SET(table, 0, sizeof(ClientTable));
+    
+    table->capacity = capacity;
+    table->clients = PUSH_ARRAY(arena, Client, capacity);
+    MEMORY_SET(table->clients, 0, capacity * sizeof(Client));
+    
+    table->slot_count = ClientTableSlotCount(capacity);
+    table->slots = PUSH_ARRAY(arena, uint32_t, table->slot_count);
+    MEMORY_SET(table->slots, 0, table->slot_count * sizeof(uint32_t));
+    
+    table->active = PUSH_ARRAY(arena, unsigned int, capacity);
+    table->free_list = PUSH_ARRAY(arena, unsigned int, capacity);
+    
+    // hand out low indices first
+    for(unsigned int idx = 0; idx < capacity; ++idx)
+        table->free_list[idx] = capacity - 1 - idx;
+    table->free_count = capacity;
+}
+
+unsigned int ClientTableIndex(ClientTable *table, Client *client)
+{
+    ASSERT(client >= table->clients && client < table->clients + table->capacity);
+    unsigned int result = (unsigned int)(client - table->clients);
+    return result;
+}
+
+Client *ClientTableActive(ClientTable *table, unsigned int active_idx)
+{
+    ASSERT(active_idx < table->active_count);
+    Client *result = table->clients + table->active[active_idx];
+    return result;
+}
+
+// Returns the slot holding the address or, when it is not in the table,
+// the slot it should be inserted into (first tombstone on the probe path
+// if there was one)
+uint32_t *ClientTableProbe(ClientTable *table, Address address, bool *found)
+{
+    uint32_t mask = table->slot_count - 1;
+    uint32_t slot_idx = AddressHash(address) & mask;
+    uint32_t *insert_slot = 0;
+    *found = false;
+    
+    for(unsigned int probe = 0; probe < table->slot_count; ++probe)
+    {
+        uint32_t *slot = table->slots + slot_idx;
+        if(*slot == CLIENT_SLOT_EMPTY)
+        {
+            if(insert_slot == 0)
+                insert_slot = slot;
+            break;
+        }
+        else if(*slot == CLIENT_SLOT_TOMBSTONE)
+        {
+            if(insert_slot == 0)
+                insert_slot = slot;
+        }
+        else
+        {
+            Client *client = table->clients + (*slot - 1);
+            if(AddressCompare(client->address, address))
+            {
+                *found = true;
+                return slot;
+            }
+        }
+        slot_idx = (slot_idx + 1) & mask;
+    }
+    
+    return insert_slot;
+}
+
+Client *ClientTableFind(ClientTable *table, Address address)
+{
+    bool found;
+    uint32_t *slot = ClientTableProbe(table, address, &found);
+    Client *result = (found ? table->clients + (*slot - 1) : 0);
+    return result;
+}
+
+// Drops every tombstone by reinserting the active clients
+void ClientTableRehash(ClientTable *table)
+{
+    MEMORY_SET(table->slots, 0, table->slot_count * sizeof(uint32_t));
+    table->tombstone_count = 0;
+    
+    for(unsigned int active_idx = 0; active_idx < table->active_count; ++active_idx)
+    {
+        unsigned int client_idx = table->active[active_idx];
+        Client *client = table->clients + client_idx;
+        bool found;
+        uint32_t *slot = ClientTableProbe(table, client->address, &found);
+        ASSERT(!found && slot != 0);
+        *slot = client_idx + 1;
+    }
+}
+
+// Returns a cleared, connected client for the address or 0 when the
+// table is full. The address can't be in the table already.
+Client *ClientTableAdd(ClientTable *table, Address address, Nickname *nickname)
+{
+    if(table->free_count == 0)
+        return 0;
+    
+    // live entries never fill more than half of the slots, so only
+    // tombstones can make the probe chains long, flush them out early
+    if(table->active_count + table->tombstone_count >= (table->slot_count / 4) * 3)
+        ClientTableRehash(table);
+    
+    bool found;
+    uint32_t *slot = ClientTableProbe(table, address, &found);
+    ASSERT(!found && slot != 0);
+    if(*slot == CLIENT_SLOT_TOMBSTONE)
+        --table->tombstone_count;
+    
+    unsigned int client_idx = table->free_list[--table->free_count];
+    *slot = client_idx + 1;
+    
+    Client *result = table->clients + client_idx;
+    MEMORY_SET(result, 0, sizeof(Client));
+    result->connected = true;
+    result->address = address;
+    result->nickname = *nickname;
+    result->active_idx = table->active_count;
+    table->active[table->active_count++] = client_idx;
+    
+    return result;
+}
+
+void ClientTableRemove(ClientTable *table, Client *client)
+{
+    ASSERT(client->connected);
+    bool found;
+    uint32_t *slot = ClientTableProbe(table, client->address, &found);
+    ASSERT(found);
+    if(found)
+    {
+        *slot = CLIENT_SLOT_TOMBSTONE;
+        ++table->tombstone_count;
+    }
+    
+    // swap-remove from the active list
+    unsigned int client_idx = ClientTableIndex(table, client);
+    unsigned int last_client_idx = table->active[--table->active_count];
+    table->active[client->active_idx] = last_client_idx;
+    table->clients[last_client_idx].active_idx = client->active_idx;
+    
+    client->connected = false;
+    table->free_list[table->free_count++] = client_idx;
+}
+
+#endif //CLIENT_TABLE_H
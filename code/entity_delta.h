@@ -0,0 +1,101 @@
+/* date = October 17th 2026 1:05 pm */
+
+#ifndef ENTITY_DELTA_H
+#define ENTITY_DELTA_H
+
+// Entities are sent as a list of the fields that changed since a baseline
+// the reciever is known to have. Both sides keep an EntityHistory of every
+// entity keyed by server tick so the baseline can be looked up by its tick.
+
+typedef enum EntityFieldIndex
+{
+    EntityField_P,
+    EntityField_V,
+    EntityField_Hitbox,
+    EntityField_TextureRect,
+    EntityField_JumpTimer,
+    EntityField_Direction,
+    EntityField_SpellP,
+    EntityField_SpellHitbox,
+    EntityField_SpellTextureRect,
+    EntityField_SpellTimer,
+    EntityField_SpellDirection,
+    EntityField_COUNT
+} EntityFieldIndex;
+
+typedef struct EntityField
+{
+    uint16_t offset;
+    uint16_t size;
+} EntityField;
+
+#define ENTITY_FIELD(name) { (uint16_t)offsetof(Entity, name), (uint16_t)sizeof(((Entity *)0)->name) }
+global EntityField global_entity_fields[EntityField_COUNT] =
+{
+    [EntityField_P]                = ENTITY_FIELD(p),
+    [EntityField_V]                = ENTITY_FIELD(v),
+    [EntityField_Hitbox]           = ENTITY_FIELD(hitbox),
+    [EntityField_TextureRect]      = ENTITY_FIELD(texture_rect),
+    [EntityField_JumpTimer]        = ENTITY_FIELD(jump_timer),
+    [EntityField_Direction]        = ENTITY_FIELD(direction),
+    [EntityField_SpellP]           = ENTITY_FIELD(spell_p),
+    [EntityField_SpellHitbox]      = ENTITY_FIELD(spell_hitbox),
+    [EntityField_SpellTextureRect] = ENTITY_FIELD(spell_texture_rect),
+    [EntityField_SpellTimer]       = ENTITY_FIELD(spell_timer),
+    [EntityField_SpellDirection]   = ENTITY_FIELD(spell_direction),
+};
+#undef ENTITY_FIELD
+
+#define ENTITY_FIELD_MASK_ALL ((uint16_t)((1u << EntityField_COUNT) - 1))
+
+global Entity global_zero_entity;
+
+Entity *EntityHistoryGet(EntityHistory *history, uint16_t tick)
+{
+    unsigned int slot = tick % ENTITY_HISTORY_SIZE;
+    Entity *result = 0;
+    if(history->valid[slot] && history->ticks[slot] == tick)
+        result = history->entities + slot;
+    return result;
+}
+
+void EntityHistoryPut(EntityHistory *history, uint16_t tick, Entity *entity)
+{
+    unsigned int slot = tick % ENTITY_HISTORY_SIZE;
+    history->ticks[slot] = tick;
+    history->valid[slot] = true;
+    MEMORY_COPY(history->entities + slot, entity, sizeof(Entity));
+}
+
+// Mask of the fields of entity that differ from baseline (pass
+// global_zero_entity when there is none), see SerializeEntityUpdate
+uint16_t EntityDeltaMask(Entity *baseline, Entity *entity)
+{
+    uint16_t result = 0;
+    for(unsigned int field_idx = 0; field_idx < EntityField_COUNT; ++field_idx)
+    {
+        EntityField *field = global_entity_fields + field_idx;
+        uint8_t *baseline_field = (uint8_t *)baseline + field->offset;
+        uint8_t *entity_field = (uint8_t *)entity + field->offset;
+        if(memcmp(baseline_field, entity_field, field->size) != 0)
+            result |= (uint16_t)(1u << field_idx);
+    }
+    return result;
+}
+
+// Copies the fields in field_mask from fields on top of entity, which
+// has to hold the baseline already
+void EntityDeltaApply(Entity *entity, uint16_t field_mask, Entity *fields)
+{
+    for(unsigned int field_idx = 0; field_idx < EntityField_COUNT; ++field_idx)
+    {
+        if(field_mask & (1u << field_idx))
+        {
+            EntityField *field = global_entity_fields + field_idx;
+            MEMORY_COPY((uint8_t *)entity + field->offset,
+                        (uint8_t *)fields + field->offset, field->size);
+        }
+    }
+}
+
+#endif //ENTITY_DELTA_H
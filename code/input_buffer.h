@@ -0,0 +1,94 @@
+/* date = October 17th 2026 9:50 pm */
+
+#ifndef INPUT_BUFFER_H
+#define INPUT_BUFFER_H
+
+// Server side queue of the inputs of a client, keyed by input sequence.
+// The client samples one input per simulation step and the server applies
+// one per step, so the queue only has to absorb jitter. Every step uses
+// up a sequence number, when it runs dry the last input is repeated in
+// place of the missing one and that one gets dropped if it still shows
+// up, so the steps of the server line up with the predicted steps of the
+// client one for one. Only up to INPUT_BUFFER_MAX_LAG inputs are missed
+// that way, past that the client has stalled and the steps wait for it
+// instead of leaving it behind for good. When the queue holds more than
+// INPUT_BUFFER_MAX_LAG inputs the oldest get skipped to keep the latency
+// down.
+
+#define INPUT_BUFFER_SIZE 32
+#define INPUT_BUFFER_MAX_LAG 8
+
+typedef struct InputBuffer
+{
+    bool started;
+    uint16_t next_sequence;   // next input a step applies
+    uint16_t newest_sequence; // newest input recieved
+    PlayerInput last;         // applied by the previous step
+    
+    // newest input a step moved past, what the client replays from
+    bool has_applied;
+    uint16_t applied_sequence;
+    
+    bool valid[INPUT_BUFFER_SIZE];
+    uint16_t sequences[INPUT_BUFFER_SIZE];
+    PlayerInput inputs[INPUT_BUFFER_SIZE];
+} InputBuffer;
+
+void InputBufferPush(InputBuffer *buffer, uint16_t sequence, PlayerInput *input)
+{
+    if(!buffer->started)
+    {
+        buffer->started = true;
+        buffer->next_sequence = sequence;
+        buffer->newest_sequence = sequence;
+    }
+    
+    // already applied, skipped or stood in for
+    if(SequenceIsNewer(buffer->next_sequence, sequence))
+        return;
+    
+    // too far ahead to have room, the skip in InputBufferPop catches up
+    uint16_t ahead = (uint16_t)(sequence - buffer->next_sequence);
+    if(ahead >= INPUT_BUFFER_SIZE)
+        buffer->next_sequence = (uint16_t)(sequence - INPUT_BUFFER_MAX_LAG);
+    
+    unsigned int slot_idx = sequence % INPUT_BUFFER_SIZE;
+    buffer->valid[slot_idx] = true;
+    buffer->sequences[slot_idx] = sequence;
+    buffer->inputs[slot_idx] = *input;
+    if(SequenceIsNewer(sequence, buffer->newest_sequence))
+        buffer->newest_sequence = sequence;
+}
+
+// Input for the next simulation step
+PlayerInput InputBufferPop(InputBuffer *buffer)
+{
+    if(!buffer->started)
+        return buffer->last;
+    
+    if(SequenceIsNewer(buffer->next_sequence, buffer->newest_sequence))
+    {
+        uint16_t missing = (uint16_t)(buffer->next_sequence - buffer->newest_sequence);
+        if(missing > INPUT_BUFFER_MAX_LAG)
+            return buffer->last;
+    }
+    else
+    {
+        uint16_t pending = (uint16_t)(buffer->newest_sequence - buffer->next_sequence);
+        if(pending > INPUT_BUFFER_MAX_LAG)
+            buffer->next_sequence = (uint16_t)(buffer->newest_sequence - INPUT_BUFFER_MAX_LAG);
+    }
+    
+    // a lost or late input is stood in for by the one before it
+    unsigned int slot_idx = buffer->next_sequence % INPUT_BUFFER_SIZE;
+    if(buffer->valid[slot_idx] && buffer->sequences[slot_idx] == buffer->next_sequence)
+    {
+        buffer->last = buffer->inputs[slot_idx];
+        buffer->valid[slot_idx] = false;
+    }
+    buffer->has_applied = true;
+    buffer->applied_sequence = buffer->next_sequence++;
+    return buffer->last;
+}
+
+#endif //INPUT_BUFFER_H
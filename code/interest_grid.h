@@ -0,0 +1,284 @@
+/* date = October 17th 2026 11:20 am */
+
+#ifndef INTEREST_GRID_H
+#define INTEREST_GRID_H
+
+// Uniform grid over entity positions used by the server to decide which
+// entities a client gets to see. The world is unbounded so cells are
+// hashed into a fixed number of buckets; the grid is rebuilt from scratch
+// every tick with a counting sort, which keeps every bucket contiguous
+// in memory and costs O(entities in the world).
+
+typedef struct InterestGridEntry
+{
+    Vec2i p;
+    Vec2i cell;
+    unsigned int entity_idx;
+} InterestGridEntry;
+
+typedef struct InterestGrid
+{
+    int cell_size; // in units
+    
+    unsigned int bucket_count; // power of two
+    unsigned int *bucket_start; // bucket_count + 1 entries, prefix sums
+    
+    InterestGridEntry *entries;
+    unsigned int entry_count;
+    unsigned int entry_capacity;
+} InterestGrid;
+
+Vec2i InterestGridCell(InterestGrid *grid, Vec2i p)
+{
+    Vec2i result;
+    result.x = FloorDivide(p.x, grid->cell_size);
+    result.y = FloorDivide(p.y, grid->cell_size);
+    return result;
+}
+
+unsigned int InterestGridBucket(InterestGrid *grid, Vec2i cell)
+{
+    uint32_t hash = ((uint32_t)cell.x * 73856093u) ^ ((uint32_t)cell.y * 19349663u);
+    unsigned int result = hash & (grid->bucket_count - 1);
+    return result;
+}
+
+unsigned int InterestGridBucketCount(unsigned int capacity)
+{
+    unsigned int result = 1;
+    while(result < 2*capacity)
+        result <<= 1;
+    return result;
+}
+
+size_t InterestGridMemorySize(unsigned int capacity)
+{
+    size_t result = ((InterestGridBucketCount(capacity) + 1) * sizeof(unsigned int)
+                     + capacity * sizeof(InterestGridEntry));
+    return result;
+}
+
+void InterestGridInit(InterestGrid *grid, MemoryArena *arena, unsigned int capacity, int cell_size)
+{
+    ASSERT(cell_size > 0);
+    MEMORY_SET(grid, 0, sizeof(InterestGrid));
+    grid->cell_size = cell_size;
+    grid->bucket_count = InterestGridBucketCount(capacity);
+    grid->bucket_start = PUSH_ARRAY(arena, unsigned int, grid->bucket_count + 1);
+    grid->entries = PUSH_ARRAY(arena, InterestGridEntry, capacity);
+    grid->entry_capacity = capacity;
+}
+
+// Takes the entities every worker published for the tick, buffer_idx is
+// the parity of the tick
+void InterestGridBuild(InterestGrid *grid, World *world, unsigned int buffer_idx)
+{
+    ASSERT(world->capacity <= grid->entry_capacity);
+    unsigned int *bucket_start = grid->bucket_start;
+    MEMORY_SET(bucket_start, 0, (grid->bucket_count + 1) * sizeof(unsigned int));
+    
+    // count, shifted by one so the prefix sum lands on the bucket start
+    unsigned int entry_count = 0;
+    for(unsigned int worker_idx = 0; worker_idx < world->worker_count; ++worker_idx)
+    {
+        WorldEntry *entries = world->entries[buffer_idx] + worker_idx * world->worker_capacity;
+        unsigned int count = world->entry_counts[buffer_idx][worker_idx];
+        for(unsigned int idx = 0; idx < count; ++idx)
+        {
+            Vec2i cell = InterestGridCell(grid, entries[idx].p);
+            ++bucket_start[InterestGridBucket(grid, cell) + 1];
+        }
+        entry_count += count;
+    }
+    
+    for(unsigned int bucket_idx = 0; bucket_idx < grid->bucket_count; ++bucket_idx)
+        bucket_start[bucket_idx + 1] += bucket_start[bucket_idx];
+    
+    // scatter, bucket_start[bucket] is used as the write cursor and ends
+    // up pointing at the start of the next bucket, shift it back after
+    for(unsigned int worker_idx = 0; worker_idx < world->worker_count; ++worker_idx)
+    {
+        WorldEntry *entries = world->entries[buffer_idx] + worker_idx * world->worker_capacity;
+        unsigned int count = world->entry_counts[buffer_idx][worker_idx];
+        for(unsigned int idx = 0; idx < count; ++idx)
+        {
+            InterestGridEntry entry;
+            entry.p = entries[idx].p;
+            entry.cell = InterestGridCell(grid, entry.p);
+            entry.entity_idx = entries[idx].idx;
+            unsigned int bucket = InterestGridBucket(grid, entry.cell);
+            grid->entries[bucket_start[bucket]++] = entry;
+        }
+    }
+    
+    for(unsigned int bucket_idx = grid->bucket_count; bucket_idx > 0; --bucket_idx)
+        bucket_start[bucket_idx] = bucket_start[bucket_idx - 1];
+    bucket_start[0] = 0;
+    
+    grid->entry_count = entry_count;
+}
+
+// Iterates over every entry within radius units of center. Usage:
+//     InterestGridQuery query = InterestGridQueryBegin(grid, center, radius);
+//     while((entry = InterestGridQueryNext(&query))) { ... }
+typedef struct InterestGridQuery
+{
+    InterestGrid *grid;
+    Vec2i center;
+    int64_t radius_sq;
+    
+    Vec2i cell_min;
+    Vec2i cell_max;
+    Vec2i cell;
+    
+    unsigned int entry_idx;
+    unsigned int entry_end;
+} InterestGridQuery;
+
+InterestGridQuery InterestGridQueryBegin(InterestGrid *grid, Vec2i center, int radius)
+{
+    InterestGridQuery result;
+    result.grid = grid;
+    result.center = center;
+    result.radius_sq = (int64_t)radius * (int64_t)radius;
+    result.cell_min = InterestGridCell(grid, Vec2iGet(center.x - radius, center.y - radius));
+    result.cell_max = InterestGridCell(grid, Vec2iGet(center.x + radius, center.y + radius));
+    
+    // start one cell before the first one, QueryNext steps onto it
+    result.cell = Vec2iGet(result.cell_min.x - 1, result.cell_min.y);
+    result.entry_idx = 0;
+    result.entry_end = 0;
+    return result;
+}
+
+int64_t Vec2iDistanceSquared(Vec2i a, Vec2i b)
+{
+    int64_t dx = (int64_t)a.x - (int64_t)b.x;
+    int64_t dy = (int64_t)a.y - (int64_t)b.y;
+    int64_t result = dx*dx + dy*dy;
+    return result;
+}
+
+InterestGridEntry *InterestGridQueryNext(InterestGridQuery *query)
+{
+    InterestGrid *grid = query->grid;
+    while(true)
+    {
+        while(query->entry_idx < query->entry_end)
+        {
+            InterestGridEntry *entry = grid->entries + query->entry_idx++;
+            
+            // different cells can share a bucket, only take entries from
+            // the cell we are visiting so nothing is reported twice
+            if(entry->cell.x != query->cell.x || entry->cell.y != query->cell.y)
+                continue;
+            
+            if(Vec2iDistanceSquared(entry->p, query->center) <= query->radius_sq)
+                return entry;
+        }
+        
+        ++query->cell.x;
+        if(query->cell.x > query->cell_max.x)
+        {
+            query->cell.x = query->cell_min.x;
+            ++query->cell.y;
+            if(query->cell.y > query->cell_max.y)
+                return 0;
+        }
+        
+        unsigned int bucket = InterestGridBucket(grid, query->cell);
+        query->entry_idx = grid->bucket_start[bucket];
+        query->entry_end = grid->bucket_start[bucket + 1];
+    }
+}
+
+int64_t InterestGridEntryDistance(InterestGridEntry *entry, Vec2i center)
+{
+    int64_t result = Vec2iDistanceSquared(entry->p, center);
+    return result;
+}
+
+// Puts the entry at heap_idx of a max heap on the distance to center
+// where it belongs below
+void InterestGridHeapSiftDown(InterestGridEntry **heap, unsigned int count,
+                              unsigned int heap_idx, Vec2i center)
+{
+    while(true)
+    {
+        unsigned int largest = heap_idx;
+        unsigned int left = 2*heap_idx + 1;
+        unsigned int right = left + 1;
+        if(left < count && (InterestGridEntryDistance(heap[left], center)
+                            > InterestGridEntryDistance(heap[largest], center)))
+            largest = left;
+        if(right < count && (InterestGridEntryDistance(heap[right], center)
+                             > InterestGridEntryDistance(heap[largest], center)))
+            largest = right;
+        if(largest == heap_idx)
+            return;
+        
+        InterestGridEntry *swap = heap[heap_idx];
+        heap[heap_idx] = heap[largest];
+        heap[largest] = swap;
+        heap_idx = largest;
+    }
+}
+
+// Fills result with the entries within radius units of center, only the
+// capacity nearest ones when there are more. The entry of entity
+// first_idx always makes it in, as result[0], whatever the ties around
+// it. The rest are kept as a max heap on the distance while the query
+// goes, so a crowd costs O(entries log capacity) and no memory beyond the
+// result. Returns how many there are, in no particular order after the
+// first.
+unsigned int InterestGridNearest(InterestGrid *grid, Vec2i center, int radius, unsigned int first_idx,
+                                 InterestGridEntry **result, unsigned int capacity)
+{
+    ASSERT(capacity > 1);
+    InterestGridEntry *first = 0;
+    InterestGridEntry **heap = result + 1;
+    unsigned int heap_capacity = capacity - 1;
+    unsigned int count = 0;
+    InterestGridQuery query = InterestGridQueryBegin(grid, center, radius);
+    InterestGridEntry *entry;
+    while((entry = InterestGridQueryNext(&query)))
+    {
+        if(entry->entity_idx == first_idx)
+        {
+            first = entry;
+        }
+        else if(count < heap_capacity)
+        {
+            // sift up
+            unsigned int heap_idx = count++;
+            heap[heap_idx] = entry;
+            while(heap_idx > 0)
+            {
+                unsigned int parent = (heap_idx - 1) / 2;
+                if(InterestGridEntryDistance(heap[parent], center)
+                   >= InterestGridEntryDistance(heap[heap_idx], center))
+                    break;
+                
+                InterestGridEntry *swap = heap[parent];
+                heap[parent] = heap[heap_idx];
+                heap[heap_idx] = swap;
+                heap_idx = parent;
+            }
+        }
+        else if(InterestGridEntryDistance(entry, center) < InterestGridEntryDistance(heap[0], center))
+        {
+            heap[0] = entry;
+            InterestGridHeapSiftDown(heap, count, 0, center);
+        }
+    }
+    
+    // without the first entry the last one of the heap fills its place
+    if(first)
+        result[0] = first;
+    else if(count > 0)
+        result[0] = heap[--count];
+    unsigned int result_count = (first || count > 0 ? count + 1 : 0);
+    return result_count;
+}
+
+#endif //INTEREST_GRID_H
@@ -0,0 +1,449 @@
+/* date = October 18th 2026 1:10 am */
+
+#ifndef LEVEL_H
+#define LEVEL_H
+
+// Levels are tilemaps cut into square chunks, stored in a file that gets
+// mapped and used in place. Loading one only checks the header, so it
+// costs the same for any level size. Pages of chunks nobody looks at are
+// never read. All values are little endian.
+//
+//   header: LevelFileHeader
+//   index:  chunks_wide * chunks_high u32 file offsets of the chunks, row by
+//           row from the lower left chunk, 0 for a chunk without a solid tile
+//   chunks: LEVEL_CHUNK_SIZE rows of LEVEL_CHUNK_SIZE tile bytes each,
+//           bottom row first
+//
+// A tile byte of 0 is empty. Anything else is solid, and it is drawn with
+// the atlas tile in that column minus one.
+
+#define LEVEL_FILE_MAGIC 0x4C564C4Eu // "NLVL"
+#define LEVEL_FILE_VERSION 1
+#define LEVEL_CHUNK_SHIFT 5
+#define LEVEL_CHUNK_SIZE (1 << LEVEL_CHUNK_SHIFT) // in tiles
+#define LEVEL_CHUNK_BYTES (LEVEL_CHUNK_SIZE * LEVEL_CHUNK_SIZE)
+#define LEVEL_ATLAS_ROW 4
+#define LEVEL_DEFAULT_PATH "../assets/default.nlvl"
+
+typedef struct LevelFileHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t chunk_size; // has to be LEVEL_CHUNK_SIZE
+    int32_t tile_size;   // in units
+    int32_t chunk_x;     // chunk coordinates of the first chunk in the index
+    int32_t chunk_y;
+    uint32_t chunks_wide;
+    uint32_t chunks_high;
+} LevelFileHeader;
+
+bool RectiCheckOverlap(Recti a, Recti b)
+{
+    if(a.p1.x <= b.p0.x || b.p1.x <= a.p0.x)
+        return false;
+    
+    if(a.p1.y <= b.p0.y || b.p1.y <= a.p0.y)
+        return false;
+    
+    return true;
+}
+
+// FNV-1a of the header and the index. Tells apart level files without
+// reading the chunks, every chunk that gets a tile or loses its last one
+// moves the offsets in the index.
+uint32_t LevelHash(uint8_t *data, size_t size)
+{
+    uint32_t result = 2166136261u;
+    for(size_t byte_idx = 0; byte_idx < size; ++byte_idx)
+    {
+        result ^= data[byte_idx];
+        result *= 16777619u;
+    }
+    return result;
+}
+
+// Takes a mapped level file, false if it isn't one or its tiles aren't
+// tile_size units, the meters_to_units of the physics
+bool LevelLoad(Level *level, void *data, size_t size, int tile_size)
+{
+    MEMORY_SET(level, 0, sizeof(Level));
+    LevelFileHeader *header = (LevelFileHeader *)data;
+    if(size < sizeof(LevelFileHeader) || header->magic != LEVEL_FILE_MAGIC)
+    {
+        fprintf(stderr, "[ERROR] Not a level file\n");
+        return false;
+    }
+    
+    if(header->version != LEVEL_FILE_VERSION || header->chunk_size != LEVEL_CHUNK_SIZE)
+    {
+        fprintf(stderr, "[ERROR] Level file version %u with %u tile chunks doesn't fit, "
+                "expected version %u with %u tile chunks\n",
+                header->version, header->chunk_size, LEVEL_FILE_VERSION, LEVEL_CHUNK_SIZE);
+        return false;
+    }
+    
+    if(header->tile_size != tile_size)
+    {
+        fprintf(stderr, "[ERROR] Level tiles are %d units, expected %d\n", header->tile_size, tile_size);
+        return false;
+    }
+    
+    // tile coordinates of the whole level have to fit an int
+    int max_chunks = INT32_MAX / LEVEL_CHUNK_SIZE;
+    if(header->chunks_wide > (uint32_t)max_chunks || header->chunks_high > (uint32_t)max_chunks)
+    {
+        fprintf(stderr, "[ERROR] Level of %ux%u chunks, at most %d each way\n",
+                header->chunks_wide, header->chunks_high, max_chunks);
+        return false;
+    }
+    
+    // checked by dividing so the product can't wrap
+    size_t index_count = (size - sizeof(LevelFileHeader)) / sizeof(uint32_t);
+    if(header->chunks_wide != 0 && header->chunks_high > index_count / header->chunks_wide)
+    {
+        fprintf(stderr, "[ERROR] Level file is cut short\n");
+        return false;
+    }
+    size_t index_size = (size_t)header->chunks_wide * (size_t)header->chunks_high * sizeof(uint32_t);
+    
+    level->data = (uint8_t *)data;
+    level->size = size;
+    level->hash = LevelHash(level->data, sizeof(LevelFileHeader) + index_size);
+    level->tile_size = header->tile_size;
+    level->chunk_p = Vec2iGet(header->chunk_x, header->chunk_y);
+    level->chunks_wide = (int)header->chunks_wide;
+    level->chunks_high = (int)header->chunks_high;
+    level->chunk_offsets = (uint32_t *)(level->data + sizeof(LevelFileHeader));
+    return true;
+}
+
+// Tiles of the chunk at chunk coordinates chunk_x, chunk_y, 0 if it has
+// no solid tiles. Chunks are only checked against the file size here, so
+// a broken offset reads as an empty chunk instead of past the mapping.
+uint8_t *LevelChunk(Level *level, int chunk_x, int chunk_y)
+{
+    int idx_x = chunk_x - level->chunk_p.x;
+    int idx_y = chunk_y - level->chunk_p.y;
+    if(idx_x < 0 || idx_x >= level->chunks_wide || idx_y < 0 || idx_y >= level->chunks_high)
+        return 0;
+    
+    uint32_t offset = level->chunk_offsets[idx_y * level->chunks_wide + idx_x];
+    if(offset == 0 || (size_t)offset + LEVEL_CHUNK_BYTES > level->size)
+        return 0;
+    
+    uint8_t *result = level->data + offset;
+    return result;
+}
+
+// The client keeps the chunks around the camera in a LevelStream, copied
+// out of the level file by a thread of the platform so the frame doesn't
+// wait on the disk for them. Collision still reads the mapping for a
+// chunk the thread hasn't loaded yet, which takes a jump across the
+// level; the chunks around the spawn get loaded before the first frame.
+// The slots are a fixed window of
+// LEVEL_STREAM_WINDOW^2 chunks addressed by chunk coordinates modulo the
+// window, a chunk only gets replaced by one a window away, so memory
+// stays the same for any level size. The frame asks for the chunks it
+// looks at and the thread loads the missing ones around them nearest
+// first. Both directions go through sequence numbers like the server
+// metrics (see server_metrics.h), so neither side ever waits on the
+// other: a tile read while its slot gets rewritten counts as not loaded.
+#define LEVEL_STREAM_WINDOW 8 // power of two, in chunks
+#define LEVEL_STREAM_MARGIN 1 // chunks loaded past the ones asked for
+
+typedef enum LevelStreamSlotState
+{
+    LevelStreamSlot_Unused,
+    LevelStreamSlot_Solid,  // tiles hold the chunk
+    LevelStreamSlot_Air,    // the chunk has no solid tiles
+    LevelStreamSlot_Failed, // reading it failed, look into the mapping
+} LevelStreamSlotState;
+
+typedef struct LevelStreamSlot
+{
+    uint32_t sequence; // odd while the thread writes
+    Vec2i chunk;
+    uint32_t state;    // LevelStreamSlotState
+    uint8_t tiles[LEVEL_CHUNK_BYTES];
+} LevelStreamSlot;
+
+struct LevelStream
+{
+    // written by the frame, chunks it wants loaded
+    uint32_t request_sequence; // odd while the frame writes
+    Vec2i request_min;
+    Vec2i request_max;
+    
+    // the level as mapped by the game, the thread reads the file itself
+    Vec2i chunk_p;
+    int chunks_wide, chunks_high;
+    size_t file_size;
+    
+    LevelStreamSlot slots[LEVEL_STREAM_WINDOW * LEVEL_STREAM_WINDOW];
+};
+
+void LevelStreamInit(LevelStream *stream, Level *level)
+{
+    MEMORY_SET(stream, 0, sizeof(LevelStream));
+    stream->chunk_p = level->chunk_p;
+    stream->chunks_wide = level->chunks_wide;
+    stream->chunks_high = level->chunks_high;
+    stream->file_size = level->size;
+    
+    // nothing is asked for until the first frame
+    stream->request_min = Vec2iGet(0, 0);
+    stream->request_max = Vec2iGet(-1, -1);
+}
+
+LevelStreamSlot *LevelStreamSlotOf(LevelStream *stream, int chunk_x, int chunk_y)
+{
+    int slot_x = chunk_x & (LEVEL_STREAM_WINDOW - 1);
+    int slot_y = chunk_y & (LEVEL_STREAM_WINDOW - 1);
+    LevelStreamSlot *result = stream->slots + slot_y * LEVEL_STREAM_WINDOW + slot_x;
+    return result;
+}
+
+// Called by the frame, only writes when the chunks change
+void LevelStreamRequest(LevelStream *stream, Vec2i chunk_min, Vec2i chunk_max)
+{
+    if(chunk_min.x == stream->request_min.x && chunk_min.y == stream->request_min.y
+       && chunk_max.x == stream->request_max.x && chunk_max.y == stream->request_max.y)
+        return;
+    
+    uint32_t sequence = __atomic_load_n(&stream->request_sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&stream->request_sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    stream->request_min = chunk_min;
+    stream->request_max = chunk_max;
+    __atomic_store_n(&stream->request_sequence, sequence + 2, __ATOMIC_RELEASE);
+}
+
+// Called by the frame, false when the chunk of the tile isn't loaded
+bool LevelStreamTile(LevelStream *stream, int tile_x, int tile_y, uint8_t *tile)
+{
+    int chunk_x = tile_x >> LEVEL_CHUNK_SHIFT;
+    int chunk_y = tile_y >> LEVEL_CHUNK_SHIFT;
+    LevelStreamSlot *slot = LevelStreamSlotOf(stream, chunk_x, chunk_y);
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+    if(sequence & 1)
+        return false;
+    
+    uint32_t state = slot->state;
+    bool found = (slot->chunk.x == chunk_x && slot->chunk.y == chunk_y
+                  && (state == LevelStreamSlot_Solid || state == LevelStreamSlot_Air));
+    if(found)
+    {
+        int local_x = tile_x & (LEVEL_CHUNK_SIZE - 1);
+        int local_y = tile_y & (LEVEL_CHUNK_SIZE - 1);
+        *tile = (state == LevelStreamSlot_Solid ? slot->tiles[local_y * LEVEL_CHUNK_SIZE + local_x] : 0);
+    }
+    
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    bool unchanged = (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence);
+    return found && unchanged;
+}
+
+// Called by the thread, the chunk of the window around the request that
+// is nearest to its center and not loaded yet. Chunks that failed to
+// load only come up when nothing else is missing and retry is set, so a
+// broken one doesn't hold up the rest. False when there is none.
+bool LevelStreamNextChunk(LevelStream *stream, bool retry, Vec2i *chunk)
+{
+    Vec2i request_min, request_max;
+    while(true)
+    {
+        uint32_t sequence = __atomic_load_n(&stream->request_sequence, __ATOMIC_ACQUIRE);
+        request_min = stream->request_min;
+        request_max = stream->request_max;
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(!(sequence & 1) && __atomic_load_n(&stream->request_sequence, __ATOMIC_RELAXED) == sequence)
+            break;
+    }
+    if(request_max.x < request_min.x || request_max.y < request_min.y)
+        return false;
+    
+    // a window wider than the slots would evict its own chunks, the
+    // chunks furthest from the center are left out then
+    Vec2i center = Vec2iGet(FloorDivide(request_min.x + request_max.x, 2),
+                            FloorDivide(request_min.y + request_max.y, 2));
+    Vec2i window_min = Vec2iGet(request_min.x - LEVEL_STREAM_MARGIN, request_min.y - LEVEL_STREAM_MARGIN);
+    Vec2i window_max = Vec2iGet(request_max.x + LEVEL_STREAM_MARGIN, request_max.y + LEVEL_STREAM_MARGIN);
+    window_min.x = MAX(window_min.x, center.x - LEVEL_STREAM_WINDOW/2);
+    window_min.y = MAX(window_min.y, center.y - LEVEL_STREAM_WINDOW/2);
+    window_max.x = MIN(window_max.x, window_min.x + LEVEL_STREAM_WINDOW - 1);
+    window_max.y = MIN(window_max.y, window_min.y + LEVEL_STREAM_WINDOW - 1);
+    
+    bool result = false;
+    bool result_failed = false;
+    int nearest_distance = 0;
+    for(int chunk_y = window_min.y; chunk_y <= window_max.y; ++chunk_y)
+    {
+        for(int chunk_x = window_min.x; chunk_x <= window_max.x; ++chunk_x)
+        {
+            // only the thread writes slots, it reads them as they are
+            LevelStreamSlot *slot = LevelStreamSlotOf(stream, chunk_x, chunk_y);
+            bool failed = false;
+            if(slot->state != LevelStreamSlot_Unused && slot->chunk.x == chunk_x && slot->chunk.y == chunk_y)
+            {
+                failed = (slot->state == LevelStreamSlot_Failed);
+                if(!failed || !retry)
+                    continue;
+            }
+            
+            int distance_x = (chunk_x > center.x ? chunk_x - center.x : center.x - chunk_x);
+            int distance_y = (chunk_y > center.y ? chunk_y - center.y : center.y - chunk_y);
+            int distance = MAX(distance_x, distance_y);
+            bool better = (!result
+                           || (result_failed && !failed)
+                           || (result_failed == failed && distance < nearest_distance));
+            if(better)
+            {
+                *chunk = Vec2iGet(chunk_x, chunk_y);
+                nearest_distance = distance;
+                result_failed = failed;
+                result = true;
+            }
+        }
+    }
+    return result;
+}
+
+// Called by the thread around replacing a slot with another chunk
+LevelStreamSlot *LevelStreamWriteBegin(LevelStream *stream, Vec2i chunk)
+{
+    LevelStreamSlot *slot = LevelStreamSlotOf(stream, chunk.x, chunk.y);
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    slot->chunk = chunk;
+    return slot;
+}
+
+void LevelStreamWriteEnd(LevelStreamSlot *slot, LevelStreamSlotState state)
+{
+    slot->state = (uint32_t)state;
+    uint32_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&slot->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+// File offset of the chunk in the index of the level, 0 outside of it
+size_t LevelStreamIndexOffset(LevelStream *stream, Vec2i chunk)
+{
+    int idx_x = chunk.x - stream->chunk_p.x;
+    int idx_y = chunk.y - stream->chunk_p.y;
+    if(idx_x < 0 || idx_x >= stream->chunks_wide || idx_y < 0 || idx_y >= stream->chunks_high)
+        return 0;
+    
+    size_t result = (sizeof(LevelFileHeader)
+                     + ((size_t)idx_y * (size_t)stream->chunks_wide + (size_t)idx_x) * sizeof(uint32_t));
+    return result;
+}
+
+// GCC shifts negative values arithmetically, so the chunk rounds down.
+// With a stream the chunks come from there, the mapping is only read
+// when the thread hasn't loaded them yet.
+uint8_t LevelTile(Level *level, int tile_x, int tile_y)
+{
+    uint8_t streamed;
+    if(level->stream && LevelStreamTile(level->stream, tile_x, tile_y, &streamed))
+        return streamed;
+    
+    uint8_t *chunk = LevelChunk(level, tile_x >> LEVEL_CHUNK_SHIFT, tile_y >> LEVEL_CHUNK_SHIFT);
+    if(chunk == 0)
+        return 0;
+    
+    int local_x = tile_x & (LEVEL_CHUNK_SIZE - 1);
+    int local_y = tile_y & (LEVEL_CHUNK_SIZE - 1);
+    uint8_t result = chunk[local_y * LEVEL_CHUNK_SIZE + local_x];
+    return result;
+}
+
+Recti LevelTileRect(Level *level, int tile_x, int tile_y)
+{
+    int tile_size = level->tile_size;
+    Recti result = {{ tile_x * tile_size, tile_y * tile_size,
+            (tile_x + 1) * tile_size, (tile_y + 1) * tile_size }};
+    return result;
+}
+
+// Tiles the rect covers, false when it is empty
+bool LevelTileRange(Level *level, Recti rect, Vec2i *tile_min, Vec2i *tile_max)
+{
+    if(rect.x1 <= rect.x0 || rect.y1 <= rect.y0)
+        return false;
+    
+    tile_min->x = FloorDivide(rect.x0, level->tile_size);
+    tile_min->y = FloorDivide(rect.y0, level->tile_size);
+    tile_max->x = FloorDivide(rect.x1 - 1, level->tile_size);
+    tile_max->y = FloorDivide(rect.y1 - 1, level->tile_size);
+    return true;
+}
+
+bool LevelCheckOverlap(Level *level, Recti hitbox)
+{
+    Vec2i tile_min, tile_max;
+    if(!LevelTileRange(level, hitbox, &tile_min, &tile_max))
+        return false;
+    
+    for(int tile_y = tile_min.y; tile_y <= tile_max.y; ++tile_y)
+    {
+        for(int tile_x = tile_min.x; tile_x <= tile_max.x; ++tile_x)
+        {
+            if(LevelTile(level, tile_x, tile_y))
+                return true;
+        }
+    }
+    return false;
+}
+
+// How far the hitbox gets moving move units along one axis (0 for x, 1
+// for y) before it would overlap a solid tile. This is exactly where
+// walking it unit by unit stops, but it takes one pass over the tiles the
+// path crosses. Returns move when nothing is in the way.
+int LevelSweepAxis(Level *level, Recti hitbox, int move, int axis)
+{
+    ASSERT(axis == 0 || axis == 1);
+    int other = 1 - axis;
+    Recti path = hitbox;
+    path.p0.e[axis] += MIN(move, 0);
+    path.p1.e[axis] += MAX(move, 0);
+    
+    int result = move;
+    Vec2i tile_min, tile_max;
+    if(move == 0 || !LevelTileRange(level, path, &tile_min, &tile_max))
+        return result;
+    
+    for(int tile_y = tile_min.y; tile_y <= tile_max.y; ++tile_y)
+    {
+        for(int tile_x = tile_min.x; tile_x <= tile_max.x; ++tile_x)
+        {
+            if(!LevelTile(level, tile_x, tile_y))
+                continue;
+            
+            Recti obstacle = LevelTileRect(level, tile_x, tile_y);
+            if(hitbox.p1.e[other] <= obstacle.p0.e[other] || obstacle.p1.e[other] <= hitbox.p0.e[other])
+                continue;
+            
+            // the hitbox moved by k overlaps the tile for
+            // overlap_min <= k <= overlap_max, a step into that range is
+            // the one that gets refused
+            int overlap_min = obstacle.p0.e[axis] - hitbox.p1.e[axis] + 1;
+            int overlap_max = obstacle.p1.e[axis] - hitbox.p0.e[axis] - 1;
+            if(move > 0)
+            {
+                int contact = MAX(1, overlap_min);
+                if(contact <= overlap_max && contact <= result)
+                    result = contact - 1;
+            }
+            else
+            {
+                int contact = MIN(-1, overlap_max);
+                if(contact >= overlap_min && contact >= result)
+                    result = contact + 1;
+            }
+        }
+    }
+    return result;
+}
+
+#endif //LEVEL_H
@@ -0,0 +1,287 @@
+// Writes level files, see level.h. Without options it writes the default
+// level, --random adds platforms all over a bigger map to try out
+// levels that don't fit in memory at once.
+
+#include "base.h"
+#include "nisk_math.h"
+
+#include "networking.h"
+#include "nisk.h"
+
+#include <stdlib.h>       // calloc()
+#include <stdio.h>
+
+#include "level.h"
+
+#define LEVEL_TOOL_TILE_SIZE 8 // has to match meters_to_units
+
+// Atlas columns of the obstacle tiles, a wide and high obstacle takes a
+// 3x3 frame made of three runs of 3 columns, from the top row down
+#define ATLAS_BIG_TOP 0
+#define ATLAS_BIG_MIDDLE 3
+#define ATLAS_BIG_BOTTOM 6
+#define ATLAS_HORIZONTAL 9
+#define ATLAS_VERTICAL 12
+#define ATLAS_DOT 15
+
+// Tiles of the whole level while it gets built, row by row from the lower
+// left tile of the lower left chunk
+typedef struct LevelBuilder
+{
+    Vec2i chunk_p;
+    int chunks_wide, chunks_high;
+    int tiles_wide, tiles_high;
+    uint8_t *tiles;
+} LevelBuilder;
+
+bool LevelBuilderInit(LevelBuilder *builder, Vec2i chunk_p, int chunks_wide, int chunks_high)
+{
+    builder->chunk_p = chunk_p;
+    builder->chunks_wide = chunks_wide;
+    builder->chunks_high = chunks_high;
+    builder->tiles_wide = chunks_wide * LEVEL_CHUNK_SIZE;
+    builder->tiles_high = chunks_high * LEVEL_CHUNK_SIZE;
+    builder->tiles = (uint8_t *)calloc((size_t)builder->tiles_wide * (size_t)builder->tiles_high, 1);
+    if(builder->tiles == 0)
+    {
+        fprintf(stderr, "[ERROR] Allocate %dx%d chunks\n", chunks_wide, chunks_high);
+        return false;
+    }
+    return true;
+}
+
+uint8_t *LevelBuilderTile(LevelBuilder *builder, int tile_x, int tile_y)
+{
+    int idx_x = tile_x - builder->chunk_p.x * LEVEL_CHUNK_SIZE;
+    int idx_y = tile_y - builder->chunk_p.y * LEVEL_CHUNK_SIZE;
+    if(idx_x < 0 || idx_x >= builder->tiles_wide || idx_y < 0 || idx_y >= builder->tiles_high)
+        return 0;
+    
+    uint8_t *result = builder->tiles + (size_t)idx_y * (size_t)builder->tiles_wide + (size_t)idx_x;
+    return result;
+}
+
+// Rect of tiles drawn as one obstacle, the same way the obstacles were
+// drawn before levels were tilemaps
+void LevelBuilderObstacle(LevelBuilder *builder, int pos_x, int pos_y, int width, int height)
+{
+    ASSERT(width > 0 && height > 0);
+    bool wide = (width > 1);
+    bool high = (height > 1);
+    for(int tile_y = 0; tile_y < height; ++tile_y)
+    {
+        for(int tile_x = 0; tile_x < width; ++tile_x)
+        {
+            int edge_x = (tile_x == width - 1 ? 2 : tile_x > 0 ? 1 : 0);
+            int edge_y = (tile_y == height - 1 ? 0 : tile_y > 0 ? 1 : 2);
+            
+            int column;
+            if(wide && high)
+                column = (edge_y == 0 ? ATLAS_BIG_TOP    :
+                          edge_y == 1 ? ATLAS_BIG_MIDDLE :
+                          ATLAS_BIG_BOTTOM) + edge_x;
+            else if(wide)
+                column = ATLAS_HORIZONTAL + edge_x;
+            else if(high)
+                column = ATLAS_VERTICAL + edge_y;
+            else
+                column = ATLAS_DOT;
+            
+            uint8_t *tile = LevelBuilderTile(builder, pos_x + tile_x, pos_y + tile_y);
+            if(tile)
+                *tile = (uint8_t)(column + 1);
+        }
+    }
+}
+
+void LevelBuilderDefault(LevelBuilder *builder)
+{
+    LevelBuilderObstacle(builder, -8, -8, 16, 2);
+    LevelBuilderObstacle(builder, -6, -5, 4, 1);
+    LevelBuilderObstacle(builder,  0, -5, 2, 1);
+    LevelBuilderObstacle(builder,  3, -5, 1, 1);
+    LevelBuilderObstacle(builder,  5, -5, 1, 2);
+    LevelBuilderObstacle(builder, -1, -1, 2, 2);
+}
+
+uint32_t XorShift32(uint32_t *state)
+{
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+// A few platforms in every chunk, the default level stays in the middle
+// and nothing gets placed around it so players still spawn on it
+void LevelBuilderRandom(LevelBuilder *builder, uint32_t seed)
+{
+    uint32_t random = (seed ? seed : 1);
+    for(int chunk_y = 0; chunk_y < builder->chunks_high; ++chunk_y)
+    {
+        for(int chunk_x = 0; chunk_x < builder->chunks_wide; ++chunk_x)
+        {
+            int platform_count = 4 + (int)(XorShift32(&random) % 8);
+            for(int platform_idx = 0; platform_idx < platform_count; ++platform_idx)
+            {
+                int width = 1 + (int)(XorShift32(&random) % 12);
+                int height = 1 + (int)(XorShift32(&random) % 3);
+                int pos_x = ((builder->chunk_p.x + chunk_x) * LEVEL_CHUNK_SIZE
+                             + (int)(XorShift32(&random) % (uint32_t)(LEVEL_CHUNK_SIZE - width)));
+                int pos_y = ((builder->chunk_p.y + chunk_y) * LEVEL_CHUNK_SIZE
+                             + (int)(XorShift32(&random) % (uint32_t)(LEVEL_CHUNK_SIZE - height)));
+                
+                bool near_spawn = (pos_x + width > -12 && pos_x < 12 && pos_y + height > -10 && pos_y < 8);
+                if(!near_spawn)
+                    LevelBuilderObstacle(builder, pos_x, pos_y, width, height);
+            }
+        }
+    }
+    LevelBuilderDefault(builder);
+}
+
+bool LevelBuilderChunkIsEmpty(LevelBuilder *builder, int chunk_x, int chunk_y)
+{
+    for(int tile_y = 0; tile_y < LEVEL_CHUNK_SIZE; ++tile_y)
+    {
+        uint8_t *row = LevelBuilderTile(builder, chunk_x * LEVEL_CHUNK_SIZE, chunk_y * LEVEL_CHUNK_SIZE + tile_y);
+        for(int tile_x = 0; tile_x < LEVEL_CHUNK_SIZE; ++tile_x)
+        {
+            if(row[tile_x])
+                return false;
+        }
+    }
+    return true;
+}
+
+// Chunks without a solid tile only get a 0 in the index
+bool LevelBuilderWrite(LevelBuilder *builder, char *path)
+{
+    FILE *file = fopen(path, "wb");
+    if(file == 0)
+    {
+        fprintf(stderr, "[ERROR] Open %s\n", path);
+        return false;
+    }
+    
+    LevelFileHeader header;
+    header.magic = LEVEL_FILE_MAGIC;
+    header.version = LEVEL_FILE_VERSION;
+    header.chunk_size = LEVEL_CHUNK_SIZE;
+    header.tile_size = LEVEL_TOOL_TILE_SIZE;
+    header.chunk_x = builder->chunk_p.x;
+    header.chunk_y = builder->chunk_p.y;
+    header.chunks_wide = (uint32_t)builder->chunks_wide;
+    header.chunks_high = (uint32_t)builder->chunks_high;
+    
+    size_t chunk_count = (size_t)builder->chunks_wide * (size_t)builder->chunks_high;
+    uint32_t *offsets = (uint32_t *)calloc(chunk_count, sizeof(uint32_t));
+    if(offsets == 0)
+    {
+        fclose(file);
+        return false;
+    }
+    
+    size_t offset = sizeof(LevelFileHeader) + chunk_count * sizeof(uint32_t);
+    unsigned int stored_count = 0;
+    for(int idx_y = 0; idx_y < builder->chunks_high; ++idx_y)
+    {
+        for(int idx_x = 0; idx_x < builder->chunks_wide; ++idx_x)
+        {
+            int chunk_x = builder->chunk_p.x + idx_x;
+            int chunk_y = builder->chunk_p.y + idx_y;
+            if(LevelBuilderChunkIsEmpty(builder, chunk_x, chunk_y))
+                continue;
+            
+            offsets[idx_y * builder->chunks_wide + idx_x] = (uint32_t)offset;
+            offset += LEVEL_CHUNK_BYTES;
+            ++stored_count;
+        }
+    }
+    
+    bool result = (offset <= 0xFFFFFFFFu);
+    if(!result)
+        fprintf(stderr, "[ERROR] Level doesn't fit 32 bit offsets\n");
+    
+    result = result && fwrite(&header, sizeof(header), 1, file) == 1;
+    result = result && fwrite(offsets, sizeof(uint32_t), chunk_count, file) == chunk_count;
+    for(int idx_y = 0; result && idx_y < builder->chunks_high; ++idx_y)
+    {
+        for(int idx_x = 0; result && idx_x < builder->chunks_wide; ++idx_x)
+        {
+            if(offsets[idx_y * builder->chunks_wide + idx_x] == 0)
+                continue;
+            
+            int chunk_x = builder->chunk_p.x + idx_x;
+            int chunk_y = builder->chunk_p.y + idx_y;
+            for(int tile_y = 0; result && tile_y < LEVEL_CHUNK_SIZE; ++tile_y)
+            {
+                uint8_t *row = LevelBuilderTile(builder, chunk_x * LEVEL_CHUNK_SIZE, chunk_y * LEVEL_CHUNK_SIZE + tile_y);
+                result = (fwrite(row, 1, LEVEL_CHUNK_SIZE, file) == LEVEL_CHUNK_SIZE);
+            }
+        }
+    }
+    
+    if(fclose(file) != 0 || !result)
+    {
+        fprintf(stderr, "[ERROR] Write %s\n", path);
+        result = false;
+    }
+    else
+        printf("Wrote %s: %dx%d chunks, %u stored, %zu bytes\n",
+               path, builder->chunks_wide, builder->chunks_high, stored_count, offset);
+    
+    free(offsets);
+    return result;
+}
+
+void PrintUsage(void)
+{
+    printf("Usage:   level.out <path> [--random <chunks wide> <chunks high> <seed>]\n"
+           "Example: level.out ../assets/default.nlvl\n"
+           "         level.out /tmp/big.nlvl --random 256 64 7\n");
+}
+
+bool ArgumentIs(char *argument, char *name)
+{
+    bool result = StringCompare(argument, StringLength(argument), name, StringLength(name));
+    return result;
+}
+
+int main(int argc, char **argv)
+{
+    if(argc != 2 && !(argc == 6 && ArgumentIs(argv[2], "--random")))
+    {
+        PrintUsage();
+        return -1;
+    }
+    
+    LevelBuilder builder;
+    if(argc == 2)
+    {
+        if(!LevelBuilderInit(&builder, Vec2iGet(-1, -1), 2, 2))
+            return -1;
+        LevelBuilderDefault(&builder);
+    }
+    else
+    {
+        int chunks_wide = 0, chunks_high = 0;
+        unsigned int seed = 0;
+        if(sscanf(argv[3], "%d", &chunks_wide) != 1 || sscanf(argv[4], "%d", &chunks_high) != 1
+           || sscanf(argv[5], "%u", &seed) != 1 || chunks_wide < 2 || chunks_high < 2)
+        {
+            PrintUsage();
+            return -1;
+        }
+        
+        Vec2i chunk_p = Vec2iGet(-chunks_wide/2, -chunks_high/2);
+        if(!LevelBuilderInit(&builder, chunk_p, chunks_wide, chunks_high))
+            return -1;
+        LevelBuilderRandom(&builder, seed);
+    }
+    
+    int result = (LevelBuilderWrite(&builder, argv[1]) ? 0 : -1);
+    return result;
+}
@@ -0,0 +1,506 @@
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+
+// The game itself, bots run it without a window. Every bot is a whole
+// client with its own GameData and socket, the platform layer below only
+// swaps rendering for nothing and counts the traffic.
+#include "nisk.c"
+
+#include <netinet/in.h>   // sockaddr_in
+#include <arpa/inet.h>    // inet_addr
+#include <fcntl.h>        // set file/socket handle to non-blocking
+#include <unistd.h>       // write(), close()
+#include <errno.h>        // socket error handling
+#include <sys/socket.h>   // recvmmsg, sendmmsg
+#include <sys/mman.h>     // mmap
+#include <sys/stat.h>     // size of the level file
+#include <sys/resource.h> // file descriptor limit
+#include <time.h>         // clock_nanosleep()
+#include <pthread.h>      // bot threads
+
+#include "linux_networking.c"
+#include "linux_files.c"
+
+#define BOT_FRAME_HZ 60
+#define BOT_MAX_COUNT 16384
+#define BOT_MAX_THREADS 64
+
+typedef struct BotConfig
+{
+    unsigned int bot_count;
+    unsigned int thread_count;
+    char *address;
+    char *port;
+    char *level_path;
+    float seconds;        // 0 runs until killed
+    float connect_rate;   // bots started per second
+    float report_interval; // in seconds
+} BotConfig;
+
+typedef struct Bot
+{
+    GameMemory memory;
+    Input input;
+    char nickname[32];
+    char *argv[6];
+    bool running;
+    
+    // scripted movement
+    uint32_t random;
+    float turn_time;
+    int move_x;
+    
+    int64_t reported_tick; // newest server tick at the last report
+} Bot;
+
+// traffic of the bots of a thread since the last report
+typedef struct BotTraffic
+{
+    uint64_t packets_sent;
+    uint64_t bytes_sent;
+    uint64_t packets_recieved;
+    uint64_t bytes_recieved;
+} BotTraffic;
+
+// the platform calls don't know which bot they are for, counting per
+// thread keeps the threads off each other's counters
+__thread BotTraffic global_traffic;
+
+// What the bots of every thread saw of the server since the last report.
+// Each thread adds its part, the last one to do so prints it.
+typedef struct BotReport
+{
+    unsigned int started_count;
+    unsigned int connected_count;
+    unsigned int correction_count;
+    int64_t ticks_advanced;
+    unsigned int ticking_count;
+    float frame_ms_max;
+    BotTraffic traffic;
+} BotReport;
+
+typedef struct BotReportShared
+{
+    pthread_mutex_t mutex;
+    unsigned int thread_count;
+    unsigned int reported_count;
+    BotReport report;
+} BotReportShared;
+
+typedef struct BotThread
+{
+    BotConfig *config;
+    Platform *platform;
+    BotReportShared *shared;
+    Bot *bots;
+    unsigned int first_idx; // of all the bots
+    unsigned int bot_count;
+    int64_t start_ns;
+} BotThread;
+
+void BotLoadTextureEx(TextureID texture_id, char *filename, int opt_tile_w, int opt_tile_h)
+{
+    (void)texture_id; (void)filename; (void)opt_tile_w; (void)opt_tile_h;
+}
+
+void BotBlitTextureTileCoord(TextureID texture_id, int t_x, int t_y,
+                             int x0, int y0, int x1, int y1, bool flip_h)
+{
+    (void)texture_id; (void)t_x; (void)t_y;
+    (void)x0; (void)y0; (void)x1; (void)y1; (void)flip_h;
+}
+
+bool BotSocketSend(int sockfd, Address *destination, void *data, int size)
+{
+    ++global_traffic.packets_sent;
+    global_traffic.bytes_sent += (uint64_t)size;
+    bool result = SocketSend(sockfd, destination, data, size);
+    return result;
+}
+
+unsigned int BotSocketRecieveBatch(int sockfd, SocketBatch *batch)
+{
+    unsigned int result = SocketRecieveBatch(sockfd, batch);
+    for(unsigned int packet_idx = 0; packet_idx < result; ++packet_idx)
+    {
+        ++global_traffic.packets_recieved;
+        global_traffic.bytes_recieved += (uint64_t)MAX(batch->packets[packet_idx].size, 0);
+    }
+    return result;
+}
+
+unsigned int BotInetAddrWrap(char *addr)
+{
+    unsigned int result = ntohl(inet_addr(addr));
+    return result;
+}
+
+// xorshift32, every bot has its own seed so runs repeat
+uint32_t BotRandom(Bot *bot)
+{
+    uint32_t x = bot->random;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    bot->random = x;
+    return x;
+}
+
+float BotRandomUnit(Bot *bot)
+{
+    float result = (float)(BotRandom(bot) >> 8) / (float)(1 << 24);
+    return result;
+}
+
+// Runs left and right, turning every one to three seconds, and jumps and
+// casts spells now and then
+void BotScriptInput(Bot *bot, float dt)
+{
+    InputDevice *keyboard = &bot->input.input_devices[InputDevice_Keyboard];
+    MEMORY_SET(keyboard->keys_down, 0, sizeof(keyboard->keys_down));
+    
+    bot->turn_time -= dt;
+    if(bot->turn_time <= 0)
+    {
+        bot->turn_time = 1.0f + 2.0f * BotRandomUnit(bot);
+        bot->move_x = (int)(BotRandom(bot) % 3) - 1;
+    }
+    
+    keyboard->keys_down[Input_DPadLeft] = (bot->move_x < 0);
+    keyboard->keys_down[Input_DPadRight] = (bot->move_x > 0);
+    keyboard->keys_down[Input_DPadUp] = (BotRandomUnit(bot) < 0.02f);
+    keyboard->keys_down[Input_BumperRight] = (BotRandomUnit(bot) < 0.01f);
+}
+
+void PrintUsage(void)
+{
+    printf("Usage:   bot.out [--bots <count>] [--address <address>] [--port <port>]\n"
+           "                 [--seconds <seconds>] [--connect-rate <bots per second>]\n"
+           "                 [--report-interval <seconds>] [--threads <count>]\n"
+           "                 [--level <path>]\n"
+           "Example: bot.out --bots 2000 --threads 8 --address 127.0.0.1 --seconds 60\n");
+}
+
+bool ArgumentIs(char *argument, char *name)
+{
+    bool result = StringCompare(argument, StringLength(argument), name, StringLength(name));
+    return result;
+}
+
+bool ParseBotConfig(BotConfig *config, int argc, char **argv)
+{
+    config->bot_count = 256;
+    config->thread_count = 1;
+    config->address = "127.0.0.1";
+    config->port = "54321";
+    config->level_path = LEVEL_DEFAULT_PATH;
+    config->seconds = 0.0f;
+    config->connect_rate = 500.0f;
+    config->report_interval = 5.0f;
+    
+    for(int arg_idx = 1; arg_idx + 1 < argc; arg_idx += 2)
+    {
+        char *argument = argv[arg_idx];
+        char *value = argv[arg_idx + 1];
+        bool parsed = false;
+        
+        if(ArgumentIs(argument, "--bots"))
+            parsed = (sscanf(value, "%u", &config->bot_count) == 1);
+        else if(ArgumentIs(argument, "--threads"))
+            parsed = (sscanf(value, "%u", &config->thread_count) == 1);
+        else if(ArgumentIs(argument, "--seconds"))
+            parsed = (sscanf(value, "%f", &config->seconds) == 1);
+        else if(ArgumentIs(argument, "--connect-rate"))
+            parsed = (sscanf(value, "%f", &config->connect_rate) == 1);
+        else if(ArgumentIs(argument, "--report-interval"))
+            parsed = (sscanf(value, "%f", &config->report_interval) == 1);
+        else if(ArgumentIs(argument, "--address"))
+            parsed = ((config->address = value) != 0);
+        else if(ArgumentIs(argument, "--port"))
+            parsed = ((config->port = value) != 0);
+        else if(ArgumentIs(argument, "--level"))
+            parsed = ((config->level_path = value) != 0);
+        
+        if(!parsed)
+        {
+            PrintUsage();
+            return false;
+        }
+    }
+    
+    if(argc % 2 == 0)
+    {
+        PrintUsage();
+        return false;
+    }
+    
+    if(config->bot_count == 0 || config->bot_count > BOT_MAX_COUNT)
+    {
+        fprintf(stderr, "[ERROR] Bots have to be in range 1..%d\n", BOT_MAX_COUNT);
+        return false;
+    }
+    
+    if(config->thread_count == 0 || config->thread_count > BOT_MAX_THREADS)
+    {
+        fprintf(stderr, "[ERROR] Threads have to be in range 1..%d\n", BOT_MAX_THREADS);
+        return false;
+    }
+    
+    if(config->connect_rate <= 0 || config->report_interval <= 0)
+    {
+        fprintf(stderr, "[ERROR] Connect rate and report interval have to be positive\n");
+        return false;
+    }
+    
+    return true;
+}
+
+// Every bot holds a socket, the default limit of 1024 descriptors is not
+// enough for a crowd
+bool RaiseDescriptorLimit(unsigned int needed)
+{
+    struct rlimit limit;
+    if(getrlimit(RLIMIT_NOFILE, &limit) != 0)
+        return false;
+    
+    if(limit.rlim_cur < needed)
+    {
+        limit.rlim_cur = MIN(limit.rlim_max, (rlim_t)needed);
+        if(setrlimit(RLIMIT_NOFILE, &limit) != 0 || limit.rlim_cur < needed)
+        {
+            fprintf(stderr, "[ERROR] Need %u file descriptors, the limit is %lu\n",
+                    needed, (unsigned long)limit.rlim_cur);
+            return false;
+        }
+    }
+    return true;
+}
+
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+int64_t MonotonicNanoseconds(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t result = (int64_t)now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+    return result;
+}
+
+// Adds what the bots of a thread saw since the last report
+void BotReportAdd(BotReport *report, Bot *bots, unsigned int started_count)
+{
+    report->started_count += started_count;
+    for(unsigned int bot_idx = 0; bot_idx < started_count; ++bot_idx)
+    {
+        Bot *bot = bots + bot_idx;
+        GameData *game_data = (GameData *)bot->memory.permanent_storage;
+        if(!game_data->connected)
+            continue;
+        
+        ++report->connected_count;
+        report->correction_count += game_data->correction_count;
+        game_data->correction_count = 0;
+        if(game_data->has_tick_clock)
+        {
+            if(bot->reported_tick != 0)
+            {
+                report->ticks_advanced += game_data->newest_tick_unwrapped - bot->reported_tick;
+                ++report->ticking_count;
+            }
+            bot->reported_tick = game_data->newest_tick_unwrapped;
+        }
+    }
+    
+    BotTraffic *traffic = &global_traffic;
+    report->traffic.packets_sent += traffic->packets_sent;
+    report->traffic.bytes_sent += traffic->bytes_sent;
+    report->traffic.packets_recieved += traffic->packets_recieved;
+    report->traffic.bytes_recieved += traffic->bytes_recieved;
+    MEMORY_SET(traffic, 0, sizeof(BotTraffic));
+}
+
+// The tick rate the bots see drops below the update rate of the server
+// once its ticks run late
+void BotReportPrint(BotReport *report, BotConfig *config)
+{
+    BotTraffic *traffic = &report->traffic;
+    double per_client = (report->connected_count > 0 ? 1.0 / (double)report->connected_count : 0.0);
+    double per_second = 1.0 / (double)config->report_interval;
+    double tick_rate = (report->ticking_count > 0
+                        ? (double)report->ticks_advanced / (double)report->ticking_count * per_second
+                        : 0.0);
+    printf("bots: %u/%u connected  server ticks/s: %.1f  frame max: %.2fms  corrections: %u\n"
+           "  sent: %.0f pkts/s %.0f B/s per client  recieved: %.0f pkts/s %.0f B/s per client\n",
+           report->connected_count, report->started_count, tick_rate,
+           (double)report->frame_ms_max, report->correction_count,
+           (double)traffic->packets_sent * per_second,
+           (double)traffic->bytes_sent * per_second * per_client,
+           (double)traffic->packets_recieved * per_second,
+           (double)traffic->bytes_recieved * per_second * per_client);
+    fflush(stdout);
+}
+
+void *BotThreadRun(void *data)
+{
+    BotThread *thread = (BotThread *)data;
+    BotConfig *config = thread->config;
+    BotReportShared *shared = thread->shared;
+    
+    int64_t frame_ns = NANOSECONDS_PER_SECOND / BOT_FRAME_HZ;
+    int64_t report_ns = (int64_t)(config->report_interval * (float)NANOSECONDS_PER_SECOND);
+    int64_t next_frame_ns = thread->start_ns;
+    int64_t last_frame_ns = thread->start_ns;
+    int64_t next_report_ns = thread->start_ns + report_ns;
+    float frame_ms_max = 0.0f;
+    
+    while(true)
+    {
+        int64_t now_ns = MonotonicNanoseconds();
+        float elapsed = (float)(now_ns - thread->start_ns) / (float)NANOSECONDS_PER_SECOND;
+        if(config->seconds > 0 && elapsed >= config->seconds)
+        {
+            for(unsigned int bot_idx = 0; bot_idx < thread->bot_count; ++bot_idx)
+                GameShutdown(&thread->bots[bot_idx].memory, thread->platform);
+            break;
+        }
+        
+        // a slow frame gets the time it took, up to a limit
+        float dt = (float)(now_ns - last_frame_ns) / (float)NANOSECONDS_PER_SECOND;
+        dt = CLAMP(1.0f / (float)BOT_FRAME_HZ, dt, 0.1f);
+        last_frame_ns = now_ns;
+        
+        // bots are started at connect_rate across all the threads
+        unsigned int total_started = MIN(config->bot_count, (unsigned int)(elapsed * config->connect_rate) + 1);
+        unsigned int started_count = 0;
+        if(total_started > thread->first_idx)
+            started_count = MIN(thread->bot_count, total_started - thread->first_idx);
+        
+        for(unsigned int bot_idx = 0; bot_idx < started_count; ++bot_idx)
+        {
+            Bot *bot = thread->bots + bot_idx;
+            if(!bot->running)
+                continue;
+            
+            bot->input.dt = dt;
+            BotScriptInput(bot, dt);
+            GameUpdateAndRender(&bot->memory, thread->platform, &bot->input, &bot->running);
+        }
+        
+        float frame_ms = (float)(MonotonicNanoseconds() - now_ns) / 1000000.0f;
+        frame_ms_max = MAX(frame_ms_max, frame_ms);
+        if(now_ns >= next_report_ns)
+        {
+            pthread_mutex_lock(&shared->mutex);
+            BotReportAdd(&shared->report, thread->bots, started_count);
+            shared->report.frame_ms_max = MAX(shared->report.frame_ms_max, frame_ms_max);
+            if(++shared->reported_count == shared->thread_count)
+            {
+                BotReportPrint(&shared->report, config);
+                MEMORY_SET(&shared->report, 0, sizeof(BotReport));
+                shared->reported_count = 0;
+            }
+            pthread_mutex_unlock(&shared->mutex);
+            
+            next_report_ns += report_ns;
+            frame_ms_max = 0.0f;
+        }
+        
+        next_frame_ns += frame_ns;
+        if(next_frame_ns < now_ns)
+            next_frame_ns = now_ns;
+        struct timespec deadline;
+        deadline.tv_sec = (time_t)(next_frame_ns / NANOSECONDS_PER_SECOND);
+        deadline.tv_nsec = (long)(next_frame_ns % NANOSECONDS_PER_SECOND);
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, 0);
+    }
+    
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    BotConfig config;
+    if(!ParseBotConfig(&config, argc, argv))
+        return -1;
+    
+    if(!RaiseDescriptorLimit(config.bot_count + 16))
+        return -1;
+    
+    // pages of a GameData only get touched as far as a bot uses them
+    size_t storage_size = sizeof(GameData);
+    size_t memory_size = config.bot_count * (sizeof(Bot) + storage_size);
+    void *memory = mmap(0, memory_size, PROT_READ | PROT_WRITE,
+                        MAP_ANON | MAP_PRIVATE | MAP_NORESERVE, -1, 0);
+    if(memory == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Allocate bot memory\n");
+        return -1;
+    }
+    MemoryArena arena;
+    InitializeArena(&arena, (uint8_t *)memory, memory_size);
+    Bot *bots = PUSH_ARRAY(&arena, Bot, config.bot_count);
+    
+    local_persist Platform platform;
+    platform.load_texture_ex         = &BotLoadTextureEx;
+    platform.blit_texture_tile_coord = &BotBlitTextureTileCoord;
+    platform.socket_create           = &SocketCreate;
+    platform.socket_close            = &SocketClose;
+    platform.socket_send             = &BotSocketSend;
+    platform.socket_recieve          = &SocketRecieve;
+    platform.socket_recieve_batch    = &BotSocketRecieveBatch;
+    platform.socket_send_batch       = &SocketSendBatch;
+    platform.inet_addr_wrap          = &BotInetAddrWrap;
+    platform.map_file                = &LinuxMapFile;
+    
+    for(unsigned int bot_idx = 0; bot_idx < config.bot_count; ++bot_idx)
+    {
+        Bot *bot = bots + bot_idx;
+        bot->memory.permanent_storage = PUSH_ARRAY(&arena, uint8_t, storage_size);
+        bot->memory.permanent_storage_size = storage_size;
+        snprintf(bot->nickname, sizeof(bot->nickname), "bot%u", bot_idx);
+        bot->argv[0] = argv[0];
+        bot->argv[1] = bot->nickname;
+        bot->argv[2] = config.address;
+        bot->argv[3] = config.port;
+        bot->argv[4] = "--level";
+        bot->argv[5] = config.level_path;
+        bot->input.argc = ARRAY_SIZE(bot->argv);
+        bot->input.argv = bot->argv;
+        bot->input.screen_size = Vec2iGet(800, 600);
+        bot->running = true;
+        bot->random = 2463534242u + bot_idx * 2654435761u;
+    }
+    
+    local_persist BotReportShared shared;
+    pthread_mutex_init(&shared.mutex, 0);
+    shared.thread_count = config.thread_count;
+    
+    // every thread runs a contiguous range of the bots
+    local_persist BotThread threads[BOT_MAX_THREADS];
+    pthread_t thread_handles[BOT_MAX_THREADS];
+    int64_t start_ns = MonotonicNanoseconds();
+    unsigned int first_idx = 0;
+    for(unsigned int thread_idx = 0; thread_idx < config.thread_count; ++thread_idx)
+    {
+        unsigned int remaining = config.thread_count - thread_idx;
+        BotThread *thread = threads + thread_idx;
+        thread->config = &config;
+        thread->platform = &platform;
+        thread->shared = &shared;
+        thread->first_idx = first_idx;
+        thread->bot_count = (config.bot_count - first_idx + remaining - 1) / remaining;
+        thread->bots = bots + first_idx;
+        thread->start_ns = start_ns;
+        first_idx += thread->bot_count;
+        
+        if(pthread_create(thread_handles + thread_idx, 0, BotThreadRun, thread) != 0)
+        {
+            fprintf(stderr, "[ERROR] Start bot thread\n");
+            return -1;
+        }
+    }
+    
+    for(unsigned int thread_idx = 0; thread_idx < config.thread_count; ++thread_idx)
+        pthread_join(thread_handles[thread_idx], 0);
+    
+    return 0;
+}
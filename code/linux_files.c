@@ -0,0 +1,25 @@
+// Maps a whole file read only, returns 0 if it can't. The mapping stays
+// for as long as the process runs.
+void *LinuxMapFile(char *path, size_t *size)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+    if(fd < 0 || fstat(fd, &file_stat) < 0 || file_stat.st_size == 0)
+    {
+        fprintf(stderr, "[ERROR] Open file %s\n", path);
+        if(fd >= 0)
+            close(fd);
+        return 0;
+    }
+    
+    void *result = mmap(0, (size_t)file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(result == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Map file %s\n", path);
+        return 0;
+    }
+    
+    *size = (size_t)file_stat.st_size;
+    return result;
+}
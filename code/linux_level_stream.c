@@ -0,0 +1,161 @@
+// Thread that fills the LevelStream of the client, see level.h. It reads
+// the chunks with its own handle of the level file, so the file only ever
+// takes up page cache, not memory of the client, and the frame doesn't
+// fault on pages of the mapping for chunks around the camera. The chunks
+// asked for by the time the stream starts are read before it returns,
+// that covers the spawn.
+
+#define LINUX_LEVEL_STREAM_IDLE_MIN_NS 2000000    // between looks at the request,
+#define LINUX_LEVEL_STREAM_IDLE_MAX_NS 32000000   // doubled while nothing changes
+#define LINUX_LEVEL_STREAM_RETRY_NS    250000000  // before reading a failed chunk again
+
+typedef struct LinuxLevelStream
+{
+    LevelStream *stream;
+    int fd;
+    int64_t next_retry_ns;
+} LinuxLevelStream;
+
+global LinuxLevelStream global_level_stream;
+
+int64_t LinuxLevelStreamNanoseconds(void)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t result = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    return result;
+}
+
+bool LinuxReadAt(int fd, void *data, size_t size, size_t offset)
+{
+    uint8_t *at = (uint8_t *)data;
+    while(size > 0)
+    {
+        ssize_t read_size = pread(fd, at, size, (off_t)offset);
+        if(read_size < 0 && errno == EINTR)
+            continue;
+        if(read_size <= 0)
+            return false;
+        
+        at += read_size;
+        size -= (size_t)read_size;
+        offset += (size_t)read_size;
+    }
+    return true;
+}
+
+LevelStreamSlotState LinuxLevelStreamLoad(LinuxLevelStream *linux_stream, Vec2i chunk, uint8_t *tiles)
+{
+    LevelStream *stream = linux_stream->stream;
+    size_t index_offset = LevelStreamIndexOffset(stream, chunk);
+    if(index_offset == 0)
+        return LevelStreamSlot_Air;
+    
+    uint32_t offset;
+    if(!LinuxReadAt(linux_stream->fd, &offset, sizeof(offset), index_offset))
+        return LevelStreamSlot_Failed;
+    
+    // the same checks as LevelChunk
+    if(offset == 0 || (size_t)offset + LEVEL_CHUNK_BYTES > stream->file_size)
+        return LevelStreamSlot_Air;
+    
+    if(!LinuxReadAt(linux_stream->fd, tiles, LEVEL_CHUNK_BYTES, offset))
+        return LevelStreamSlot_Failed;
+    
+    return LevelStreamSlot_Solid;
+}
+
+// Loads the next missing chunk, false when there is none. Failed chunks
+// are tried again every LINUX_LEVEL_STREAM_RETRY_NS at most.
+bool LinuxLevelStreamLoadNext(LinuxLevelStream *linux_stream)
+{
+    LevelStream *stream = linux_stream->stream;
+    local_persist uint8_t tiles[LEVEL_CHUNK_BYTES];
+    int64_t now_ns = LinuxLevelStreamNanoseconds();
+    bool retry = (now_ns >= linux_stream->next_retry_ns);
+    Vec2i chunk;
+    if(!LevelStreamNextChunk(stream, retry, &chunk))
+        return false;
+    
+    // the slot is only taken once the chunk is read, readers see the
+    // old chunk up to then
+    LevelStreamSlotState state = LinuxLevelStreamLoad(linux_stream, chunk, tiles);
+    LevelStreamSlot *slot = LevelStreamSlotOf(stream, chunk.x, chunk.y);
+    if(state == LevelStreamSlot_Failed)
+    {
+        bool failed_before = (slot->state == LevelStreamSlot_Failed
+                              && slot->chunk.x == chunk.x && slot->chunk.y == chunk.y);
+        if(!failed_before)
+            fprintf(stderr, "[ERROR] Read level chunk %d, %d\n", chunk.x, chunk.y);
+        linux_stream->next_retry_ns = now_ns + LINUX_LEVEL_STREAM_RETRY_NS;
+    }
+    
+    slot = LevelStreamWriteBegin(stream, chunk);
+    if(state == LevelStreamSlot_Solid)
+        MEMORY_COPY(slot->tiles, tiles, LEVEL_CHUNK_BYTES);
+    LevelStreamWriteEnd(slot, state);
+    return true;
+}
+
+void *LinuxLevelStreamRun(void *data)
+{
+    LinuxLevelStream *linux_stream = (LinuxLevelStream *)data;
+    LevelStream *stream = linux_stream->stream;
+    int64_t idle_ns = LINUX_LEVEL_STREAM_IDLE_MIN_NS;
+    uint32_t idle_sequence = 0;
+    while(true)
+    {
+        if(LinuxLevelStreamLoadNext(linux_stream))
+        {
+            idle_ns = LINUX_LEVEL_STREAM_IDLE_MIN_NS;
+            continue;
+        }
+        
+        // the frame only writes the request when the chunks in view
+        // change, until then there is nothing to do
+        uint32_t sequence = __atomic_load_n(&stream->request_sequence, __ATOMIC_RELAXED);
+        if(sequence != idle_sequence)
+            idle_ns = LINUX_LEVEL_STREAM_IDLE_MIN_NS;
+        else
+            idle_ns = MIN(2 * idle_ns, LINUX_LEVEL_STREAM_IDLE_MAX_NS);
+        idle_sequence = sequence;
+        
+        timespec wait = { 0, (long)idle_ns };
+        nanosleep(&wait, 0);
+    }
+    return 0;
+}
+
+// Starts the thread, there is one stream for the whole client
+bool LinuxStreamLevel(LevelStream *stream, char *path)
+{
+    ASSERT(global_level_stream.stream == 0);
+    int fd = open(path, O_RDONLY);
+    if(fd < 0)
+    {
+        fprintf(stderr, "[ERROR] Open file %s\n", path);
+        return false;
+    }
+    
+    global_level_stream.stream = stream;
+    global_level_stream.fd = fd;
+    global_level_stream.next_retry_ns = 0;
+    
+    // every slot at most once, a failed chunk isn't retried until later
+    for(unsigned int slot_idx = 0; slot_idx < ARRAY_SIZE(stream->slots); ++slot_idx)
+    {
+        if(!LinuxLevelStreamLoadNext(&global_level_stream))
+            break;
+    }
+    
+    pthread_t thread;
+    if(pthread_create(&thread, 0, LinuxLevelStreamRun, &global_level_stream) != 0)
+    {
+        fprintf(stderr, "[ERROR] Start level stream thread\n");
+        close(fd);
+        global_level_stream.stream = 0;
+        return false;
+    }
+    pthread_detach(thread);
+    return true;
+}
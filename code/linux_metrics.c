@@ -0,0 +1,183 @@
+// Reads the live metrics a server publishes with --metrics and prints
+// them every interval, see server_metrics.h. Only ever reads the file,
+// the server doesn't notice how many of these watch it.
+
+#include "base.h"
+
+#include "networking.h"
+#include "server_metrics.h"
+
+#include <fcntl.h>        // open()
+#include <unistd.h>       // close()
+#include <sys/mman.h>     // mmap
+#include <sys/stat.h>     // size of the metrics file
+#include <time.h>         // nanosleep()
+#include <stdio.h>
+
+#define METRICS_READ_ATTEMPTS 1000
+
+void PrintUsage(void)
+{
+    printf("Usage:   metrics.out <path> [--interval <seconds>] [--clients] [--once]\n"
+           "Example: metrics.out /dev/shm/nisk --interval 2 --clients\n");
+}
+
+bool ArgumentIs(char *argument, char *name)
+{
+    bool result = StringCompare(argument, StringLength(argument), name, StringLength(name));
+    return result;
+}
+
+// Copy of a worker block the worker didn't write to while it was taken
+bool ReadWorker(ServerMetricsHeader *header, unsigned int worker_idx, WorkerMetrics *result)
+{
+    WorkerMetrics *metrics = ServerMetricsWorker(header, worker_idx);
+    for(unsigned int attempt_idx = 0; attempt_idx < METRICS_READ_ATTEMPTS; ++attempt_idx)
+    {
+        if(WorkerMetricsRead(metrics, result, header->worker_stride))
+            return true;
+    }
+    return false;
+}
+
+void PrintWorker(ServerMetricsHeader *header, unsigned int worker_idx,
+                 WorkerMetrics *metrics, WorkerMetrics *previous, float seconds, bool print_clients)
+{
+    printf("worker %u  tick %u  clients %u  tick time %.3fms\n",
+           worker_idx, metrics->tick, metrics->client_count, (double)metrics->tick_ms);
+    
+    printf("  ");
+    for(unsigned int zone_idx = 0; zone_idx < header->zone_count; ++zone_idx)
+        printf(" %s %.3f", header->zone_names[zone_idx], (double)metrics->zone_ms[zone_idx]);
+    printf("\n");
+    
+    for(unsigned int type = 0; type < PacketType_COUNT; ++type)
+    {
+        uint64_t packets_in = metrics->in.packets[type] - previous->in.packets[type];
+        uint64_t packets_out = metrics->out.packets[type] - previous->out.packets[type];
+        if(packets_in == 0 && packets_out == 0)
+            continue;
+        
+        uint64_t bytes_in = metrics->in.bytes[type] - previous->in.bytes[type];
+        uint64_t bytes_out = metrics->out.bytes[type] - previous->out.bytes[type];
+        printf("   %-8s in: %8.0f pkts/s %10.0f B/s  out: %8.0f pkts/s %10.0f B/s\n",
+               PacketTypeName((PacketType)type),
+               (double)packets_in / (double)seconds, (double)bytes_in / (double)seconds,
+               (double)packets_out / (double)seconds, (double)bytes_out / (double)seconds);
+    }
+    
+    if(print_clients)
+    {
+        unsigned int client_count = MIN(metrics->client_count, header->worker_capacity);
+        for(unsigned int client_idx = 0; client_idx < client_count; ++client_idx)
+        {
+            MetricsClient *client = metrics->clients + client_idx;
+            printf("   %5u %-20s %d.%d.%d.%d:%-5d  rtt %6.1fms  loss in %5.1f%% out %5.1f%%\n",
+                   client->entity_idx, client->nickname,
+                   EXPAND_INT(client->address.address), client->address.port,
+                   (double)client->rtt * 1000.0,
+                   (double)client->loss_in * 100.0, (double)client->loss_out * 100.0);
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    if(argc < 2)
+    {
+        PrintUsage();
+        return -1;
+    }
+    
+    char *path = argv[1];
+    float interval = 1.0f;
+    bool print_clients = false;
+    bool once = false;
+    for(int arg_idx = 2; arg_idx < argc; ++arg_idx)
+    {
+        char *argument = argv[arg_idx];
+        if(ArgumentIs(argument, "--clients"))
+            print_clients = true;
+        else if(ArgumentIs(argument, "--once"))
+            once = true;
+        else if(ArgumentIs(argument, "--interval") && arg_idx + 1 < argc
+                && sscanf(argv[arg_idx + 1], "%f", &interval) == 1 && interval > 0)
+            ++arg_idx;
+        else
+        {
+            PrintUsage();
+            return -1;
+        }
+    }
+    
+    int fd = open(path, O_RDONLY);
+    struct stat file_stat;
+    if(fd < 0 || fstat(fd, &file_stat) < 0 || (size_t)file_stat.st_size < sizeof(ServerMetricsHeader))
+    {
+        fprintf(stderr, "[ERROR] Open metrics file %s\n", path);
+        return -1;
+    }
+    
+    size_t size = (size_t)file_stat.st_size;
+    void *memory = mmap(0, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Map metrics file %s\n", path);
+        return -1;
+    }
+    
+    ServerMetricsHeader *header = (ServerMetricsHeader *)memory;
+    if(__atomic_load_n(&header->magic, __ATOMIC_ACQUIRE) != SERVER_METRICS_MAGIC
+       || header->version != SERVER_METRICS_VERSION
+       || size < ServerMetricsSize(header->worker_count, header->worker_capacity)
+       || header->zone_count > SERVER_METRICS_MAX_ZONES)
+    {
+        fprintf(stderr, "[ERROR] %s holds no server metrics we can read\n", path);
+        return -1;
+    }
+    
+    // the current and the previous copy of every worker block
+    unsigned int worker_count = header->worker_count;
+    size_t copies_size = 2 * worker_count * header->worker_stride;
+    void *copies = mmap(0, copies_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if(copies == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Allocate metrics copies\n");
+        return -1;
+    }
+    MemoryArena arena;
+    InitializeArena(&arena, (uint8_t *)copies, copies_size);
+    uint8_t *current_base = PUSH_ARRAY(&arena, uint8_t, worker_count * header->worker_stride);
+    uint8_t *previous_base = PUSH_ARRAY(&arena, uint8_t, worker_count * header->worker_stride);
+    
+    for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+        ReadWorker(header, worker_idx, (WorkerMetrics *)(previous_base + worker_idx * header->worker_stride));
+    
+    struct timespec wait;
+    wait.tv_sec = (time_t)interval;
+    wait.tv_nsec = (long)((interval - (float)wait.tv_sec) * 1000000000.0f);
+    while(true)
+    {
+        nanosleep(&wait, 0);
+        for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+        {
+            WorkerMetrics *metrics = (WorkerMetrics *)(current_base + worker_idx * header->worker_stride);
+            WorkerMetrics *previous = (WorkerMetrics *)(previous_base + worker_idx * header->worker_stride);
+            if(!ReadWorker(header, worker_idx, metrics))
+            {
+                printf("worker %u  busy, no consistent copy\n", worker_idx);
+                continue;
+            }
+            PrintWorker(header, worker_idx, metrics, previous, interval, print_clients);
+            MEMORY_COPY(previous, metrics, header->worker_stride);
+        }
+        printf("\n");
+        fflush(stdout);
+        
+        if(once)
+            break;
+    }
+    
+    return 0;
+}
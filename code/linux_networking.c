@@ -27,6 +27,21 @@ bool SocketCreate(int *sockfd)
     return true;
 }
 
+// Lets several sockets bind the same port, the kernel then spreads the
+// incoming datagrams across them by the hash of the sender address
+bool SocketReusePort(int sockfd)
+{
+    int enable = 1;
+    int rc = setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(enable));
+    if(rc < 0)
+    {
+        fprintf(stderr, "[ERROR] Set SO_REUSEPORT\n");
+        return false;
+    }
+    
+    return true;
+}
+
 bool SocketBind(int sockfd, unsigned short port)
 {
     struct sockaddr_in address;
@@ -102,4 +117,143 @@ int SocketRecieve(int sockfd, Address *sender, void *data, int size)
     }
     
     return bytes_recieved;
+}
+
+// Returns how many datagrams were read, the ones cut short for not
+// fitting a packet are dropped and counted, batch->count holds the rest
+unsigned int SocketRecieveBatch(int sockfd, SocketBatch *batch)
+{
+    struct mmsghdr messages[SOCKET_BATCH_SIZE];
+    struct iovec iovecs[SOCKET_BATCH_SIZE];
+    struct sockaddr_in from[SOCKET_BATCH_SIZE];
+    
+    for(unsigned int idx = 0; idx < SOCKET_BATCH_SIZE; ++idx)
+    {
+        iovecs[idx].iov_base = batch->packets[idx].data;
+        iovecs[idx].iov_len = sizeof(batch->packets[idx].data);
+        
+        MEMORY_SET(&messages[idx], 0, sizeof(messages[idx]));
+        messages[idx].msg_hdr.msg_name = &from[idx];
+        messages[idx].msg_hdr.msg_namelen = sizeof(from[idx]);
+        messages[idx].msg_hdr.msg_iov = &iovecs[idx];
+        messages[idx].msg_hdr.msg_iovlen = 1;
+    }
+    
+    int messages_recieved = recvmmsg(sockfd, messages, SOCKET_BATCH_SIZE, MSG_DONTWAIT, 0);
+    if(messages_recieved == -1)
+    {
+        if(errno != EWOULDBLOCK)
+        {
+            fprintf(stderr, "[ERROR] SocketRecieveBatch: %s\n", strerror(errno));
+            INVALID_CODE_PATH;
+        }
+        messages_recieved = 0;
+    }
+    
+    batch->count = 0;
+    for(unsigned int idx = 0; idx < (unsigned int)messages_recieved; ++idx)
+    {
+        // nothing we send is that big, parsing what is left of it only
+        // gets a broken packet
+        if(messages[idx].msg_hdr.msg_flags & MSG_TRUNC)
+        {
+            ++batch->truncated_count;
+            continue;
+        }
+        
+        SocketPacket *packet = batch->packets + batch->count;
+        if(batch->count != idx)
+            MEMORY_COPY(packet->data, batch->packets[idx].data, messages[idx].msg_len);
+        packet->address.address = ntohl(from[idx].sin_addr.s_addr);
+        packet->address.port = ntohs(from[idx].sin_port);
+        packet->size = (int)messages[idx].msg_len;
+        ++batch->count;
+    }
+    
+    unsigned int result = (unsigned int)messages_recieved;
+    return result;
+}
+
+_Static_assert(sizeof(SocketSpan) == sizeof(struct iovec)
+               && offsetof(SocketSpan, data) == offsetof(struct iovec, iov_base)
+               && offsetof(SocketSpan, size) == offsetof(struct iovec, iov_len),
+               "SocketSpan has to be laid out like struct iovec");
+
+// Points msg_iov at the data of the packet, or at its spans when it is
+// gathered. single is used in the first case and has to outlive the send.
+void SocketPacketSetIovecs(SocketPacket *packet, struct msghdr *msg, struct iovec *single)
+{
+    if(packet->spans)
+    {
+        ASSERT(packet->span_count > 0);
+        packet->spans[0].data = packet->data;
+        packet->spans[0].size = (size_t)packet->size;
+        msg->msg_iov = (struct iovec *)packet->spans;
+        msg->msg_iovlen = packet->span_count;
+    }
+    else
+    {
+        single->iov_base = packet->data;
+        single->iov_len = (size_t)packet->size;
+        msg->msg_iov = single;
+        msg->msg_iovlen = 1;
+    }
+}
+
+unsigned int SocketSendBatch(int sockfd, SocketBatch *batch)
+{
+    struct mmsghdr messages[SOCKET_BATCH_SIZE];
+    struct iovec iovecs[SOCKET_BATCH_SIZE];
+    struct sockaddr_in to[SOCKET_BATCH_SIZE];
+    
+    ASSERT(batch->count <= SOCKET_BATCH_SIZE);
+    for(unsigned int idx = 0; idx < batch->count; ++idx)
+    {
+        SocketPacket *packet = batch->packets + idx;
+        to[idx].sin_family = AF_INET;
+        to[idx].sin_addr.s_addr = htonl(packet->address.address);
+        to[idx].sin_port = htons(packet->address.port);
+        
+        MEMORY_SET(&messages[idx], 0, sizeof(messages[idx]));
+        messages[idx].msg_hdr.msg_name = &to[idx];
+        messages[idx].msg_hdr.msg_namelen = sizeof(to[idx]);
+        SocketPacketSetIovecs(packet, &messages[idx].msg_hdr, &iovecs[idx]);
+    }
+    
+    // sendmmsg can stop short of the whole batch, keep going from
+    // where it left off. It fails when the first message of the call
+    // can't be sent, that one is skipped so the rest still go out.
+    unsigned int messages_sent = 0;
+    unsigned int message_idx = 0;
+    while(message_idx < batch->count)
+    {
+        int rc = sendmmsg(sockfd, messages + message_idx, batch->count - message_idx, 0);
+        if(rc <= 0)
+        {
+            fprintf(stderr, "[ERROR] SocketSendBatch: %s\n", strerror(errno));
+            ++message_idx;
+            continue;
+        }
+        message_idx += (unsigned int)rc;
+        messages_sent += (unsigned int)rc;
+    }
+    
+    batch->count = 0;
+    return messages_sent;
+}
+
+// Reserves the next outgoing packet in the batch, flushing the
+// batch first when it is already full
+SocketPacket *SocketBatchPush(int sockfd, SocketBatch *batch, Address *destination)
+{
+    if(batch->count >= ARRAY_SIZE(batch->packets))
+        SocketSendBatch(sockfd, batch);
+    
+    SocketPacket *result = batch->packets + batch->count;
+    ++batch->count;
+    result->address = *destination;
+    result->size = 0;
+    result->spans = 0;
+    result->span_count = 0;
+    return result;
 }
\ No newline at end of file
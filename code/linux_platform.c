@@ -1,8 +1,11 @@
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+
 // helpers and platform independent headers
 #include "base.h"
 #include "nisk_math.h"
 
 #include "networking.h"
+#include "nisk.h"
 #include "nisk_platform.h"
 
 // libraries
@@ -15,6 +18,7 @@
 #include <sys/stat.h>     // file info
 #include <linux/limits.h> // MAX_PATH 
 #include <dlfcn.h>        // dlopen, dlsym, dlclose
+#include <pthread.h>      // level stream thread
 
 #include "linux_platform.h"
 
@@ -24,11 +28,17 @@
 #include <fcntl.h>        // set file/socket handle to non-blocking
 #include <unistd.h>       // write(), close()
 #include <errno.h>        // socket error handling
+#include <sys/socket.h>   // recvmmsg, sendmmsg
 
 #include "linux_networking.c"
+#include "linux_files.c"
+#include "net_emulator.h"
 
 #include <stdio.h>
 
+#include "level.h"
+#include "linux_level_stream.c"
+
 global SDLApp global_app;
 
 #define MAX_CONTROLLERS 4
@@ -99,6 +109,8 @@ internal LinuxGameCode LinuxLoadGameCode(char *source_dll_name)
     {
         result.game_update_and_render = (GameUpdateAndRenderType *)
             dlsym(result.game_code_dll, "GameUpdateAndRender");
+        result.game_shutdown = (GameShutdownType *)
+            dlsym(result.game_code_dll, "GameShutdown");
         
         result.is_valid = !!(result.game_update_and_render);
     }
@@ -113,6 +125,7 @@ internal void LinuxUnloadGameCode(LinuxGameCode *game_code)
         game_code->game_code_dll = 0;
     }
     game_code->game_update_and_render = 0;
+    game_code->game_shutdown = 0;
     game_code->is_valid = false;
 }
 
@@ -361,6 +374,70 @@ void SDLRenderFillRect(int x0, int y0, int x1, int y1,
     SDL_RenderFillRect(global_app.renderer, &rect);
 }
 
+// Set with --net-emulation, the socket calls of the game go through it
+#define LINUX_NET_EMULATOR_CAPACITY 1024
+global NetEmulator *global_net_emulator;
+
+int64_t LinuxMonotonicNanoseconds(void)
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t result = (int64_t)now.tv_sec * 1000000000LL + now.tv_nsec;
+    return result;
+}
+
+bool LinuxEmulatedSocketSend(int sockfd, Address *destination, void *data, int size)
+{
+    bool result = NetEmulatorSend(global_net_emulator, LinuxMonotonicNanoseconds(),
+                                  sockfd, destination, data, size);
+    return result;
+}
+
+unsigned int LinuxEmulatedSocketSendBatch(int sockfd, SocketBatch *batch)
+{
+    unsigned int result = NetEmulatorSendBatch(global_net_emulator, LinuxMonotonicNanoseconds(),
+                                               sockfd, batch);
+    return result;
+}
+
+unsigned int LinuxEmulatedSocketRecieveBatch(int sockfd, SocketBatch *batch)
+{
+    unsigned int result = NetEmulatorRecieveBatch(global_net_emulator, LinuxMonotonicNanoseconds(),
+                                                  sockfd, batch);
+    return result;
+}
+
+// Looks for --net-emulation <key=value,...> after the arguments of the
+// game, see NetEmulatorConfigParse
+bool LinuxInitNetEmulator(int argc, char **argv)
+{
+    for(int arg_idx = 1; arg_idx + 1 < argc; ++arg_idx)
+    {
+        char *argument = argv[arg_idx];
+        if(!StringCompare(argument, StringLength(argument), "--net-emulation", 15))
+            continue;
+        
+        NetEmulatorConfig config;
+        if(!NetEmulatorConfigParse(&config, argv[arg_idx + 1]))
+            return false;
+        
+        size_t memory_size = sizeof(NetEmulator) + NetEmulatorMemorySize(LINUX_NET_EMULATOR_CAPACITY);
+        void *memory = mmap(0, memory_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+        if(memory == MAP_FAILED)
+        {
+            fprintf(stderr, "[ERROR] Allocate network emulator memory\n");
+            return false;
+        }
+        MemoryArena arena;
+        InitializeArena(&arena, (uint8_t *)memory, memory_size);
+        global_net_emulator = PUSH_ARRAY(&arena, NetEmulator, 1);
+        NetEmulatorInit(global_net_emulator, &arena, LINUX_NET_EMULATOR_CAPACITY,
+                        &config, config.seed);
+        break;
+    }
+    return true;
+}
+
 unsigned int LinuxInetAddrWrap(char *addr)
 {
     unsigned int result = ntohl(inet_addr(addr));
@@ -375,6 +452,9 @@ int main(int argc, char **argv)
     LinuxState linux_state = {0};
     LinuxInitEXEPath(&linux_state);
     
+    if(!LinuxInitNetEmulator(argc, argv))
+        return -1;
+    
     char source_game_code_dll_path[PATH_MAX];
     LinuxAppendToParentDirectoryPath(&linux_state, "nisk.so", source_game_code_dll_path, PATH_MAX);
     LinuxGameCode game_code = LinuxLoadGameCode(source_game_code_dll_path);
@@ -440,7 +520,17 @@ int main(int argc, char **argv)
             platform.socket_close            = &SocketClose;
             platform.socket_send             = &SocketSend;
             platform.socket_recieve          = &SocketRecieve;
+            platform.socket_recieve_batch    = &SocketRecieveBatch;
+            platform.socket_send_batch       = &SocketSendBatch;
             platform.inet_addr_wrap          = &LinuxInetAddrWrap;
+            platform.map_file                = &LinuxMapFile;
+            platform.stream_level            = &LinuxStreamLevel;
+            if(global_net_emulator)
+            {
+                platform.socket_send          = &LinuxEmulatedSocketSend;
+                platform.socket_recieve_batch = &LinuxEmulatedSocketRecieveBatch;
+                platform.socket_send_batch    = &LinuxEmulatedSocketSendBatch;
+            }
             
             Input input = {0};
             input.argc = argc;
@@ -540,6 +630,9 @@ int main(int argc, char **argv)
                 
                 SDL_RenderPresent(global_app.renderer);
             }
+            
+            if(game_code.game_shutdown)
+                game_code.game_shutdown(&game_memory, &platform);
         }
         else
         {
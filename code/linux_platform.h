@@ -30,6 +30,7 @@ typedef struct LinuxGameCode
     timespec last_dll_write_time;
     
     GameUpdateAndRenderType *game_update_and_render;
+    GameShutdownType *game_shutdown;
     
     bool is_valid;
 } LinuxGameCode;
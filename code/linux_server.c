@@ -1,3 +1,5 @@
+#define _GNU_SOURCE // recvmmsg, sendmmsg
+
 #include "base.h"
 #include "nisk_math.h"
 
@@ -9,302 +11,1515 @@
 #include <fcntl.h>        // set file/socket handle to non-blocking
 #include <unistd.h>       // write(), close()
 #include <errno.h>        // socket error handling
-#include <time.h>         // nanosleep()
+#include <sys/socket.h>   // recvmmsg, sendmmsg
+#include <time.h>         // clock_gettime()
+#include <sys/epoll.h>    // epoll_wait()
+#include <sys/timerfd.h>  // tick deadlines
+#include <sys/mman.h>     // mmap
+#include <pthread.h>      // worker threads
+#include <stdlib.h>       // strtod()
+#include <sys/stat.h>     // size of a capture file
+#include <linux/limits.h> // PATH_MAX
 
 #include <stdio.h>
 
 #include "linux_networking.c"
+#include "linux_uring.c"
+#include "linux_files.c"
+
+#include "entity_delta.h"
+#include "bitstream.h"
+#include "protocol.h"
+#include "reliable_channel.h"
+#include "level.h"
+#include "simulation.h"
+#include "input_buffer.h"
+#include "baseline_table.h"
+#include "client_table.h"
+#include "world.h"
+#include "update_cache.h"
+#include "interest_grid.h"
+#include "net_emulator.h"
+#include "packet_capture.h"
+#include "profiler.h"
+#include "server_metrics.h"
 
-typedef struct Client
+#define SERVER_MAX_WORKERS 64
+#define SERVER_MAX_SIM_STEPS_PER_TICK 8
+#define SERVER_NET_EMULATOR_PACKETS_PER_CLIENT 32
+
+typedef struct timespec timespec;
+
+#define NANOSECONDS_PER_SECOND 1000000000LL
+
+int64_t MonotonicNanoseconds(void)
 {
-    bool connected;
-    Nickname nickname;
-    Address address;
-    float time_since_last_packet;
-    Snapshot snapshot;
-} Client;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t result = (int64_t)now.tv_sec * NANOSECONDS_PER_SECOND + now.tv_nsec;
+    return result;
+}
+
+typedef struct ServerConfig
+{
+    unsigned int max_clients;
+    int meters_to_units;
+    
+    // entities further than the interest radius are not replicated at all,
+    // the ones in the outer half of it only every far_update_interval ticks
+    int interest_radius;      // in meters
+    int interest_cell_size;   // in meters
+    int far_update_interval;  // in ticks
+    
+    int update_hz;
+    bool print_tick_stats;
+    bool print_profile; // zones of the profiler, every stats interval
+    
+    unsigned int worker_count; // threads, each with its own socket
+    bool use_io_uring;         // see linux_uring.c
+    NetEmulatorConfig net_emulation;
+    
+    // each worker records to or replays from its own file, named after
+    // the path with .<worker> appended when there is more than one
+    char *capture_path;
+    char *replay_path;
+    
+    char *metrics_path; // see server_metrics.h
+    char *level_path;
+} ServerConfig;
+
+// How late ticks start compared to their deadline, see ServerRun
+typedef struct TickStats
+{
+    unsigned int tick_count;
+    unsigned int missed_tick_count;
+    int64_t jitter_total_ns;
+    int64_t jitter_max_ns;
+    unsigned int spell_hit_count;
+    
+    // time spent in ServerTick, barrier included
+    float work_total_ms;
+    float work_max_ms;
+} TickStats;
 
 typedef struct ServerState
 {
-    Client clients[128];
+    int socket;
+    SocketBatch packets_in;
+    SocketBatch packets_out;
+    Uring uring; // takes over both batches with --io-uring
+    NetEmulator net_emulator; // sits in front of the socket with --net-emulation
+    PacketCapture capture;    // every datagram we handle goes in with --capture
+    
+    // with --replay the datagrams come from a capture instead of a socket
+    // and whatever we send is dropped
+    PacketReplay replay;
+    unsigned int replay_tick_count; // the same for every worker
+    uint64_t replay_sent_count;
+    
+    // published to metrics after every tick with --metrics
+    PacketCounters counters_in;
+    PacketCounters counters_out;
+    WorkerMetrics *metrics;
+    EntityUpdateCache update_cache;
+    
+    ServerConfig config;
+    unsigned int tick_idx;
+    double time; // in seconds
+    TickStats tick_stats;
+    
+    MemoryArena arena;
+    ClientTable client_table;
+    InterestGrid interest_grid;
+    
+    // the entities of our clients, indexed like the active list of the
+    // client table, one simulation step per SIM_STEP_DT of elapsed time
+    PhysicsSpec physics_spec;
+    Level *level; // the same for every worker, never written
+    SimPlayers players;
+    int64_t elapsed_ns;
+    uint64_t sim_step_count;
+    
+    // every worker thread has its own ServerState, the entity indices of
+    // its clients start at entity_base (see World)
+    World *world;
+    unsigned int worker_idx;
+    unsigned int entity_base;
 } ServerState;
 
-Client *GetClient(ServerState *state, Address address)
+uint16_t ServerEntityIndex(ServerState *state, Client *client)
 {
-    for(long unsigned offset=0; offset < ARRAY_SIZE(state->clients); ++offset)
+    uint16_t result = (uint16_t)(state->entity_base + ClientTableIndex(&state->client_table, client));
+    return result;
+}
+
+void ServerRemoveClient(ServerState *state, Client *client)
+{
+    WorldReleaseNickname(state->world, ServerEntityIndex(state, client));
+    SimPlayersRemove(&state->players, client->active_idx);
+    ClientTableRemove(&state->client_table, client);
+}
+
+void ServerFlushPackets(ServerState *state)
+{
+    if(state->config.use_io_uring)
+        UringSubmit(&state->uring);
+    else if(state->config.net_emulation.enabled)
+        NetEmulatorSendBatch(&state->net_emulator, MonotonicNanoseconds(),
+                             state->socket, &state->packets_out);
+    else if(state->config.replay_path)
     {
-        int idx = (address.address + offset) % ARRAY_SIZE(state->clients);
-        Client *client = state->clients + idx;
-        if(client->connected)
+        state->replay_sent_count += state->packets_out.count;
+        state->packets_out.count = 0;
+    }
+    else
+        SocketSendBatch(state->socket, &state->packets_out);
+}
+
+// Outgoing datagrams go through whichever socket backend is in use
+SocketPacket *ServerPushPacket(ServerState *state, Address *destination)
+{
+    SocketPacket *result;
+    if(state->config.use_io_uring)
+        result = UringPushPacket(&state->uring, destination);
+    else
+    {
+        // a full batch has to go out through ServerFlushPackets
+        if(state->packets_out.count >= ARRAY_SIZE(state->packets_out.packets))
+            ServerFlushPackets(state);
+        result = SocketBatchPush(state->socket, &state->packets_out, destination);
+    }
+    return result;
+}
+
+// Takes back the packet of the last ServerPushPacket
+void ServerDropLastPacket(ServerState *state)
+{
+    if(state->config.use_io_uring)
+        --state->uring.send_count;
+    else
+        --state->packets_out.count;
+}
+
+// Until this returns the kernel may still read flushed packets, the
+// batches send right away so only io_uring has to wait
+void ServerWaitPackets(ServerState *state)
+{
+    if(state->config.use_io_uring)
+        UringWaitSends(&state->uring);
+}
+
+// Queues a connectionless REJECT with the outgoing packets, it goes out
+// with the next ServerFlushPackets (at the latest at the end of the tick)
+void ServerSendReject(ServerState *state, Address *destination, DisconnectReason reason)
+{
+    SocketPacket *packet = ServerPushPacket(state, destination);
+    BitStream stream = BitStreamWriter(packet->data, sizeof(packet->data));
+    PacketHeader header = { PROTOCOL_ID, REJECT, 0, 0, 0 };
+    SerializePacketHeader(&stream, &header);
+    SerializeDisconnectReason(&stream, &reason);
+    packet->size = (int)BitStreamBytesUsed(&stream);
+    PacketCountersAdd(&state->counters_out, REJECT, (size_t)packet->size);
+}
+
+// Tells the client why it is dropped through its channel. The client is
+// gone before its next SNAPSHOT, so the Disconnect goes out in a CONTROL
+// datagram of its own with the next ServerFlushPackets.
+void ServerDropClient(ServerState *state, Client *client, DisconnectReason reason)
+{
+    ControlMessage disconnect = {0};
+    disconnect.type = ControlMessage_Disconnect;
+    disconnect.reason = reason;
+    if(ReliableChannelSend(&client->channel, &disconnect))
+    {
+        SocketPacket *packet = ServerPushPacket(state, &client->address);
+        BitStream stream = BitStreamWriter(packet->data, sizeof(packet->data));
+        ReliableChannelWritePacket(&client->channel, &stream, CONTROL, state->time);
+        packet->size = (int)BitStreamBytesUsed(&stream);
+        PacketCountersAdd(&state->counters_out, CONTROL, (size_t)packet->size);
+    }
+    else
+    {
+        ServerSendReject(state, &client->address, reason);
+    }
+    ServerRemoveClient(state, client);
+}
+
+// Outgoing SNAPSHOT datagram. The header, the control messages and the
+// list go into the data of the packet, the entity updates are gathered
+// from the EntityUpdateCache behind it.
+typedef struct SnapshotPacket
+{
+    SocketPacket *socket_packet;
+    BitStream stream;
+    unsigned int message_count;
+    SnapshotList list;
+    size_t list_end_bit_idx;
+    size_t size; // data plus every span, in bytes
+    SentPacket *sent_packet;
+} SnapshotPacket;
+
+void SnapshotPacketBegin(SnapshotPacket *packet, ServerState *state, Client *client)
+{
+    EntityUpdateCache *cache = &state->update_cache;
+    if(!EntityUpdateCacheHasRoom(cache))
+    {
+        // the packets pointing into the cache have to be out before it
+        // can be reused
+        ServerFlushPackets(state);
+        ServerWaitPackets(state);
+        EntityUpdateCacheReset(cache);
+    }
+    
+    packet->socket_packet = ServerPushPacket(state, &client->address);
+    packet->stream = BitStreamWriter(packet->socket_packet->data, sizeof(packet->socket_packet->data));
+    uint16_t sequence = client->channel.next_sequence;
+    packet->message_count = ReliableChannelWritePacket(&client->channel, &packet->stream,
+                                                       SNAPSHOT, state->time);
+    
+    MEMORY_SET(&packet->list, 0, sizeof(SnapshotList));
+    packet->list.tick = (uint16_t)state->tick_idx;
+    packet->list.has_input_ack = client->inputs.has_applied;
+    packet->list.input_ack = client->inputs.applied_sequence;
+    SerializeSnapshotList(&packet->stream, &packet->list);
+    packet->list_end_bit_idx = packet->stream.bit_idx;
+    packet->size = BitStreamBytesUsed(&packet->stream);
+    
+    // spans[0] is the data itself, see SocketPacket
+    packet->socket_packet->spans = (SocketSpan *)(cache->spans.base + cache->spans.used);
+    packet->socket_packet->span_count = 1;
+    
+    packet->sent_packet = client->sent_packets + (sequence % SENT_PACKET_COUNT);
+    packet->sent_packet->pending = false;
+    packet->sent_packet->sequence = sequence;
+    packet->sent_packet->tick = packet->list.tick;
+    packet->sent_packet->entity_count = 0;
+}
+
+bool SnapshotPacketIsFull(SnapshotPacket *packet)
+{
+    bool result = (packet->list.count >= MAX_ENTITY_UPDATES_PER_PACKET);
+    return result;
+}
+
+// Returns false and leaves the packet as it was when the update does not
+// fit in what is left of the datagram
+bool SnapshotPacketPushEntity(SnapshotPacket *packet, EntityUpdateCache *cache, Client *dst_client,
+                              EntityHistory *src_history, uint16_t src_idx)
+{
+    uint16_t tick = packet->list.tick;
+    Entity *entity = EntityHistoryGet(src_history, tick);
+    ASSERT(entity != 0);
+    
+    // newest state of the entity the client has acknowledged, we still
+    // have to have it in the history of the entity
+    Entity *baseline = 0;
+    EntityBaseline *acked = BaselineTableFind(&dst_client->baselines, src_idx);
+    if(acked && BaselineIsUsable(acked->tick, tick))
+        baseline = EntityHistoryGet(src_history, acked->tick);
+    
+    SocketSpan span = EntityUpdateCacheGet(cache, tick, src_idx, entity, baseline,
+                                           (baseline ? acked->tick : 0));
+    if(packet->size + span.size > PACKET_MAX_SIZE)
+        return false;
+    
+    SocketPacket *socket_packet = packet->socket_packet;
+    socket_packet->spans[socket_packet->span_count++] = span;
+    packet->size += span.size;
+    
+    SentPacket *sent_packet = packet->sent_packet;
+    sent_packet->entity_idx[sent_packet->entity_count++] = src_idx;
+    ++packet->list.count;
+    return true;
+}
+
+void SnapshotPacketEnd(SnapshotPacket *packet, ServerState *state)
+{
+    // packet is still the last one pushed, drop it if it carries
+    // nothing, its sequence number just goes unused
+    if(packet->list.count == 0 && packet->message_count == 0)
+    {
+        ServerDropLastPacket(state);
+    }
+    else
+    {
+        SnapshotListPatchCount(&packet->stream, packet->list_end_bit_idx, packet->list.count);
+        
+        SocketPacket *socket_packet = packet->socket_packet;
+        socket_packet->size = (int)BitStreamBytesUsed(&packet->stream);
+        if(packet->list.count > 0)
         {
-            if(AddressCompare(client->address, address))
-                return client;
+            state->update_cache.spans.used += socket_packet->span_count * sizeof(SocketSpan);
         }
         else
         {
-            return client;
+            socket_packet->spans = 0;
+            socket_packet->span_count = 0;
         }
+        packet->sent_packet->pending = (packet->list.count > 0);
+        PacketCountersAdd(&state->counters_out, SNAPSHOT, packet->size);
     }
-    
-    return 0;
 }
 
-typedef struct timespec timespec;
+// Turns the entities of every newly acknowledged SNAPSHOT datagram into
+// baselines for the following deltas
+void ProcessSnapshotAcks(ServerState *state, Client *client, uint16_t ack, uint32_t ack_bits)
+{
+    uint16_t current_tick = (uint16_t)state->tick_idx;
+    for(unsigned int bit_idx = 0; bit_idx <= 32; ++bit_idx)
+    {
+        if(bit_idx > 0 && !(ack_bits & (1u << (bit_idx - 1))))
+            continue;
+        
+        uint16_t sequence = (uint16_t)(ack - bit_idx);
+        SentPacket *sent_packet = client->sent_packets + (sequence % SENT_PACKET_COUNT);
+        if(!sent_packet->pending || sent_packet->sequence != sequence)
+            continue;
+        
+        sent_packet->pending = false;
+        for(unsigned int entity_idx = 0; entity_idx < sent_packet->entity_count; ++entity_idx)
+        {
+            BaselineTablePut(&client->baselines, sent_packet->entity_idx[entity_idx],
+                             sent_packet->tick, current_tick);
+        }
+    }
+}
 
-typedef enum TimerEntry
+// The Connect that opens a channel, 0 if the datagram has none
+ControlMessage *FindConnect(ControlMessage *messages, unsigned int message_count)
 {
-    TimerEntry_Cycle,
-    TimerEntry_Work,
-    TimerEntry_Recieve,
-    TimerEntry_Send,
-    TimerEntry_COUNT
-} TimerEntry;
+    ControlMessage *result = 0;
+    for(unsigned int message_idx = 0; message_idx < message_count; ++message_idx)
+    {
+        if(messages[message_idx].id == 0 && messages[message_idx].type == ControlMessage_Connect)
+            result = messages + message_idx;
+    }
+    return result;
+}
 
-char *TimerEntryName(TimerEntry timer_entry)
+// A client restarted on the same address opens a new channel while we
+// still hold the old one. Its Connect looks like the first message of the
+// old channel, which can still turn up late, so it only counts once the
+// old channel has moved on to INPUT and the datagram is too old to be
+// acknowledged by it.
+bool ClientRestarted(Client *client, PacketHeader *header,
+                     ControlMessage *messages, unsigned int message_count)
 {
-    switch(timer_entry)
+    uint16_t behind = (uint16_t)(client->channel.remote_sequence - header->sequence);
+    bool result = (header->type == CONTROL
+                   && client->inputs.started
+                   && behind > 32
+                   && FindConnect(messages, message_count) != 0);
+    return result;
+}
+
+// Datagram from an address without a client, only a Connect opening a
+// new channel is welcome
+Client *ServerHandleConnect(ServerState *state, Address sender,
+                            ControlMessage *messages, unsigned int message_count)
+{
+    ControlMessage *connect = FindConnect(messages, message_count);
+    if(connect == 0)
     {
-        case TimerEntry_Cycle:   return "Cycle";
-        case TimerEntry_Work:    return "Work";
-        case TimerEntry_Recieve: return "Recieve";
-        case TimerEntry_Send:    return "Send";
-        default:                 return "Unknown";
+        // most likely timed out and still sending, tell it to start over
+        ServerSendReject(state, &sender, DisconnectReason_TimedOut);
+        return 0;
     }
+    
+    if(state->client_table.free_count == 0)
+    {
+        ServerSendReject(state, &sender, DisconnectReason_ServerFull);
+        return 0;
+    }
+    
+    Nickname *nickname = &connect->nickname;
+    Client *result = ClientTableAdd(&state->client_table, sender, nickname);
+    
+    // nicknames are unique across every worker
+    if(!WorldClaimNickname(state->world, ServerEntityIndex(state, result), nickname))
+    {
+        fprintf(stderr, "Nickname taken: %s\n", nickname->str);
+        ClientTableRemove(&state->client_table, result);
+        ServerSendReject(state, &sender, DisconnectReason_NicknameTaken);
+        return 0;
+    }
+    
+    result->interest_radius = state->config.interest_radius * state->config.meters_to_units;
+    ReliableChannelInit(&result->channel);
+    
+    Entity spawn = PlayerSpawn();
+    unsigned int player_idx = SimPlayersAdd(&state->players, &spawn);
+    ASSERT(player_idx == result->active_idx);
+    
+    ControlMessage accept = {0};
+    accept.type = ControlMessage_Accept;
+    accept.entity_idx = ServerEntityIndex(state, result);
+    accept.tick_rate = (uint16_t)state->config.update_hz;
+    accept.level_hash = state->level->hash;
+    ReliableChannelSend(&result->channel, &accept);
+    
+    printf("%s %d.%d.%d.%d:%d connected.\n",
+           nickname->str,
+           EXPAND_INT(sender.address),
+           sender.port);
+    return result;
 }
 
-typedef struct Timer
+// data is read in place, wherever the socket backend put the datagram
+void ServerHandlePacket(ServerState *state, Address sender, uint8_t *data, int size)
 {
-    timespec start;
-    timespec end;
-    float ms;
-    unsigned int hit_count;
-} Timer;
+    if(size <= 0) return;
+    
+    BitStream stream = BitStreamReader(data, (size_t)size);
+    PacketHeader header_in = {0};
+    bool header_valid = SerializePacketHeader(&stream, &header_in);
+    PacketType counted_type = (header_valid ? header_in.type : INVALID);
+    PacketCountersAdd(&state->counters_in, counted_type, (size_t)size);
+    if(!header_valid)
+        return;
+#if 0
+    printf("%d.%d.%d.%d:%d  prot: %d  type: %s\n",
+           EXPAND_INT(sender.address), sender.port,
+           header_in.protocol,
+           PacketTypeName(header_in.type));
+#endif
+    if(header_in.type != CONTROL && header_in.type != INPUT)
+    {
+        fprintf(stderr, "[ERROR] Invalid packet type!\n");
+        return;
+    }
+    
+    ControlMessage messages[RELIABLE_MESSAGES_PER_PACKET];
+    unsigned int message_count = 0;
+    if(!SerializeControlMessages(&stream, messages, &message_count))
+        return;
+    
+    Client *client = ClientTableFind(&state->client_table, sender);
+    if(client && ClientRestarted(client, &header_in, messages, message_count))
+    {
+        // everything about the old connection goes, the entity included,
+        // and the client gets accepted as if it were new
+        printf("%s %d.%d.%d.%d:%d restarted.\n",
+               client->nickname.str,
+               EXPAND_INT(sender.address),
+               sender.port);
+        ServerRemoveClient(state, client);
+        client = 0;
+    }
+    
+    if(client == 0)
+    {
+        client = ServerHandleConnect(state, sender, messages, message_count);
+        if(client == 0)
+            return;
+    }
+    
+    client->time_since_last_packet = 0.0f;
+    ReliableChannelProcessPacket(&client->channel, &header_in, messages, message_count, state->time);
+    ReliableChannelAckPacket(&client->channel, header_in.sequence);
+    ProcessSnapshotAcks(state, client, header_in.ack, header_in.ack_bits);
+    
+    if(header_in.type == INPUT)
+    {
+        InputList input_list = {0};
+        PlayerInput inputs[MAX_INPUTS_PER_PACKET];
+        bool valid = SerializeInputList(&stream, &input_list);
+        for(unsigned int input_idx = 0; valid && input_idx < input_list.count; ++input_idx)
+            valid = SerializePlayerInput(&stream, inputs + input_idx);
+        
+        if(valid)
+            client->view_delay = (float)input_list.view_delay_ms / 1000.0f;
+        
+        // oldest first, the list starts with the newest
+        for(unsigned int input_idx = input_list.count; valid && input_idx-- > 0;)
+        {
+            uint16_t sequence = (uint16_t)(input_list.sequence - input_idx);
+            InputBufferPush(&client->inputs, sequence, inputs + input_idx);
+        }
+    }
+    
+    ControlMessage message;
+    while(ReliableChannelNextMessage(&client->channel, &message))
+    {
+        switch(message.type)
+        {
+            case ControlMessage_Disconnect:
+            {
+                printf("%s %d.%d.%d.%d:%d disconnected.\n",
+                       client->nickname.str,
+                       EXPAND_INT(sender.address),
+                       sender.port);
+                ServerRemoveClient(state, client);
+                return;
+            } break;
+            
+            // Connect was handled when the client got added
+            default: break;
+        }
+    }
+}
 
-Timer global_timers[TimerEntry_COUNT];
 
-#define RESET_TIMERS STATEMENT(for(unsigned int _timer_idx=0; _timer_idx < TimerEntry_COUNT; _timer_idx++)\
-{ global_timers[_timer_idx].hit_count = 0; })
+// Zones of the profiler, see profiler.h
+typedef enum ServerZone
+{
+    ServerZone_Tick,
+    ServerZone_Timeouts,
+    ServerZone_Simulate,
+    ServerZone_Publish,
+    ServerZone_Barrier,
+    ServerZone_InterestGrid,
+    ServerZone_SpellHits,
+    ServerZone_Send,
+    ServerZone_Recieve,
+    ServerZone_COUNT
+} ServerZone;
+
+global char *global_server_zone_names[ServerZone_COUNT] =
+{
+    "Tick",
+    "Timeouts",
+    "Simulate",
+    "Publish",
+    "Barrier",
+    "InterestGrid",
+    "SpellHits",
+    "Send",
+    "Recieve",
+};
 
-#define BEGIN_TIMER(ID) STATEMENT(clock_gettime(CLOCK_MONOTONIC, &global_timers[ID].start);)
-#define END_TIMER(ID) STATEMENT(clock_gettime(CLOCK_MONOTONIC, &global_timers[ID].end);\
-++global_timers[ID].hit_count;\
-global_timers[ID].ms = MilisecondsElapsed(global_timers[ID].start,\
-global_timers[ID].end);)
+_Static_assert(ServerZone_COUNT <= SERVER_METRICS_MAX_ZONES, "Metrics have no room for every zone");
 
-float MilisecondsElapsed(timespec start, timespec end)
+// one per worker thread
+__thread Profiler global_profiler;
+
+#define BEGIN_ZONE(ID) ProfilerBegin(&global_profiler, ID)
+#define END_ZONE(ID) ProfilerEnd(&global_profiler, ID)
+
+timespec TimespecFromNanoseconds(int64_t ns)
 {
-    float result = (1000.0f*(float)(end.tv_sec - start.tv_sec)
-                    + (float)(end.tv_nsec - start.tv_nsec)/1000000.0f);
-    
+    timespec result;
+    result.tv_sec = (time_t)(ns / NANOSECONDS_PER_SECOND);
+    result.tv_nsec = (long)(ns % NANOSECONDS_PER_SECOND);
     return result;
 }
 
-timespec TimespecFromMiliseconds(float ms)
+bool ArgumentIs(char *argument, char *name)
 {
-    timespec result = {0};
-    if(ms > 1000)
+    bool result = StringCompare(argument, StringLength(argument), name, StringLength(name));
+    return result;
+}
+
+void PrintUsage(void)
+{
+    printf("Usage:   server.out [--max-clients <count>] [--interest-radius <meters>]\n"
+           "                    [--far-update-interval <ticks>] [--update-hz <hz>]\n"
+           "                    [--workers <count>] [--io-uring] [--tick-stats] [--profile]\n"
+           "                    [--net-emulation <key=value,...>]\n"
+           "                    [--capture <path>] [--replay <path>] [--metrics <path>]\n"
+           "                    [--level <path>]\n"
+           "Example: server.out --max-clients 4096 --interest-radius 48 --workers 4\n"
+           "         server.out --net-emulation latency=75,jitter=10,loss=5,seed=7\n"
+           "         server.out --capture traffic.cap, later server.out --replay traffic.cap\n");
+}
+
+bool ParseServerConfig(ServerConfig *config, int argc, char **argv)
+{
+    config->max_clients = 1024;
+    config->meters_to_units = 8; // has to match PhysicsSpecDefault
+    config->interest_radius = 64;
+    config->interest_cell_size = 32;
+    config->far_update_interval = 4;
+    config->update_hz = 60;
+    config->print_tick_stats = false;
+    config->print_profile = false;
+    config->worker_count = 1;
+    config->use_io_uring = false;
+    config->net_emulation.enabled = false;
+    config->capture_path = 0;
+    config->replay_path = 0;
+    config->metrics_path = 0;
+    config->level_path = LEVEL_DEFAULT_PATH;
+    
+    for(int arg_idx = 1; arg_idx < argc; ++arg_idx)
     {
-        float seconds = ms / 1000.0f;
-        ms -= (seconds * 1000.0f);
-        result.tv_sec = (long int)seconds;
+        char *argument = argv[arg_idx];
+        char *value = (arg_idx + 1 < argc ? argv[arg_idx + 1] : 0);
+        bool parsed = false;
+        
+        if(value && ArgumentIs(argument, "--max-clients"))
+            parsed = (sscanf(value, "%u", &config->max_clients) == 1);
+        else if(value && ArgumentIs(argument, "--interest-radius"))
+            parsed = (sscanf(value, "%d", &config->interest_radius) == 1);
+        else if(value && ArgumentIs(argument, "--far-update-interval"))
+            parsed = (sscanf(value, "%d", &config->far_update_interval) == 1);
+        else if(value && ArgumentIs(argument, "--update-hz"))
+            parsed = (sscanf(value, "%d", &config->update_hz) == 1);
+        else if(value && ArgumentIs(argument, "--workers"))
+            parsed = (sscanf(value, "%u", &config->worker_count) == 1);
+        else if(value && ArgumentIs(argument, "--net-emulation"))
+            parsed = NetEmulatorConfigParse(&config->net_emulation, value);
+        else if(value && ArgumentIs(argument, "--capture"))
+            parsed = ((config->capture_path = value) != 0);
+        else if(value && ArgumentIs(argument, "--replay"))
+            parsed = ((config->replay_path = value) != 0);
+        else if(value && ArgumentIs(argument, "--metrics"))
+            parsed = ((config->metrics_path = value) != 0);
+        else if(value && ArgumentIs(argument, "--level"))
+            parsed = ((config->level_path = value) != 0);
+        
+        // flags without a value
+        if(ArgumentIs(argument, "--tick-stats"))
+        {
+            config->print_tick_stats = true;
+            continue;
+        }
+        if(ArgumentIs(argument, "--profile"))
+        {
+            config->print_profile = true;
+            continue;
+        }
+        if(ArgumentIs(argument, "--io-uring"))
+        {
+            config->use_io_uring = true;
+            continue;
+        }
+        
+        if(!parsed)
+        {
+            PrintUsage();
+            return false;
+        }
+        ++arg_idx;
     }
     
-    result.tv_nsec = (long int)(ms * 1000000.0f);
+    if(config->max_clients == 0 || config->max_clients > CLIENT_TABLE_MAX_CAPACITY)
+    {
+        fprintf(stderr, "[ERROR] Max clients has to be in range 1..%d\n", CLIENT_TABLE_MAX_CAPACITY);
+        return false;
+    }
+    
+    if(config->worker_count == 0 || config->worker_count > SERVER_MAX_WORKERS)
+    {
+        fprintf(stderr, "[ERROR] Workers have to be in range 1..%d\n", SERVER_MAX_WORKERS);
+        return false;
+    }
     
+    // every worker gets the same number of client slots
+    unsigned int worker_capacity = (config->max_clients + config->worker_count - 1) / config->worker_count;
+    if(worker_capacity * config->worker_count > CLIENT_TABLE_MAX_CAPACITY)
+    {
+        fprintf(stderr, "[ERROR] Max clients rounded up to a multiple of workers is over %d\n",
+                CLIENT_TABLE_MAX_CAPACITY);
+        return false;
+    }
+    
+    if(config->interest_radius <= 0 || config->interest_radius > 4096)
+    {
+        fprintf(stderr, "[ERROR] Interest radius has to be in range 1..4096\n");
+        return false;
+    }
+    
+    if(config->far_update_interval <= 0)
+    {
+        fprintf(stderr, "[ERROR] Far update interval has to be positive\n");
+        return false;
+    }
+    
+    if(config->update_hz <= 0 || config->update_hz > 1000)
+    {
+        fprintf(stderr, "[ERROR] Update rate has to be in range 1..1000\n");
+        return false;
+    }
+    
+    // io_uring reads and writes the socket without going through us
+    if(config->use_io_uring && config->net_emulation.enabled)
+    {
+        fprintf(stderr, "[ERROR] Network emulation doesn't work with io_uring\n");
+        return false;
+    }
+    
+    if(config->replay_path && (config->capture_path || config->use_io_uring
+                               || config->net_emulation.enabled))
+    {
+        fprintf(stderr, "[ERROR] A replay has no socket to capture, emulate or use io_uring on\n");
+        return false;
+    }
+    
+    return true;
+}
+
+unsigned int ServerRecieveBatch(ServerState *state)
+{
+    unsigned int result;
+    if(state->config.net_emulation.enabled)
+        result = NetEmulatorRecieveBatch(&state->net_emulator, MonotonicNanoseconds(),
+                                         state->socket, &state->packets_in);
+    else
+        result = SocketRecieveBatch(state->socket, &state->packets_in);
     return result;
 }
 
-int main(void)
+void ServerHandleRecieved(ServerState *state, Address sender, uint8_t *data, int size)
 {
-    int socket;
-    if(!SocketCreate(&socket))
-        return -1;
+    if(state->capture.file)
+        PacketCaptureWrite(&state->capture, MonotonicNanoseconds(), sender, data, size);
+    ServerHandlePacket(state, sender, data, size);
+}
+
+void ServerRecievePackets(ServerState *state)
+{
+    BEGIN_ZONE(ServerZone_Recieve);
+    if(state->config.use_io_uring)
+    {
+        // handling a packet can reap more completions, the count is
+        // read again every iteration
+        Uring *ring = &state->uring;
+        UringReap(ring);
+        for(unsigned int packet_idx = 0; packet_idx < ring->recieved_count; ++packet_idx)
+        {
+            UringPacket *packet = ring->recieved + packet_idx;
+            ServerHandleRecieved(state, packet->address, packet->data, packet->size);
+        }
+        UringRecycleRecieved(ring);
+    }
+    else
+    {
+        while(ServerRecieveBatch(state) > 0)
+        {
+            for(unsigned int packet_idx = 0; packet_idx < state->packets_in.count; ++packet_idx)
+            {
+                SocketPacket *packet = state->packets_in.packets + packet_idx;
+                ServerHandleRecieved(state, packet->address, packet->data, packet->size);
+            }
+        }
+    }
     
-    if(!SocketBind(socket, 54321))
-        return -1;
+    // datagrams too big for a packet count with the ones that don't
+    // parse, the socket didn't tell their size
+    unsigned int *truncated_count = (state->config.use_io_uring
+                                     ? &state->uring.truncated_count
+                                     : &state->packets_in.truncated_count);
+    state->counters_in.packets[INVALID] += *truncated_count;
+    *truncated_count = 0;
     
-    int server_update_hz = 60;
-    float target_ms_per_frame = 1000.0f/(float)server_update_hz;
-    // float dt = target_ms_per_frame/1000.0f;
+    // replies to what we just read go out right away
+    ServerFlushPackets(state);
+    END_ZONE(ServerZone_Recieve);
+}
+
+#define CLIENT_TIMEOUT 5.0f // in seconds
+
+// Tests the spells of our players against every entity as the caster saw
+// it. Remote entities reach a client a round trip behind the server and
+// are shown another view delay behind that, so targets get rewound that
+// far through the rewind frames of the World. Candidates come from the
+// interest grid of the current tick, with the radius grown by how far an
+// entity can have moved since the tick the spell is tested at.
+void ServerResolveSpellHits(ServerState *state)
+{
+    ClientTable *client_table = &state->client_table;
+    SimPlayers *players = &state->players;
+    World *world = state->world;
+    PhysicsSpec *spec = &state->physics_spec;
+    uint16_t tick = (uint16_t)state->tick_idx;
+    float tick_dt = 1.0f / (float)state->config.update_hz;
     
-    ServerState state = {0};
+    Recti spell_hitbox = PlayerSpawn().spell_hitbox;
+    Recti hitbox = players->hitbox;
+    int spell_extent = (spell_hitbox.x1 - spell_hitbox.x0) + (spell_hitbox.y1 - spell_hitbox.y0);
+    int hitbox_extent = (hitbox.x1 - hitbox.x0) + (hitbox.y1 - hitbox.y0);
+    float max_speed = (MAX(spec->run_speed, spec->fall_speed) + spec->jump_speed) * (float)spec->meters_to_units;
     
-    while(true)
+    for(unsigned int active_idx = 0; active_idx < client_table->active_count; ++active_idx)
     {
-        RESET_TIMERS;
-        BEGIN_TIMER(TimerEntry_Cycle);
-        BEGIN_TIMER(TimerEntry_Work);
+        if(players->spell_timer[active_idx] <= 0)
+            continue;
+        
+        Client *client = ClientTableActive(client_table, active_idx);
+        uint16_t caster_idx = ServerEntityIndex(state, client);
+        float view_time = client->channel.rtt + client->view_delay;
+        int rewind_ticks = CLAMP(0, (int)ROUNDF(view_time / tick_dt), MAX_REWIND_TICKS);
+        uint16_t rewind_tick = (uint16_t)(tick - rewind_ticks);
+        
+        Vec2i spell_p = Vec2iGet(players->spell_unit_x[active_idx], players->spell_unit_y[active_idx]);
+        Recti spell_rect = RectiMove(spell_hitbox, spell_p.x, spell_p.y);
+        int radius = (spell_extent + hitbox_extent
+                      + (int)(max_speed * tick_dt * (float)rewind_ticks) + 1);
         
-        // Read all incoming packets
-        BEGIN_TIMER(TimerEntry_Recieve);
-        unsigned char buffer_in[2048];
-        while(true)
+        InterestGridQuery query = InterestGridQueryBegin(&state->interest_grid, spell_p, radius);
+        InterestGridEntry *entry;
+        while((entry = InterestGridQueryNext(&query)))
         {
+            uint16_t target_idx = (uint16_t)entry->entity_idx;
+            Vec2i target_p;
+            if(target_idx == caster_idx || !WorldRewindGet(world, rewind_tick, target_idx, &target_p))
+                continue;
             
-            Address sender;
-            int bytes_read = SocketRecieve(socket, &sender, buffer_in, sizeof(buffer_in));
-            
-            if(bytes_read <= 0) break;
-            if(bytes_read < (int)sizeof(PacketHeader)) continue;
+            if(RectiCheckOverlap(spell_rect, RectiMove(hitbox, target_p.x, target_p.y)))
+            {
+                // the spell is spent on the first target it touches
+                players->spell_timer[active_idx] = 0;
+                ++state->tick_stats.spell_hit_count;
+                break;
+            }
+        }
+    }
+}
+
+// dt is the time since the previous tick, more than a tick length when
+// the deadlines of some ticks were missed
+void ServerTick(ServerState *state, float dt)
+{
+    ClientTable *client_table = &state->client_table;
+    BEGIN_ZONE(ServerZone_Tick);
+    
+    // Drop clients we have not heard from in a while, walk backwards
+    // since removing swaps the last active client into the hole
+    BEGIN_ZONE(ServerZone_Timeouts);
+    for(unsigned int active_idx = client_table->active_count; active_idx-- > 0;)
+    {
+        Client *client = ClientTableActive(client_table, active_idx);
+        if(client->time_since_last_packet > CLIENT_TIMEOUT)
+        {
+            printf("%d.%d.%d.%d:%d timed out.\n",
+                   EXPAND_INT(client->address.address),
+                   client->address.port);
+            ServerDropClient(state, client, DisconnectReason_TimedOut);
+            continue;
+        }
+        client->time_since_last_packet += dt;
+    }
+    END_ZONE(ServerZone_Timeouts);
+    
+    // Step the entities of our clients once for every input they sent
+    // in the meantime, a missed tick makes up for its steps up to a limit
+    BEGIN_ZONE(ServerZone_Simulate);
+    SimPlayers *players = &state->players;
+    ASSERT(players->count == client_table->active_count);
+    uint64_t sim_step_target = (uint64_t)(state->elapsed_ns * SIM_STEP_HZ / NANOSECONDS_PER_SECOND);
+    if(sim_step_target - state->sim_step_count > SERVER_MAX_SIM_STEPS_PER_TICK)
+        state->sim_step_count = sim_step_target - SERVER_MAX_SIM_STEPS_PER_TICK;
+    for(; state->sim_step_count < sim_step_target; ++state->sim_step_count)
+    {
+        for(unsigned int active_idx = 0; active_idx < client_table->active_count; ++active_idx)
+        {
+            Client *client = ClientTableActive(client_table, active_idx);
+            PlayerInput input = InputBufferPop(&client->inputs);
+            SimPlayersSetInput(players, active_idx, &input);
+        }
+        SimPlayersStep(players, state->level, &state->physics_spec, SIM_STEP_DT);
+    }
+    END_ZONE(ServerZone_Simulate);
+    
+    // Publish the entities of our clients for this tick and wait for the
+    // other workers to do the same before reading theirs
+    BEGIN_ZONE(ServerZone_Publish);
+    World *world = state->world;
+    uint16_t tick = (uint16_t)state->tick_idx;
+    unsigned int buffer_idx = state->tick_idx % 2;
+    WorldEntry *entries = world->entries[buffer_idx] + state->worker_idx * world->worker_capacity;
+    Entity entity = PlayerSpawn();
+    for(unsigned int active_idx = 0; active_idx < client_table->active_count; ++active_idx)
+    {
+        Client *client = ClientTableActive(client_table, active_idx);
+        uint16_t entity_idx = ServerEntityIndex(state, client);
+        SimPlayersGet(players, active_idx, &entity);
+        EntityHistoryPut(world->histories + entity_idx, tick, &entity);
+        entries[active_idx].idx = entity_idx;
+        entries[active_idx].p = entity.p.unit;
+        WorldRewindPut(world, tick, entity_idx, entity.p.unit);
+    }
+    world->entry_counts[buffer_idx][state->worker_idx] = client_table->active_count;
+    END_ZONE(ServerZone_Publish);
+    BEGIN_ZONE(ServerZone_Barrier);
+    pthread_barrier_wait(&world->tick_barrier);
+    END_ZONE(ServerZone_Barrier);
+    
+    // Deliever position info of nearby entities to every client, the
+    // updates are encoded once per tick and baseline, see EntityUpdateCache
+    BEGIN_ZONE(ServerZone_InterestGrid);
+    InterestGridBuild(&state->interest_grid, world, buffer_idx);
+    END_ZONE(ServerZone_InterestGrid);
+    BEGIN_ZONE(ServerZone_SpellHits);
+    ServerResolveSpellHits(state);
+    END_ZONE(ServerZone_SpellHits);
+    
+    BEGIN_ZONE(ServerZone_Send);
+    ServerWaitPackets(state);
+    EntityUpdateCacheReset(&state->update_cache);
+    for(unsigned int dst_active_idx = 0;
+        dst_active_idx < client_table->active_count;
+        ++dst_active_idx)
+    {
+        Client *dst_client = ClientTableActive(client_table, dst_active_idx);
+        Vec2i dst_p = SimPlayersP(players, dst_active_idx);
+        int64_t near_radius = dst_client->interest_radius / 2;
+        int64_t near_radius_sq = near_radius * near_radius;
+        
+        SnapshotPacket packet;
+        SnapshotPacketBegin(&packet, state, dst_client);
+        
+        // no more than the client has room for, the nearest ones. The
+        // entity of the client itself always goes first, even in a crowd
+        // standing on the same spot, that is how it learns where the
+        // server put it.
+        InterestGridEntry *visible[MAX_VISIBLE_ENTITIES];
+        unsigned int visible_count = InterestGridNearest(&state->interest_grid, dst_p,
+                                                         dst_client->interest_radius,
+                                                         ServerEntityIndex(state, dst_client),
+                                                         visible, ARRAY_SIZE(visible));
+        for(unsigned int visible_idx = 0; visible_idx < visible_count; ++visible_idx)
+        {
+            InterestGridEntry *entry = visible[visible_idx];
+            unsigned int src_idx = entry->entity_idx;
             
-            MemoryArena buffer_in_arena;
-            InitializeArena(&buffer_in_arena, buffer_in, sizeof(buffer_in));
+            // far entities are refreshed less often, staggered by index
+            // so they don't all land on the same tick
+            if(Vec2iDistanceSquared(entry->p, dst_p) > near_radius_sq
+               && (state->tick_idx + src_idx) % (unsigned int)state->config.far_update_interval != 0)
+                continue;
             
-            PacketHeader *header_in = PUSH_STRUCT(&buffer_in_arena, PacketHeader);
-#if 0
-            printf("%d.%d.%d.%d:%d  prot: %d  type: %s\n",
-                   EXPAND_INT(sender.address), sender.port,
-                   header_in->protocol,
-                   PacketTypeName(header_in->type));
-#endif
-            switch(header_in->type)
+            EntityHistory *src_history = world->histories + src_idx;
+            if(SnapshotPacketIsFull(&packet)
+               || !SnapshotPacketPushEntity(&packet, &state->update_cache, dst_client,
+                                            src_history, (uint16_t)src_idx))
             {
-                case CONNECT:
-                {
-                    Client *remote_client = GetClient(&state, sender);
-                    if(remote_client)
-                    {
-                        if(remote_client->connected != true)
-                        {
-                            Nickname *remote_nickname = PUSH_STRUCT(&buffer_in_arena, Nickname);
-                            if(remote_nickname != 0)
-                            {
-                                unsigned int max_nickname_size = ARRAY_SIZE(remote_nickname->str) - 1;
-                                if(remote_nickname->size > max_nickname_size)
-                                {
-                                    remote_nickname->size = max_nickname_size;
-                                    remote_nickname->str[max_nickname_size] = 0;
-                                }
-                                
-                                
-                                bool nickname_taken = false;
-                                for(unsigned int idx = 0; idx < ARRAY_SIZE(state.clients); ++idx)
-                                {
-                                    Client *local_client = state.clients + idx;
-                                    if(remote_client != local_client
-                                       && local_client->connected)
-                                    {
-                                        if(StringCompare(local_client->nickname.str, local_client->nickname.size,
-                                                         remote_nickname->str, remote_nickname->size))
-                                        {
-                                            nickname_taken = true;
-                                            break;
-                                        }
-                                    }
-                                }
-                                
-                                if(nickname_taken == false)
-                                {
-                                    remote_client->connected = true;
-                                    remote_client->nickname = *remote_nickname;
-                                    remote_client->address = sender;
-                                    
-                                    printf("%s %d.%d.%d.%d:%d connected.\n",
-                                           remote_nickname->str,
-                                           EXPAND_INT(sender.address),
-                                           sender.port);
-                                    
-                                    remote_client->time_since_last_packet = 0.0f;
-                                    PacketHeader header = { 0, ACCEPT };
-                                    SocketSend(socket, &sender, &header, sizeof(PacketHeader));
-                                }
-                                else
-                                {
-                                    fprintf(stderr, "Nickname taken: %s\n", remote_nickname->str);
-                                    // nickname taken
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        // server is full
-                        PacketHeader header = {0, DISCONNECT };
-                        SocketSend(socket, &sender, &header, sizeof(PacketHeader));
-                    }
-                } break;
-                
-                case DISCONNECT:
-                { 
-                    
-                } break;
-                
-                case SNAPSHOT:
-                {
-                    Client *remote_client = GetClient(&state, sender);
-                    if(remote_client->connected)
-                    {
-                        Snapshot *remote_snapshot = PUSH_STRUCT(&buffer_in_arena, Snapshot);
-                        if(SequenceIsNewer(remote_snapshot->sequence, remote_client->snapshot.sequence))
-                            MEMORY_COPY(&remote_client->snapshot, remote_snapshot, sizeof(Snapshot));
-                    }
-                } break;
+                SnapshotPacketEnd(&packet, state);
+                SnapshotPacketBegin(&packet, state, dst_client);
                 
-                default:
-                {
-                    fprintf(stderr, "[ERROR] Invalid packet type!\n");
-                } break;
+                // a single update always fits in an empty datagram
+                if(!SnapshotPacketPushEntity(&packet, &state->update_cache, dst_client,
+                                             src_history, (uint16_t)src_idx))
+                    INVALID_CODE_PATH;
             }
         }
-        END_TIMER(TimerEntry_Recieve);
         
+        SnapshotPacketEnd(&packet, state);
+    }
+    ServerFlushPackets(state);
+    END_ZONE(ServerZone_Send);
+    END_ZONE(ServerZone_Tick);
+    
+    ++state->tick_idx;
+    state->time += (double)dt;
+}
+
+void TickStatsPrint(unsigned int worker_idx, TickStats *stats, EntityUpdateCache *cache)
+{
+    if(stats->tick_count == 0)
+        return;
+    
+    int64_t jitter_avg_ns = stats->jitter_total_ns / stats->tick_count;
+    unsigned int lookup_count = cache->hit_count + cache->miss_count;
+    float work_avg_ms = stats->work_total_ms / (float)stats->tick_count;
+    printf("worker %u  ticks: %u  missed: %u  start jitter avg: %.1fus max: %.1fus"
+           "  work avg: %.3fms max: %.3fms  update cache hits: %u/%u  spell hits: %u\n",
+           worker_idx, stats->tick_count, stats->missed_tick_count,
+           (double)jitter_avg_ns / 1000.0, (double)stats->jitter_max_ns / 1000.0,
+           (double)work_avg_ms, (double)stats->work_max_ms,
+           cache->hit_count, lookup_count, stats->spell_hit_count);
+}
+
+// Rewrites the metrics of this worker, see server_metrics.h
+void ServerPublishMetrics(ServerState *state)
+{
+    WorkerMetrics *metrics = state->metrics;
+    ClientTable *client_table = &state->client_table;
+    WorkerMetricsWriteBegin(metrics);
+    
+    metrics->tick = state->tick_idx;
+    metrics->tick_ms = ProfilerLastMs(&global_profiler, ServerZone_Tick);
+    for(unsigned int zone_idx = 0; zone_idx < ServerZone_COUNT; ++zone_idx)
+        metrics->zone_ms[zone_idx] = ProfilerLastMs(&global_profiler, zone_idx);
+    metrics->in = state->counters_in;
+    metrics->out = state->counters_out;
+    
+    metrics->client_count = client_table->active_count;
+    for(unsigned int active_idx = 0; active_idx < client_table->active_count; ++active_idx)
+    {
+        Client *client = ClientTableActive(client_table, active_idx);
+        MetricsClient *metrics_client = metrics->clients + active_idx;
+        metrics_client->address = client->address;
+        metrics_client->entity_idx = ServerEntityIndex(state, client);
+        MEMORY_COPY(metrics_client->nickname, client->nickname.str, sizeof(metrics_client->nickname));
+        metrics_client->rtt = client->channel.rtt;
         
-        // Deliever position info to all clients
-        BEGIN_TIMER(TimerEntry_Send);
-        for(long unsigned dst_idx=0; dst_idx < ARRAY_SIZE(state.clients); ++dst_idx)
+        // a client that just connected hasn't sent 32 datagrams yet, the
+        // ones before its first aren't lost
+        unsigned int window = MIN(32, client->channel.recieved_count);
+        unsigned int recieved_count = (unsigned int)__builtin_popcount(client->channel.remote_ack_bits);
+        metrics_client->loss_in = (window > 0 ? 1.0f - (float)recieved_count / (float)window : 0.0f);
+        metrics_client->loss_out = client->channel.packet_loss;
+    }
+    
+    WorkerMetricsWriteEnd(metrics);
+}
+
+void ServerProfilePrint(ServerState *state)
+{
+    char title[64];
+    snprintf(title, sizeof(title), "worker %u profile", state->worker_idx);
+    ProfilerPrint(&global_profiler, title, global_server_zone_names, ServerZone_COUNT);
+}
+
+// Sleeps in epoll until a datagram arrives or the next tick is due.
+// Packets are handled as soon as they come in instead of waiting for the
+// tick. Ticks start on absolute deadlines of a timerfd, so a slow tick
+// doesn't push the ones after it back, and how late a tick started
+// compared to its deadline goes into the TickStats. Every worker starts
+// on the same first deadline so their ticks meet at the tick barrier.
+// Returns true once another worker failed, false when this one does.
+bool ServerRun(ServerState *state)
+{
+    int64_t tick_ns = NANOSECONDS_PER_SECOND / state->config.update_hz;
+    float tick_dt = (float)tick_ns / (float)NANOSECONDS_PER_SECOND;
+    
+    int timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if(timer_fd < 0)
+    {
+        fprintf(stderr, "[ERROR] Create timerfd: %s\n", strerror(errno));
+        return false;
+    }
+    
+    int64_t next_tick_ns = state->world->first_tick_ns;
+    struct itimerspec timer_spec;
+    timer_spec.it_value = TimespecFromNanoseconds(next_tick_ns);
+    timer_spec.it_interval = TimespecFromNanoseconds(tick_ns);
+    if(timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &timer_spec, 0) < 0)
+    {
+        fprintf(stderr, "[ERROR] Set timerfd: %s\n", strerror(errno));
+        close(timer_fd);
+        return false;
+    }
+    
+    int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if(epoll_fd < 0)
+    {
+        fprintf(stderr, "[ERROR] Create epoll: %s\n", strerror(errno));
+        close(timer_fd);
+        return false;
+    }
+    
+    // with io_uring the datagrams are already read when its fd turns
+    // readable, there is a completion waiting
+    int socket_fd = (state->config.use_io_uring ? state->uring.fd : state->socket);
+    struct epoll_event socket_event = {0};
+    socket_event.events = EPOLLIN;
+    socket_event.data.fd = socket_fd;
+    struct epoll_event timer_event = {0};
+    timer_event.events = EPOLLIN;
+    timer_event.data.fd = timer_fd;
+    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, socket_fd, &socket_event) < 0
+       || epoll_ctl(epoll_fd, EPOLL_CTL_ADD, timer_fd, &timer_event) < 0)
+    {
+        fprintf(stderr, "[ERROR] Register epoll events: %s\n", strerror(errno));
+        close(epoll_fd);
+        close(timer_fd);
+        return false;
+    }
+    
+    unsigned int stats_interval = (unsigned int)state->config.update_hz * 10;
+    while(true)
+    {
+        struct epoll_event events[2];
+        int event_count = epoll_wait(epoll_fd, events, ARRAY_SIZE(events), -1);
+        if(event_count < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            fprintf(stderr, "[ERROR] Wait for events: %s\n", strerror(errno));
+            break;
+        }
+        
+        uint64_t expirations = 0;
+        for(int event_idx = 0; event_idx < event_count; ++event_idx)
         {
-            Client *dst_client = state.clients + dst_idx;
-            if(dst_client->connected)
+            if(events[event_idx].data.fd == socket_fd)
             {
-#if 0
-                if(dst_client->time_since_last_packet > global_timeout_treshold)
-                {
-                    printf("%d.%d.%d.%d:%d timed out.\n",
-                           EXPAND_INT(dst_client->address.address),
-                           dst_client->address.port);
-                    dst_client->connected = false;
-                    continue;
-                }
-                dst_client->time_since_last_packet += dt;
-#endif
-                for(long unsigned src_idx=0; src_idx < ARRAY_SIZE(state.clients); ++src_idx)
-                {
-                    if(dst_idx == src_idx)
-                        continue;
-                    
-                    Client *src_client = state.clients + src_idx;
-                    if(src_client->connected)
-                    {
-                        uint8_t buffer_out[sizeof(PacketHeader) + sizeof(Snapshot)];
-                        uint8_t *buffer_out_ptr = buffer_out;
-                        
-                        PacketHeader *header = (PacketHeader *)buffer_out_ptr;
-                        header->protocol = 0;
-                        header->type = SNAPSHOT;
-                        buffer_out_ptr += sizeof(PacketHeader);
-                        
-                        Snapshot *snapshot = (Snapshot *)buffer_out_ptr;
-                        MEMORY_COPY(snapshot, &src_client->snapshot, sizeof(Snapshot));
-                        snapshot->idx = (uint8_t)src_idx;
-                        snapshot->sequence = dst_client->snapshot.sequence;
-                        
-                        SocketSend(socket, &dst_client->address, buffer_out, sizeof(buffer_out));
-                    }
-                }
+                ServerRecievePackets(state);
+            }
+            else if(events[event_idx].data.fd == timer_fd)
+            {
+                if(read(timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations))
+                    expirations = 0;
             }
         }
-        END_TIMER(TimerEntry_Send);
-        END_TIMER(TimerEntry_Work);
         
-        float work_in_ms = global_timers[TimerEntry_Work].ms;
-        if(work_in_ms < target_ms_per_frame)
+        if(expirations == 0)
+            continue;
+        
+        // more than one expiration means we missed deadlines, run a single
+        // tick for the newest one and let it cover the time in between
+        int64_t deadline_ns = next_tick_ns + (int64_t)(expirations - 1) * tick_ns;
+        next_tick_ns = deadline_ns + tick_ns;
+        
+        TickStats *stats = &state->tick_stats;
+        int64_t jitter_ns = MonotonicNanoseconds() - deadline_ns;
+        stats->tick_count += 1;
+        stats->missed_tick_count += (unsigned int)(expirations - 1);
+        stats->jitter_total_ns += jitter_ns;
+        stats->jitter_max_ns = MAX(stats->jitter_max_ns, jitter_ns);
+        
+        // delayed datagrams come due without the socket waking us up
+        if(state->config.net_emulation.enabled)
+            ServerRecievePackets(state);
+        
+        state->elapsed_ns += (int64_t)expirations * tick_ns;
+        ServerTick(state, tick_dt * (float)expirations);
+        float work_ms = ProfilerLastMs(&global_profiler, ServerZone_Tick);
+        stats->work_total_ms += work_ms;
+        stats->work_max_ms = MAX(stats->work_max_ms, work_ms);
+        
+        // a killed server loses at most the capture of one tick
+        if(state->capture.file)
+            fflush(state->capture.file);
+        
+        if(state->metrics)
+            ServerPublishMetrics(state);
+        
+        unsigned int stop_tick_count = __atomic_load_n(&state->world->stop_tick_count, __ATOMIC_RELAXED);
+        if(stop_tick_count != 0 && state->tick_idx >= stop_tick_count)
         {
-            timespec sleep_time = TimespecFromMiliseconds(target_ms_per_frame - work_in_ms);
-            nanosleep(&sleep_time, 0);
+            close(epoll_fd);
+            close(timer_fd);
+            return true;
         }
         
-        END_TIMER(TimerEntry_Cycle);
+        if(stats->tick_count >= stats_interval)
+        {
+            if(state->config.print_tick_stats)
+                TickStatsPrint(state->worker_idx, stats, &state->update_cache);
+            if(state->config.print_profile)
+                ServerProfilePrint(state);
+            MEMORY_SET(stats, 0, sizeof(TickStats));
+            state->update_cache.hit_count = 0;
+            state->update_cache.miss_count = 0;
+        }
+    }
+    
+    close(epoll_fd);
+    close(timer_fd);
+    return false;
+}
+
+// Feeds the capture of this worker through the server as fast as it
+// goes. Ticks run on a clock of their own, every datagram is handled
+// before the first tick deadline after its arrival in the capture, which
+// is about when the live server would have handled it.
+void ServerReplay(ServerState *state)
+{
+    int64_t tick_ns = NANOSECONDS_PER_SECOND / state->config.update_hz;
+    float tick_dt = (float)tick_ns / (float)NANOSECONDS_PER_SECOND;
+    
+    // the capture starts a tick before the first deadline
+    int64_t deadline_ns = tick_ns;
+    uint64_t packet_count = 0;
+    PacketRecord record;
+    bool has_record = PacketReplayNext(&state->replay, &record);
+    
+    TickStats *stats = &state->tick_stats;
+    MEMORY_SET(stats, 0, sizeof(TickStats));
+    int64_t start_ns = MonotonicNanoseconds();
+    for(unsigned int tick_idx = 0; tick_idx < state->replay_tick_count; ++tick_idx)
+    {
+        BEGIN_ZONE(ServerZone_Recieve);
+        for(; has_record && record.time_ns < deadline_ns;
+            has_record = PacketReplayNext(&state->replay, &record))
+        {
+            ServerHandlePacket(state, record.address, record.data, record.size);
+            ++packet_count;
+        }
+        ServerFlushPackets(state);
+        END_ZONE(ServerZone_Recieve);
+        
+        state->elapsed_ns += tick_ns;
+        ServerTick(state, tick_dt);
+        float work_ms = ProfilerLastMs(&global_profiler, ServerZone_Tick);
+        stats->tick_count += 1;
+        stats->work_total_ms += work_ms;
+        stats->work_max_ms = MAX(stats->work_max_ms, work_ms);
+        deadline_ns += tick_ns;
+    }
+    
+    double seconds = (double)(MonotonicNanoseconds() - start_ns) / (double)NANOSECONDS_PER_SECOND;
+    double captured_seconds = (double)state->replay_tick_count * (double)tick_dt;
+    float work_avg_ms = (stats->tick_count > 0 ? stats->work_total_ms / (float)stats->tick_count : 0.0f);
+    printf("worker %u replayed %u ticks, %lu packets in %.2fs (%.1fx real time)"
+           "  sent: %lu  work avg: %.3fms max: %.3fms  spell hits: %u\n",
+           state->worker_idx, stats->tick_count, (unsigned long)packet_count, seconds,
+           (seconds > 0 ? captured_seconds / seconds : 0.0),
+           (unsigned long)state->replay_sent_count,
+           (double)work_avg_ms, (double)stats->work_max_ms, stats->spell_hit_count);
+    if(state->config.print_profile)
+        ServerProfilePrint(state);
+}
+
+void ServerWorkerPath(char *result, size_t result_size, char *path,
+                      unsigned int worker_idx, unsigned int worker_count)
+{
+    if(worker_count > 1)
+        snprintf(result, result_size, "%s.%u", path, worker_idx);
+    else
+        snprintf(result, result_size, "%s", path);
+}
+
+// Maps the capture of this worker, it is only ever read
+bool ServerOpenReplay(ServerState *state, unsigned int worker_count)
+{
+    char path[PATH_MAX];
+    ServerWorkerPath(path, sizeof(path), state->config.replay_path, state->worker_idx, worker_count);
+    size_t size = 0;
+    void *data = LinuxMapFile(path, &size);
+    if(data == 0)
+        return false;
+    
+    PacketReplay *replay = &state->replay;
+    if(!PacketReplayInit(replay, (uint8_t *)data, size))
+        return false;
+    
+    if(replay->header.worker_count != worker_count
+       || replay->header.worker_idx != state->worker_idx
+       || replay->header.update_hz != state->config.update_hz)
+    {
+        fprintf(stderr, "[ERROR] %s was captured by worker %u of %u at %u Hz, "
+                "run the replay with the same --workers and --update-hz\n",
+                path, replay->header.worker_idx, replay->header.worker_count,
+                replay->header.update_hz);
+        return false;
+    }
+    return true;
+}
+
+// Creates the metrics file every worker publishes to, readers find the
+// layout in its header
+ServerMetricsHeader *ServerCreateMetrics(ServerConfig *config, unsigned int worker_capacity)
+{
+    size_t size = ServerMetricsSize(config->worker_count, worker_capacity);
+    int fd = open(config->metrics_path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0 || ftruncate(fd, (off_t)size) < 0)
+    {
+        fprintf(stderr, "[ERROR] Create metrics file %s: %s\n", config->metrics_path, strerror(errno));
+        if(fd >= 0)
+            close(fd);
+        return 0;
+    }
+    
+    void *memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(memory == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Map metrics file %s\n", config->metrics_path);
+        return 0;
+    }
+    
+    ServerMetricsHeader *header = (ServerMetricsHeader *)memory;
+    header->version = SERVER_METRICS_VERSION;
+    header->worker_count = config->worker_count;
+    header->worker_capacity = worker_capacity;
+    header->worker_stride = (uint32_t)ServerMetricsWorkerStride(worker_capacity);
+    header->update_hz = (uint32_t)config->update_hz;
+    header->zone_count = ServerZone_COUNT;
+    for(unsigned int zone_idx = 0; zone_idx < ServerZone_COUNT; ++zone_idx)
+    {
+        snprintf(header->zone_names[zone_idx], SERVER_METRICS_ZONE_NAME_SIZE, "%s",
+                 global_server_zone_names[zone_idx]);
+    }
+    
+    // readers check the magic last, the rest is in place by then
+    __atomic_store_n(&header->magic, SERVER_METRICS_MAGIC, __ATOMIC_RELEASE);
+    return header;
+}
+
+// The other workers would wait for a failed one at the tick barrier
+// forever. It meets them there a last time, with no entities published
+// for the tick it doesn't run, and tells them to stop once they are done
+// with that tick. A worker still finishing the tick before reads a count
+// it hasn't reached.
+void ServerWorkerStop(ServerState *state)
+{
+    World *world = state->world;
+    world->entry_counts[state->tick_idx % 2][state->worker_idx] = 0;
+    __atomic_store_n(&world->stop_tick_count, state->tick_idx + 1, __ATOMIC_RELAXED);
+    pthread_barrier_wait(&world->tick_barrier);
+}
+
+// Returns 0 when the worker stopped because another one failed, 1 when
+// it failed itself
+void *ServerWorkerThread(void *data)
+{
+    ServerState *state = (ServerState *)data;
+    ProfilerInit(&global_profiler);
+    if(state->config.replay_path)
+    {
+        ServerReplay(state);
+        return 0;
+    }
+    
+    if(ServerRun(state))
+        return 0;
+    
+    ServerWorkerStop(state);
+    return (void *)1;
+}
+
+int main(int argc, char **argv)
+{
+    ServerConfig config;
+    if(!ParseServerConfig(&config, argc, argv))
+        return -1;
+    ProfilerCalibrate();
+    
+    unsigned int worker_count = config.worker_count;
+    unsigned int worker_capacity = (config.max_clients + worker_count - 1) / worker_count;
+    unsigned int net_emulator_capacity = (config.net_emulation.enabled
+                                          ? worker_capacity * SERVER_NET_EMULATOR_PACKETS_PER_CLIENT
+                                          : 0);
+    
+    local_persist World world;
+    MemoryArena world_arena;
+    size_t world_memory_size = WorldMemorySize(worker_count * worker_capacity, worker_count);
+    void *world_memory = mmap(0, world_memory_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if(world_memory == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Allocate world memory\n");
+        return -1;
     }
+    InitializeArena(&world_arena, (uint8_t *)world_memory, world_memory_size);
+    if(!WorldInit(&world, &world_arena, worker_count, worker_capacity))
+        return -1;
     
-    return 0;
+    local_persist Level level;
+    size_t level_size = 0;
+    void *level_data = LinuxMapFile(config.level_path, &level_size);
+    if(level_data == 0 || !LevelLoad(&level, level_data, level_size, PhysicsSpecDefault().meters_to_units))
+        return -1;
+    
+    // the states hold the packet batches, keep them off the stack
+    local_persist ServerState states[SERVER_MAX_WORKERS];
+    for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+    {
+        ServerState *state = states + worker_idx;
+        state->config = config;
+        state->world = &world;
+        state->worker_idx = worker_idx;
+        state->entity_base = worker_idx * worker_capacity;
+        state->physics_spec = PhysicsSpecDefault();
+        state->level = &level;
+        
+        // the interest grid holds the entities of every worker
+        size_t memory_size = (ClientTableMemorySize(worker_capacity)
+                              + InterestGridMemorySize(world.capacity)
+                              + EntityUpdateCacheMemorySize(world.capacity)
+                              + SimPlayersMemorySize(worker_capacity)
+                              + NetEmulatorMemorySize(net_emulator_capacity));
+        void *memory = mmap(0, memory_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+        if(memory == MAP_FAILED)
+        {
+            fprintf(stderr, "[ERROR] Allocate server memory\n");
+            return -1;
+        }
+        InitializeArena(&state->arena, (uint8_t *)memory, memory_size);
+        ClientTableInit(&state->client_table, &state->arena, worker_capacity);
+        InterestGridInit(&state->interest_grid, &state->arena, world.capacity,
+                         config.interest_cell_size * config.meters_to_units);
+        EntityUpdateCacheInit(&state->update_cache, &state->arena, world.capacity);
+        SimPlayersInit(&state->players, &state->arena, worker_capacity);
+        
+        // every worker draws from its own sequence of the seed
+        if(config.net_emulation.enabled)
+        {
+            NetEmulatorInit(&state->net_emulator, &state->arena, net_emulator_capacity,
+                            &config.net_emulation, config.net_emulation.seed + worker_idx);
+        }
+        
+        if(config.replay_path)
+        {
+            state->socket = -1;
+            if(!ServerOpenReplay(state, worker_count))
+                return -1;
+            continue;
+        }
+        
+        if(!SocketCreate(&state->socket))
+            return -1;
+        
+        // every worker binds the same port, the kernel picks the worker
+        // a client talks to by its address
+        if(worker_count > 1 && !SocketReusePort(state->socket))
+            return -1;
+        
+        if(!SocketBind(state->socket, 54321))
+            return -1;
+        
+        if(state->config.use_io_uring && !UringInit(&state->uring, state->socket))
+        {
+            fprintf(stderr, "[ERROR] Falling back to recvmmsg and sendmmsg\n");
+            if(state->uring.fd >= 0)
+                close(state->uring.fd);
+            state->config.use_io_uring = false;
+        }
+    }
+    
+    world.first_tick_ns = MonotonicNanoseconds() + NANOSECONDS_PER_SECOND / config.update_hz;
+    
+    if(config.metrics_path)
+    {
+        ServerMetricsHeader *metrics = ServerCreateMetrics(&config, worker_capacity);
+        if(metrics == 0)
+            return -1;
+        for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+            states[worker_idx].metrics = ServerMetricsWorker(metrics, worker_idx);
+    }
+    
+    // every worker replays until the last datagram of any of them
+    if(config.replay_path)
+    {
+        int64_t duration_ns = 0;
+        for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+            duration_ns = MAX(duration_ns, PacketReplayDuration(&states[worker_idx].replay));
+        unsigned int tick_count = (unsigned int)(duration_ns * config.update_hz / NANOSECONDS_PER_SECOND) + 2;
+        for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+            states[worker_idx].replay_tick_count = tick_count;
+    }
+    
+    if(config.capture_path)
+    {
+        PacketCaptureHeader header = {0};
+        header.update_hz = (uint16_t)config.update_hz;
+        header.worker_count = (uint16_t)worker_count;
+        for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+        {
+            char path[PATH_MAX];
+            ServerWorkerPath(path, sizeof(path), config.capture_path, worker_idx, worker_count);
+            header.worker_idx = (uint16_t)worker_idx;
+            int64_t start_ns = world.first_tick_ns - NANOSECONDS_PER_SECOND / config.update_hz;
+            if(!PacketCaptureOpen(&states[worker_idx].capture, path, &header, start_ns))
+                return -1;
+        }
+    }
+    
+    pthread_t threads[SERVER_MAX_WORKERS];
+    for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+    {
+        if(pthread_create(threads + worker_idx, 0, ServerWorkerThread, states + worker_idx) != 0)
+        {
+            fprintf(stderr, "[ERROR] Start worker thread\n");
+            return -1;
+        }
+    }
+    
+    int result = 0;
+    for(unsigned int worker_idx = 0; worker_idx < worker_count; ++worker_idx)
+    {
+        void *failed = 0;
+        pthread_join(threads[worker_idx], &failed);
+        if(failed)
+            result = -1;
+        
+        if(states[worker_idx].capture.file)
+            fclose(states[worker_idx].capture.file);
+    }
+    
+    return result;
 }
@@ -0,0 +1,419 @@
+// io_uring backend of the server sockets, talks to the kernel through the
+// raw syscalls. A multishot recvmsg stays posted on the socket and the
+// kernel writes every datagram straight into one of the buffers of a
+// registered buffer ring, packets are parsed right where they land and
+// the buffer goes back to the ring afterwards. Outgoing datagrams are
+// queued up and go out with a single io_uring_enter. Completions are
+// read from the shared ring without a syscall, the ring fd turns
+// readable in epoll when there are any.
+
+#include <linux/io_uring.h>
+#include <sys/syscall.h>  // io_uring_setup, io_uring_enter, io_uring_register
+#include <sys/uio.h>      // iovec
+
+#define URING_QUEUE_SIZE   16384 // submission entries, power of two
+#define URING_BUFFER_COUNT 4096  // recieve buffers, power of two
+#define URING_BUFFER_SIZE  2048
+#define URING_BUFFER_GROUP 0
+
+// one submission entry stays free for re-arming the recieve
+#define URING_SEND_CAPACITY (URING_QUEUE_SIZE - 1)
+
+#define URING_USER_DATA_RECIEVE 0
+#define URING_USER_DATA_SEND    1
+
+typedef struct UringPacket
+{
+    Address address;
+    int size;
+    uint8_t *data; // inside the recieve buffer
+    uint16_t buffer_id;
+} UringPacket;
+
+typedef struct Uring
+{
+    int fd;
+    int sockfd;
+    
+    unsigned int *sq_head;
+    unsigned int *sq_tail;
+    unsigned int sq_mask;
+    unsigned int sq_entries;
+    struct io_uring_sqe *sqes;
+    unsigned int sq_pending; // prepared, not submitted yet
+    
+    unsigned int *cq_head;
+    unsigned int *cq_tail;
+    unsigned int cq_mask;
+    struct io_uring_cqe *cqes;
+    
+    struct io_uring_buf_ring *buffer_ring;
+    uint8_t *buffers;
+    uint16_t buffer_tail;
+    
+    struct msghdr recieve_msg;
+    bool recieve_armed;
+    UringPacket *recieved; // URING_BUFFER_COUNT entries, one per buffer at most
+    unsigned int recieved_count;
+    unsigned int truncated_count; // dropped for not fitting a buffer, added up until taken
+    
+    SocketPacket *send_packets;
+    struct msghdr *send_msgs;
+    struct iovec *send_iovecs;
+    struct sockaddr_in *send_addresses;
+    unsigned int send_count;
+    unsigned int send_in_flight; // submitted, completion not seen yet
+} Uring;
+
+int UringSetup(unsigned int entries, struct io_uring_params *params)
+{
+    int result = (int)syscall(__NR_io_uring_setup, entries, params);
+    return result;
+}
+
+int UringEnter(int fd, unsigned int to_submit, unsigned int min_complete, unsigned int flags)
+{
+    int result = (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, 0, 0);
+    return result;
+}
+
+int UringRegister(int fd, unsigned int opcode, void *arg, unsigned int arg_count)
+{
+    int result = (int)syscall(__NR_io_uring_register, fd, opcode, arg, arg_count);
+    return result;
+}
+
+// Whether the kernel knows the opcodes we use, a kernel older than them
+// fails the submission entries with -EINVAL instead
+bool UringProbe(int fd)
+{
+    uint64_t probe_memory[(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op)) / sizeof(uint64_t)];
+    MEMORY_SET(probe_memory, 0, sizeof(probe_memory));
+    struct io_uring_probe *probe = (struct io_uring_probe *)probe_memory;
+    if(UringRegister(fd, IORING_REGISTER_PROBE, probe, 256) < 0)
+        return false;
+    
+    uint8_t needed_ops[] = { IORING_OP_RECVMSG, IORING_OP_SENDMSG };
+    for(unsigned int op_idx = 0; op_idx < ARRAY_SIZE(needed_ops); ++op_idx)
+    {
+        uint8_t op = needed_ops[op_idx];
+        if(op >= probe->ops_len || !(probe->ops[op].flags & IO_URING_OP_SUPPORTED))
+            return false;
+    }
+    return true;
+}
+
+void *UringMap(int fd, size_t size, uint64_t offset)
+{
+    void *result = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, fd, (off_t)offset);
+    return result;
+}
+
+// Next free submission entry, cleared, or 0 when the queue is full
+struct io_uring_sqe *UringGetSqe(Uring *ring)
+{
+    unsigned int head = __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE);
+    unsigned int tail = *ring->sq_tail;
+    if(tail - head >= ring->sq_entries)
+        return 0;
+    
+    struct io_uring_sqe *result = ring->sqes + (tail & ring->sq_mask);
+    MEMORY_SET(result, 0, sizeof(struct io_uring_sqe));
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->sq_pending;
+    return result;
+}
+
+void UringRecycleBuffer(Uring *ring, uint16_t buffer_id)
+{
+    struct io_uring_buf *buffer = ring->buffer_ring->bufs + (ring->buffer_tail & (URING_BUFFER_COUNT - 1));
+    buffer->addr = (uint64_t)(uintptr_t)(ring->buffers + (size_t)buffer_id * URING_BUFFER_SIZE);
+    buffer->len = URING_BUFFER_SIZE;
+    buffer->bid = buffer_id;
+    ++ring->buffer_tail;
+    __atomic_store_n(&ring->buffer_ring->tail, ring->buffer_tail, __ATOMIC_RELEASE);
+}
+
+// The recieve is posted once and keeps producing completions until the
+// kernel runs out of buffers, then it has to be posted again
+void UringArmRecieve(Uring *ring)
+{
+    struct io_uring_sqe *sqe = UringGetSqe(ring);
+    ASSERT(sqe != 0);
+    sqe->opcode = IORING_OP_RECVMSG;
+    sqe->fd = ring->sockfd;
+    sqe->addr = (uint64_t)(uintptr_t)&ring->recieve_msg;
+    sqe->len = 1;
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = URING_BUFFER_GROUP;
+    sqe->user_data = URING_USER_DATA_RECIEVE;
+    ring->recieve_armed = true;
+}
+
+bool UringInit(Uring *ring, int sockfd)
+{
+    MEMORY_SET(ring, 0, sizeof(Uring));
+    ring->sockfd = sockfd;
+    
+    struct io_uring_params params = {0};
+    params.flags = IORING_SETUP_SUBMIT_ALL;
+    ring->fd = UringSetup(URING_QUEUE_SIZE, &params);
+    if(ring->fd < 0)
+    {
+        fprintf(stderr, "[ERROR] io_uring_setup: %s\n", strerror(errno));
+        return false;
+    }
+    
+    if(!(params.features & IORING_FEAT_SINGLE_MMAP) || !UringProbe(ring->fd))
+    {
+        fprintf(stderr, "[ERROR] io_uring is too old, single mmap or recvmsg and sendmsg are not supported\n");
+        return false;
+    }
+    
+    size_t sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+    size_t cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    uint8_t *rings = (uint8_t *)UringMap(ring->fd, MAX(sq_ring_size, cq_ring_size), IORING_OFF_SQ_RING);
+    ring->sqes = (struct io_uring_sqe *)UringMap(ring->fd, params.sq_entries * sizeof(struct io_uring_sqe),
+                                                 IORING_OFF_SQES);
+    if(rings == MAP_FAILED || ring->sqes == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Map io_uring queues: %s\n", strerror(errno));
+        return false;
+    }
+    
+    ring->sq_head = (unsigned int *)(rings + params.sq_off.head);
+    ring->sq_tail = (unsigned int *)(rings + params.sq_off.tail);
+    ring->sq_mask = *(unsigned int *)(rings + params.sq_off.ring_mask);
+    ring->sq_entries = params.sq_entries;
+    ring->cq_head = (unsigned int *)(rings + params.cq_off.head);
+    ring->cq_tail = (unsigned int *)(rings + params.cq_off.tail);
+    ring->cq_mask = *(unsigned int *)(rings + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)(rings + params.cq_off.cqes);
+    
+    // submission entries always sit at the index of their slot
+    unsigned int *sq_array = (unsigned int *)(rings + params.sq_off.array);
+    for(unsigned int idx = 0; idx < params.sq_entries; ++idx)
+        sq_array[idx] = idx;
+    
+    // the kernel wants the buffer ring page aligned, mmap takes care of it
+    size_t buffer_ring_size = URING_BUFFER_COUNT * sizeof(struct io_uring_buf);
+    size_t buffers_size = (size_t)URING_BUFFER_COUNT * URING_BUFFER_SIZE;
+    ring->buffer_ring = (struct io_uring_buf_ring *)mmap(0, buffer_ring_size, PROT_READ | PROT_WRITE,
+                                                         MAP_ANON | MAP_PRIVATE, -1, 0);
+    ring->buffers = (uint8_t *)mmap(0, buffers_size, PROT_READ | PROT_WRITE,
+                                    MAP_ANON | MAP_PRIVATE, -1, 0);
+    if(ring->buffer_ring == MAP_FAILED || ring->buffers == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Allocate io_uring buffers\n");
+        return false;
+    }
+    
+    struct io_uring_buf_reg buffer_reg = {0};
+    buffer_reg.ring_addr = (uint64_t)(uintptr_t)ring->buffer_ring;
+    buffer_reg.ring_entries = URING_BUFFER_COUNT;
+    buffer_reg.bgid = URING_BUFFER_GROUP;
+    if(UringRegister(ring->fd, IORING_REGISTER_PBUF_RING, &buffer_reg, 1) < 0)
+    {
+        fprintf(stderr, "[ERROR] Register io_uring buffer ring: %s\n", strerror(errno));
+        return false;
+    }
+    
+    for(unsigned int buffer_idx = 0; buffer_idx < URING_BUFFER_COUNT; ++buffer_idx)
+        UringRecycleBuffer(ring, (uint16_t)buffer_idx);
+    
+    size_t memory_size = (URING_BUFFER_COUNT * sizeof(UringPacket)
+                          + URING_SEND_CAPACITY * (sizeof(SocketPacket)
+                                                   + sizeof(struct msghdr)
+                                                   + sizeof(struct iovec)
+                                                   + sizeof(struct sockaddr_in)));
+    void *memory = mmap(0, memory_size, PROT_READ | PROT_WRITE, MAP_ANON | MAP_PRIVATE, -1, 0);
+    if(memory == MAP_FAILED)
+    {
+        fprintf(stderr, "[ERROR] Allocate io_uring send queue\n");
+        return false;
+    }
+    MemoryArena arena;
+    InitializeArena(&arena, (uint8_t *)memory, memory_size);
+    ring->send_msgs = PUSH_ARRAY(&arena, struct msghdr, URING_SEND_CAPACITY);
+    ring->send_iovecs = PUSH_ARRAY(&arena, struct iovec, URING_SEND_CAPACITY);
+    ring->recieved = PUSH_ARRAY(&arena, UringPacket, URING_BUFFER_COUNT);
+    ring->send_packets = PUSH_ARRAY(&arena, SocketPacket, URING_SEND_CAPACITY);
+    ring->send_addresses = PUSH_ARRAY(&arena, struct sockaddr_in, URING_SEND_CAPACITY);
+    
+    // every recieve buffer starts with an io_uring_recvmsg_out followed
+    // by the sender address and the payload
+    ring->recieve_msg.msg_namelen = sizeof(struct sockaddr_in);
+    UringArmRecieve(ring);
+    if(UringEnter(ring->fd, ring->sq_pending, 0, 0) < 0)
+    {
+        fprintf(stderr, "[ERROR] Post io_uring recieve: %s\n", strerror(errno));
+        return false;
+    }
+    ring->sq_pending = 0;
+    
+    // the probe can't tell if recvmsg is multishot yet, without it the
+    // recieve fails as soon as it gets submitted
+    unsigned int cq_head = *ring->cq_head;
+    if(cq_head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE))
+    {
+        struct io_uring_cqe *cqe = ring->cqes + (cq_head & ring->cq_mask);
+        if(cqe->user_data == URING_USER_DATA_RECIEVE && cqe->res < 0 && cqe->res != -ENOBUFS)
+        {
+            fprintf(stderr, "[ERROR] Multishot io_uring recieve: %s\n", strerror(-cqe->res));
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+// Takes in every completion, recieved datagrams are appended to
+// ring->recieved and keep their buffer until UringRecycleRecieved
+void UringReap(Uring *ring)
+{
+    unsigned int head = *ring->cq_head;
+    unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+    for(; head != tail; ++head)
+    {
+        struct io_uring_cqe *cqe = ring->cqes + (head & ring->cq_mask);
+        if(cqe->user_data == URING_USER_DATA_SEND)
+        {
+            ASSERT(ring->send_in_flight > 0);
+            --ring->send_in_flight;
+            if(cqe->res < 0)
+                fprintf(stderr, "[ERROR] io_uring send: %s\n", strerror(-cqe->res));
+            continue;
+        }
+        
+        if(!(cqe->flags & IORING_CQE_F_MORE))
+            ring->recieve_armed = false;
+        
+        if(!(cqe->flags & IORING_CQE_F_BUFFER))
+        {
+            // out of buffers is expected under load, the recieve gets
+            // posted again once we give some back
+            if(cqe->res < 0 && cqe->res != -ENOBUFS)
+                fprintf(stderr, "[ERROR] io_uring recieve: %s\n", strerror(-cqe->res));
+            continue;
+        }
+        
+        uint16_t buffer_id = (uint16_t)(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+        uint8_t *buffer = ring->buffers + (size_t)buffer_id * URING_BUFFER_SIZE;
+        struct io_uring_recvmsg_out *out = (struct io_uring_recvmsg_out *)buffer;
+        if(cqe->res < 0
+           || out->namelen < sizeof(struct sockaddr_in)
+           || (out->flags & MSG_TRUNC))
+        {
+            if(cqe->res >= 0 && (out->flags & MSG_TRUNC))
+                ++ring->truncated_count;
+            UringRecycleBuffer(ring, buffer_id);
+            continue;
+        }
+        
+        struct sockaddr_in *from = (struct sockaddr_in *)(out + 1);
+        ASSERT(ring->recieved_count < URING_BUFFER_COUNT);
+        UringPacket *packet = ring->recieved + ring->recieved_count++;
+        packet->address.address = ntohl(from->sin_addr.s_addr);
+        packet->address.port = ntohs(from->sin_port);
+        packet->data = (uint8_t *)(out + 1) + ring->recieve_msg.msg_namelen + out->controllen;
+        packet->size = (int)out->payloadlen;
+        packet->buffer_id = buffer_id;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+// Hands the buffers of ring->recieved back to the kernel
+void UringRecycleRecieved(Uring *ring)
+{
+    for(unsigned int packet_idx = 0; packet_idx < ring->recieved_count; ++packet_idx)
+        UringRecycleBuffer(ring, ring->recieved[packet_idx].buffer_id);
+    ring->recieved_count = 0;
+    
+    if(!ring->recieve_armed)
+        UringArmRecieve(ring);
+}
+
+// The send queue can only be written again once the kernel is done with
+// the previous submit. UDP sends normally complete inside io_uring_enter
+// so this rarely has to wait.
+void UringWaitSends(Uring *ring)
+{
+    UringReap(ring);
+    while(ring->send_in_flight > 0)
+    {
+        if(UringEnter(ring->fd, 0, 1, IORING_ENTER_GETEVENTS) < 0 && errno != EINTR)
+        {
+            fprintf(stderr, "[ERROR] Wait for io_uring sends: %s\n", strerror(errno));
+            break;
+        }
+        UringReap(ring);
+    }
+}
+
+// Submits every queued datagram, and a re-armed recieve, in one syscall
+void UringSubmit(Uring *ring)
+{
+    for(unsigned int packet_idx = 0; packet_idx < ring->send_count; ++packet_idx)
+    {
+        SocketPacket *packet = ring->send_packets + packet_idx;
+        
+        struct sockaddr_in *to = ring->send_addresses + packet_idx;
+        to->sin_family = AF_INET;
+        to->sin_addr.s_addr = htonl(packet->address.address);
+        to->sin_port = htons(packet->address.port);
+        
+        struct msghdr *msg = ring->send_msgs + packet_idx;
+        MEMORY_SET(msg, 0, sizeof(struct msghdr));
+        msg->msg_name = to;
+        msg->msg_namelen = sizeof(struct sockaddr_in);
+        SocketPacketSetIovecs(packet, msg, ring->send_iovecs + packet_idx);
+        
+        struct io_uring_sqe *sqe = UringGetSqe(ring);
+        ASSERT(sqe != 0);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = ring->sockfd;
+        sqe->addr = (uint64_t)(uintptr_t)msg;
+        sqe->len = 1;
+        sqe->user_data = URING_USER_DATA_SEND;
+    }
+    ring->send_in_flight += ring->send_count;
+    ring->send_count = 0;
+    
+    while(ring->sq_pending > 0)
+    {
+        int submitted = UringEnter(ring->fd, ring->sq_pending, 0, 0);
+        if(submitted < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            
+            // completion queue is full, make room
+            if(errno == EAGAIN || errno == EBUSY)
+            {
+                UringReap(ring);
+                continue;
+            }
+            fprintf(stderr, "[ERROR] io_uring_enter: %s\n", strerror(errno));
+            break;
+        }
+        ring->sq_pending -= (unsigned int)submitted;
+    }
+}
+
+// Same as SocketBatchPush, a full queue gets submitted first
+SocketPacket *UringPushPacket(Uring *ring, Address *destination)
+{
+    if(ring->send_count >= URING_SEND_CAPACITY)
+        UringSubmit(ring);
+    if(ring->send_count == 0 && ring->send_in_flight > 0)
+        UringWaitSends(ring);
+    
+    SocketPacket *result = ring->send_packets + ring->send_count;
+    ++ring->send_count;
+    result->address = *destination;
+    result->size = 0;
+    result->spans = 0;
+    result->span_count = 0;
+    return result;
+}
@@ -0,0 +1,415 @@
+/* date = October 17th 2026 10:40 pm */
+
+#ifndef NET_EMULATOR_H
+#define NET_EMULATOR_H
+
+// Sits between the game and its socket and makes loopback behave like a
+// bad link: every datagram going out or coming in can be delayed, lost,
+// duplicated or reordered, with separate settings for each direction.
+// Delayed datagrams wait in a queue until they are due, they only leave
+// it when the socket gets used again, so delays are as coarse as the
+// frame or tick of the caller. Every random choice comes from one seeded
+// generator, the same seed and traffic give the same conditions.
+
+typedef struct NetConditions
+{
+    float latency_ms;
+    float jitter_ms; // added on top of latency, up to this much
+    float loss;      // in percent, same for the rest
+    float duplicate;
+    float reorder;   // out of line, up to NET_REORDER_MAX_MS later than the rest
+} NetConditions;
+
+#define NET_REORDER_MAX_MS 50.0f
+
+typedef struct NetEmulatorConfig
+{
+    bool enabled;
+    uint64_t seed;
+    NetConditions outgoing;
+    NetConditions incoming;
+} NetEmulatorConfig;
+
+typedef struct NetDelayedPacket
+{
+    int64_t due_ns;
+    uint32_t order; // keeps packets due at the same time in order
+    int sockfd;
+    Address address;
+    int size;
+    uint8_t data[PACKET_MAX_SIZE];
+} NetDelayedPacket;
+
+// Min-heap of the delayed packets by time they are due
+typedef struct NetQueue
+{
+    NetDelayedPacket *packets;
+    unsigned int *heap;       // indices into packets
+    unsigned int *free_slots; // indices into packets
+    unsigned int count;
+    unsigned int free_count;
+    unsigned int capacity;
+    uint32_t next_order;
+    int64_t last_due_ns;      // packets not reordered are never due before this
+} NetQueue;
+
+typedef struct NetEmulator
+{
+    NetConditions outgoing;
+    NetConditions incoming;
+    uint64_t random;
+    NetQueue sending;
+    NetQueue recieving;
+    SocketBatch *scratch; // what the socket hands us before it is queued
+    
+    unsigned int lost_count;
+    unsigned int duplicated_count;
+    unsigned int reordered_count;
+    unsigned int overflow_count; // dropped because the queue was full
+} NetEmulator;
+
+size_t NetQueueMemorySize(unsigned int capacity)
+{
+    size_t result = capacity * (sizeof(NetDelayedPacket) + 2 * sizeof(unsigned int));
+    return result;
+}
+
+void NetQueueInit(NetQueue *queue, MemoryArena *arena, unsigned int capacity)
+{
+    queue->packets = PUSH_ARRAY(arena, NetDelayedPacket, capacity);
+    queue->heap = PUSH_ARRAY(arena, unsigned int, capacity);
+    queue->free_slots = PUSH_ARRAY(arena, unsigned int, capacity);
+    queue->count = 0;
+    queue->capacity = capacity;
+    queue->free_count = capacity;
+    queue->next_order = 0;
+    queue->last_due_ns = 0;
+    for(unsigned int slot_idx = 0; slot_idx < capacity; ++slot_idx)
+        queue->free_slots[slot_idx] = capacity - slot_idx - 1;
+}
+
+bool NetQueueBefore(NetQueue *queue, unsigned int heap_a, unsigned int heap_b)
+{
+    NetDelayedPacket *a = queue->packets + queue->heap[heap_a];
+    NetDelayedPacket *b = queue->packets + queue->heap[heap_b];
+    bool result = (a->due_ns < b->due_ns
+                   || (a->due_ns == b->due_ns && (int32_t)(a->order - b->order) < 0));
+    return result;
+}
+
+// Reserves a packet due at due_ns, returns 0 when the queue is full
+NetDelayedPacket *NetQueuePush(NetQueue *queue, int64_t due_ns)
+{
+    if(queue->free_count == 0)
+        return 0;
+    
+    unsigned int slot_idx = queue->free_slots[--queue->free_count];
+    NetDelayedPacket *result = queue->packets + slot_idx;
+    result->due_ns = due_ns;
+    result->order = queue->next_order++;
+    
+    unsigned int heap_idx = queue->count++;
+    queue->heap[heap_idx] = slot_idx;
+    while(heap_idx > 0)
+    {
+        unsigned int parent_idx = (heap_idx - 1) / 2;
+        if(!NetQueueBefore(queue, heap_idx, parent_idx))
+            break;
+        SWAP(queue->heap[heap_idx], queue->heap[parent_idx], unsigned int);
+        heap_idx = parent_idx;
+    }
+    return result;
+}
+
+// Oldest packet that is due at now_ns, stays valid until the next push
+NetDelayedPacket *NetQueuePop(NetQueue *queue, int64_t now_ns)
+{
+    if(queue->count == 0)
+        return 0;
+    
+    unsigned int slot_idx = queue->heap[0];
+    NetDelayedPacket *result = queue->packets + slot_idx;
+    if(result->due_ns > now_ns)
+        return 0;
+    
+    queue->free_slots[queue->free_count++] = slot_idx;
+    queue->heap[0] = queue->heap[--queue->count];
+    unsigned int heap_idx = 0;
+    while(true)
+    {
+        unsigned int first_idx = heap_idx;
+        unsigned int left_idx = 2 * heap_idx + 1;
+        unsigned int right_idx = left_idx + 1;
+        if(left_idx < queue->count && NetQueueBefore(queue, left_idx, first_idx))
+            first_idx = left_idx;
+        if(right_idx < queue->count && NetQueueBefore(queue, right_idx, first_idx))
+            first_idx = right_idx;
+        if(first_idx == heap_idx)
+            break;
+        SWAP(queue->heap[heap_idx], queue->heap[first_idx], unsigned int);
+        heap_idx = first_idx;
+    }
+    return result;
+}
+
+size_t NetEmulatorMemorySize(unsigned int capacity)
+{
+    size_t result = 2 * NetQueueMemorySize(capacity) + sizeof(SocketBatch);
+    return result;
+}
+
+// capacity is how many packets can wait in each direction
+void NetEmulatorInit(NetEmulator *emulator, MemoryArena *arena, unsigned int capacity,
+                     NetEmulatorConfig *config, uint64_t seed)
+{
+    MEMORY_SET(emulator, 0, sizeof(NetEmulator));
+    emulator->outgoing = config->outgoing;
+    emulator->incoming = config->incoming;
+    // xorshift can't leave zero
+    emulator->random = (seed != 0 ? seed : 0x9E3779B97F4A7C15ull);
+    NetQueueInit(&emulator->sending, arena, capacity);
+    NetQueueInit(&emulator->recieving, arena, capacity);
+    emulator->scratch = PUSH_ARRAY(arena, SocketBatch, 1);
+}
+
+// xorshift64*, uniform in [0, 1)
+float NetEmulatorRandom(NetEmulator *emulator)
+{
+    uint64_t x = emulator->random;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    emulator->random = x;
+    float result = (float)((x * 0x2545F4914F6CDD1Dull) >> 40) / (float)(1 << 24);
+    return result;
+}
+
+bool NetEmulatorRoll(NetEmulator *emulator, float percent)
+{
+    bool result = (percent > 0 && NetEmulatorRandom(emulator) * 100.0f < percent);
+    return result;
+}
+
+// Runs one datagram through the conditions of its direction into the
+// queue. The data may be split into spans like a SocketPacket.
+void NetEmulatorQueue(NetEmulator *emulator, NetQueue *queue, NetConditions *conditions,
+                      int64_t now_ns, int sockfd, SocketPacket *packet)
+{
+    if(NetEmulatorRoll(emulator, conditions->loss))
+    {
+        ++emulator->lost_count;
+        return;
+    }
+    
+    unsigned int copy_count = 1;
+    if(NetEmulatorRoll(emulator, conditions->duplicate))
+    {
+        ++emulator->duplicated_count;
+        copy_count = 2;
+    }
+    
+    for(unsigned int copy_idx = 0; copy_idx < copy_count; ++copy_idx)
+    {
+        // jitter alone doesn't reorder, a link delays what is queued
+        // behind a late packet too. A reordered packet still takes the
+        // latency but not its place in line, it gets overtaken or
+        // overtakes whatever got pushed back behind others.
+        float delay_ms = conditions->latency_ms + conditions->jitter_ms * NetEmulatorRandom(emulator);
+        int64_t due_ns = now_ns;
+        if(NetEmulatorRoll(emulator, conditions->reorder))
+        {
+            ++emulator->reordered_count;
+            delay_ms += NET_REORDER_MAX_MS * NetEmulatorRandom(emulator);
+            due_ns += (int64_t)(delay_ms * 1000000.0f);
+        }
+        else
+        {
+            due_ns += (int64_t)(delay_ms * 1000000.0f);
+            due_ns = MAX(due_ns, queue->last_due_ns);
+            queue->last_due_ns = due_ns;
+        }
+        
+        NetDelayedPacket *delayed = NetQueuePush(queue, due_ns);
+        if(delayed == 0)
+        {
+            ++emulator->overflow_count;
+            return;
+        }
+        
+        delayed->sockfd = sockfd;
+        delayed->address = packet->address;
+        if(packet->spans)
+        {
+            // the first span stands for the start of data
+            int size = packet->size;
+            for(unsigned int span_idx = 1; span_idx < packet->span_count; ++span_idx)
+            {
+                SocketSpan *span = packet->spans + span_idx;
+                ASSERT(size + (int)span->size <= PACKET_MAX_SIZE);
+                MEMORY_COPY(delayed->data + size, span->data, span->size);
+                size += (int)span->size;
+            }
+            MEMORY_COPY(delayed->data, packet->data, (size_t)packet->size);
+            delayed->size = size;
+        }
+        else
+        {
+            MEMORY_COPY(delayed->data, packet->data, (size_t)packet->size);
+            delayed->size = packet->size;
+        }
+    }
+}
+
+// Sends what is due by now
+void NetEmulatorFlush(NetEmulator *emulator, int64_t now_ns)
+{
+    NetDelayedPacket *delayed;
+    while((delayed = NetQueuePop(&emulator->sending, now_ns)) != 0)
+        SocketSend(delayed->sockfd, &delayed->address, delayed->data, delayed->size);
+}
+
+// Stand-ins for the socket calls of networking.h
+bool NetEmulatorSend(NetEmulator *emulator, int64_t now_ns,
+                     int sockfd, Address *destination, void *data, int size)
+{
+    ASSERT(size >= 0 && size <= PACKET_MAX_SIZE);
+    SocketPacket *packet = emulator->scratch->packets;
+    packet->address = *destination;
+    packet->size = size;
+    packet->spans = 0;
+    packet->span_count = 0;
+    MEMORY_COPY(packet->data, data, (size_t)size);
+    NetEmulatorQueue(emulator, &emulator->sending, &emulator->outgoing, now_ns, sockfd, packet);
+    NetEmulatorFlush(emulator, now_ns);
+    return true;
+}
+
+unsigned int NetEmulatorSendBatch(NetEmulator *emulator, int64_t now_ns,
+                                  int sockfd, SocketBatch *batch)
+{
+    unsigned int result = batch->count;
+    for(unsigned int packet_idx = 0; packet_idx < batch->count; ++packet_idx)
+    {
+        NetEmulatorQueue(emulator, &emulator->sending, &emulator->outgoing,
+                         now_ns, sockfd, batch->packets + packet_idx);
+    }
+    batch->count = 0;
+    NetEmulatorFlush(emulator, now_ns);
+    return result;
+}
+
+// Queues everything the socket has and hands out what is due, up to a
+// batch at a time
+unsigned int NetEmulatorRecieveBatch(NetEmulator *emulator, int64_t now_ns,
+                                     int sockfd, SocketBatch *batch)
+{
+    SocketBatch *scratch = emulator->scratch;
+    while(SocketRecieveBatch(sockfd, scratch) > 0)
+    {
+        for(unsigned int packet_idx = 0; packet_idx < scratch->count; ++packet_idx)
+        {
+            SocketPacket *packet = scratch->packets + packet_idx;
+            packet->spans = 0;
+            NetEmulatorQueue(emulator, &emulator->recieving, &emulator->incoming,
+                             now_ns, sockfd, packet);
+        }
+    }
+    batch->truncated_count += scratch->truncated_count;
+    scratch->truncated_count = 0;
+    
+    batch->count = 0;
+    NetDelayedPacket *delayed;
+    while(batch->count < ARRAY_SIZE(batch->packets)
+          && (delayed = NetQueuePop(&emulator->recieving, now_ns)) != 0)
+    {
+        SocketPacket *packet = batch->packets + batch->count++;
+        packet->address = delayed->address;
+        packet->size = delayed->size;
+        MEMORY_COPY(packet->data, delayed->data, (size_t)delayed->size);
+    }
+    return batch->count;
+}
+
+bool NetConditionsSet(NetConditions *conditions, char *key, unsigned int key_size, float value)
+{
+    if(StringCompare(key, key_size, "latency", 7))
+        conditions->latency_ms = value;
+    else if(StringCompare(key, key_size, "jitter", 6))
+        conditions->jitter_ms = value;
+    else if(StringCompare(key, key_size, "loss", 4))
+        conditions->loss = value;
+    else if(StringCompare(key, key_size, "duplicate", 9))
+        conditions->duplicate = value;
+    else if(StringCompare(key, key_size, "reorder", 7))
+        conditions->reorder = value;
+    else
+        return false;
+    return true;
+}
+
+// Reads a comma separated list of key=value pairs like
+// "latency=150,jitter=20,loss=5,seed=7". latency and jitter are in
+// milliseconds, loss, duplicate and reorder in percent. A key prefixed
+// with out- or in- only applies to one direction, otherwise to both.
+bool NetEmulatorConfigParse(NetEmulatorConfig *config, char *spec)
+{
+    MEMORY_SET(config, 0, sizeof(NetEmulatorConfig));
+    config->enabled = true;
+    config->seed = 1;
+    
+    char *at = spec;
+    while(*at)
+    {
+        char *key = at;
+        while(*at && *at != '=' && *at != ',')
+            ++at;
+        unsigned int key_size = (unsigned int)(at - key);
+        if(*at != '=')
+        {
+            fprintf(stderr, "[ERROR] Network emulation: expected key=value\n");
+            return false;
+        }
+        ++at;
+        
+        char *value_end;
+        double value = strtod(at, &value_end);
+        if(value_end == at || (*value_end && *value_end != ',') || value < 0)
+        {
+            fprintf(stderr, "[ERROR] Network emulation: bad value for %.*s\n", key_size, key);
+            return false;
+        }
+        at = value_end;
+        if(*at == ',')
+            ++at;
+        
+        bool known;
+        if(StringCompare(key, key_size, "seed", 4))
+        {
+            config->seed = (uint64_t)value;
+            known = true;
+        }
+        else if(key_size > 4 && StringCompare(key, 4, "out-", 4))
+        {
+            known = NetConditionsSet(&config->outgoing, key + 4, key_size - 4, (float)value);
+        }
+        else if(key_size > 3 && StringCompare(key, 3, "in-", 3))
+        {
+            known = NetConditionsSet(&config->incoming, key + 3, key_size - 3, (float)value);
+        }
+        else
+        {
+            known = (NetConditionsSet(&config->outgoing, key, key_size, (float)value)
+                     && NetConditionsSet(&config->incoming, key, key_size, (float)value));
+        }
+        
+        if(!known)
+        {
+            fprintf(stderr, "[ERROR] Network emulation: unknown key %.*s\n", key_size, key);
+            return false;
+        }
+    }
+    
+    return true;
+}
+
+#endif //NET_EMULATOR_H
@@ -3,34 +3,43 @@
 #ifndef NETWORKING_H
 #define NETWORKING_H
 
-#define EXPAND_INT(v) (v>>24),(v>>16&0xff),(v>>8&&0xff),(v&&0xff)
+#define EXPAND_INT(v) (v>>24&0xff),(v>>16&0xff),(v>>8&0xff),(v&0xff)
+
+// Largest datagram we are willing to send, stays below the usual
+// 1500 byte ethernet MTU with room for IP/UDP headers
+#define PACKET_MAX_SIZE 1200
 
 typedef enum PacketType
 {
     INVALID,
-    CONNECT,
-    ACCEPT,
-    DISCONNECT,
-    SNAPSHOT
+    CONTROL,  // reliable messages only
+    SNAPSHOT, // reliable messages followed by entity states
+    INPUT,    // reliable messages followed by player inputs
+    REJECT,   // connectionless, the server won't talk to us
+    PacketType_COUNT
 } PacketType;
 
 char *PacketTypeName(PacketType packet_type)
 {
     switch(packet_type)
     {
-        case INVALID:    return "INVALID";
-        case CONNECT:    return "CONNECT";
-        case ACCEPT:     return "ACCEPT";
-        case DISCONNECT: return "DISCONNECT";
-        case SNAPSHOT:   return "SNAPSHOT";
-        default:         return "UNKNOWN";
+        case INVALID:  return "INVALID";
+        case CONTROL:  return "CONTROL";
+        case SNAPSHOT: return "SNAPSHOT";
+        case INPUT:    return "INPUT";
+        case REJECT:   return "REJECT";
+        default:       return "UNKNOWN";
     }
 }
 
+// Wire format in protocol.h
 typedef struct PacketHeader
 {
     unsigned int protocol;
     PacketType type;
+    uint16_t sequence; // of this datagram
+    uint16_t ack;      // newest sequence recieved from the other side
+    uint32_t ack_bits; // bit n set means ack - n - 1 was recieved too
 } PacketHeader;
 
 typedef struct Address
@@ -72,12 +81,69 @@ bool SequenceIsNewer(uint16_t seq_new, uint16_t seq_old)
     return result;
 }
 
+// Datagrams are moved in and out of the socket SOCKET_BATCH_SIZE at a
+// time so we pay for one syscall per batch instead of one per packet
+#define SOCKET_BATCH_SIZE 64
+
+// Memory sent as part of a packet without copying it into the packet,
+// laid out like struct iovec so the sockets can pass it on as it is
+typedef struct SocketSpan
+{
+    void *data;
+    size_t size;
+} SocketSpan;
+
+typedef struct SocketPacket
+{
+    Address address;
+    int size;
+    uint8_t data[PACKET_MAX_SIZE];
+    
+    // when set, the datagram is gathered from spans, spans[0] is left
+    // free for the first size bytes of data
+    SocketSpan *spans;
+    unsigned int span_count;
+} SocketPacket;
+
+typedef struct SocketBatch
+{
+    SocketPacket packets[SOCKET_BATCH_SIZE];
+    unsigned int count;
+    unsigned int truncated_count; // dropped for not fitting a packet, added up until taken
+} SocketBatch;
+
+// Marks sequence as recieved in the (ack, ack_bits) pair we send back,
+// ack is the newest sequence and bit n of ack_bits stands for ack - n - 1
+void AckRecieved(uint16_t *ack, uint32_t *ack_bits, uint16_t sequence)
+{
+    if(SequenceIsNewer(sequence, *ack))
+    {
+        uint16_t shift = (uint16_t)(sequence - *ack);
+        if(shift < 32)
+            *ack_bits = (*ack_bits << shift) | (1u << (shift - 1));
+        else if(shift == 32)
+            *ack_bits = (1u << 31);
+        else
+            *ack_bits = 0;
+        *ack = sequence;
+    }
+    else
+    {
+        uint16_t age = (uint16_t)(*ack - sequence);
+        if(age >= 1 && age <= 32)
+            *ack_bits |= (1u << (age - 1));
+    }
+}
+
 bool SocketsInit();
 void SocketsShutdown();
 bool SocketCreate(int *sockfd);
+bool SocketReusePort(int sockfd);
 bool SocketBind(int sockfd, unsigned short port);
 bool SocketClose(int sockfd);
 bool SocketSend(int sockfd, Address *destination, void *data, int size);
 int SocketRecieve(int sockfd, Address *sender, void *data, int size);
+unsigned int SocketRecieveBatch(int sockfd, SocketBatch *batch);
+unsigned int SocketSendBatch(int sockfd, SocketBatch *batch);
 
 #endif // NETWORKING_H
@@ -8,19 +8,12 @@
 
 #include <stdio.h>
 
-Position PositionOffset(Position position,
-                        int offset_unit_x, int offset_unit_y,
-                        float offset_rem_x, float offset_rem_y)
-{
-    Position result;
-    float rem_x = position.rem.x + offset_rem_x;
-    float rem_y = position.rem.y + offset_rem_y;
-    result.unit.x = position.unit.x + offset_unit_x + ROUNDF(rem_x);
-    result.unit.y = position.unit.y + offset_unit_y + ROUNDF(rem_y);
-    result.rem.x = position.rem.x + offset_rem_x - ROUNDF(rem_x);
-    result.rem.y = position.rem.y + offset_rem_y - ROUNDF(rem_y);
-    return result;
-}
+#include "entity_delta.h"
+#include "bitstream.h"
+#include "protocol.h"
+#include "reliable_channel.h"
+#include "level.h"
+#include "simulation.h"
 
 Vec2 ProjectGlobalToView(Vec2i point, Position camera_p)
 {
@@ -57,204 +50,65 @@ Vec2 ProjectGlobalToScreen(Vec2i point, Position camera_p, Vec2i screen_size, fl
     return screen;
 }
 
-Recti RectiMove(Recti recti, int move_x, int move_y)
-{
-    Recti result;
-    result.x0 = recti.x0 + move_x;
-    result.y0 = recti.y0 + move_y;
-    result.x1 = recti.x1 + move_x;
-    result.y1 = recti.y1 + move_y;
-    return result;
-}
+#define UNITS_TO_PIXELS 8
 
-Recti RectiAbs(int pos_x, int pos_y, int width, int height)
+// Units on the screen, with a tile to spare on every side
+Recti ScreenView(Vec2i screen_size, Position camera_p, float units_to_pixels)
 {
-    Recti result = { pos_x, pos_y, pos_x + width, pos_y + height };
+    // the screen spans screen_size / units_to_pixels units each way
+    Recti result;
+    result.x0 = camera_p.unit.x - (int)((float)screen_size.x / units_to_pixels) - 1;
+    result.y0 = camera_p.unit.y - (int)((float)screen_size.y / units_to_pixels) - 1;
+    result.x1 = camera_p.unit.x + (int)((float)screen_size.x / units_to_pixels) + 2;
+    result.y1 = camera_p.unit.y + (int)((float)screen_size.y / units_to_pixels) + 2;
     return result;
 }
 
-bool RectiCheckOverlap(Recti a, Recti b)
+// Asks the stream for the chunks in view
+void LevelStreamView(Level *level, Recti view)
 {
-    if(a.p1.x <= b.p0.x || b.p1.x <= a.p0.x)
-        return false;
-    
-    if(a.p1.y <= b.p0.y || b.p1.y <= a.p0.y)
-        return false;
+    Vec2i tile_min, tile_max;
+    if(level->stream == 0 || !LevelTileRange(level, view, &tile_min, &tile_max))
+        return;
     
-    return true;
-}
-
-Recti ObstacleGetMeters(int pos_x, int pos_y, int width, int height, int meters_to_units)
-{
-    Recti result;
-    result.p0.x = pos_x * meters_to_units;
-    result.p0.y = pos_y * meters_to_units;
-    result.p1.x = (pos_x + width) * meters_to_units;
-    result.p1.y = (pos_y + height) * meters_to_units;
-    return result;
+    Vec2i chunk_min = Vec2iGet(tile_min.x >> LEVEL_CHUNK_SHIFT, tile_min.y >> LEVEL_CHUNK_SHIFT);
+    Vec2i chunk_max = Vec2iGet(tile_max.x >> LEVEL_CHUNK_SHIFT, tile_max.y >> LEVEL_CHUNK_SHIFT);
+    LevelStreamRequest(level->stream, chunk_min, chunk_max);
 }
 
-typedef enum ObstacleLayout
-{
-    ObstacleLayout_Invalid,
-    ObstacleLayout_Big,
-    ObstacleLayout_Horizontal,
-    ObstacleLayout_Vertical,
-    ObstacleLayout_Dot
-} ObstacleLayout;
-
-void ObstacleRender(GameMemory *memory, Platform *platform, Vec2i screen_size,
-                    Recti *obstacle, Position camera_p, int meters_to_units, int units_to_pixels)
+// Draws the solid tiles of the level in view. With a stream only the
+// loaded chunks get drawn, the rest shows up once the thread has them
+// instead of the frame waiting on the disk.
+void LevelRender(Platform *platform, Level *level, Recti view, Vec2i screen_size,
+                 Position camera_p, float units_to_pixels)
 {
-    int width_in_tiles = (obstacle->p1.x - obstacle->p0.x) / meters_to_units;
-    int height_in_tiles = (obstacle->p1.y - obstacle->p0.y) / meters_to_units;
-    ASSERT(width_in_tiles > 0 && height_in_tiles > 0);
-    
-    bool wide = (width_in_tiles > 1);
-    bool high = (height_in_tiles > 1);
-    ObstacleLayout obstacle_layout = (wide && high ? ObstacleLayout_Big        :
-                                      wide         ? ObstacleLayout_Horizontal :
-                                      high         ? ObstacleLayout_Vertical   :
-                                      ObstacleLayout_Dot);
-    
-#if 1
-    int coord_y = 4; // blue obstacles
-#else
-    int coord_y = 5; // brown obstacles
-#endif
-    switch(obstacle_layout)
-    {
-        case ObstacleLayout_Big:
-        {
-            for(int tile_y=0; tile_y < height_in_tiles; ++tile_y)
-            {
-                int coord_offset_x0;
-                if(tile_y == (height_in_tiles - 1)) coord_offset_x0 = 0;
-                else if(tile_y > 0)                 coord_offset_x0 = 3;
-                else                                coord_offset_x0 = 6;
-                
-                for(int tile_x=0; tile_x < width_in_tiles; ++tile_x)
-                {
-                    int coord_offset_x1;
-                    if(tile_x == (width_in_tiles - 1)) coord_offset_x1 = 2;
-                    else if(tile_x > 0)                coord_offset_x1 = 1;
-                    else                               coord_offset_x1 = 0;
-                    
-                    Vec2i tile_p0, tile_p1;
-                    tile_p0.x = obstacle->p0.x + tile_x * meters_to_units;
-                    tile_p0.y = obstacle->p0.y + tile_y * meters_to_units;
-                    tile_p1.x = tile_p0.x + meters_to_units;
-                    tile_p1.y = tile_p0.y + meters_to_units;
-                    
-                    Vec2 p0 = ProjectGlobalToScreen(tile_p0, camera_p,
-                                                    screen_size, units_to_pixels);
-                    Vec2 p1 = ProjectGlobalToScreen(tile_p1, camera_p,
-                                                    screen_size, units_to_pixels);
-                    
-                    int coord_x = coord_offset_x0 + coord_offset_x1;
-                    platform->blit_texture_tile_coord(TextureID_Atlas, coord_x, coord_y,
-                                                      p0.x, p0.y, p1.x, p1.y, false);
-                }
-            }
-        } break;
-        
-        case ObstacleLayout_Horizontal:
-        {
-            for(int tile_x=0; tile_x < width_in_tiles; ++tile_x)
-            {
-                int coord_offset_x0;
-                if(tile_x == (width_in_tiles - 1)) coord_offset_x0 = 11;
-                else if(tile_x > 0)                coord_offset_x0 = 10;
-                else                               coord_offset_x0 = 9;
-                
-                Vec2i tile_p0, tile_p1;
-                tile_p0.x = obstacle->p0.x + tile_x * meters_to_units;
-                tile_p0.y = obstacle->p0.y;
-                tile_p1.x = tile_p0.x + meters_to_units;
-                tile_p1.y = tile_p0.y + meters_to_units;
-                
-                Vec2 p0 = ProjectGlobalToScreen(tile_p0, camera_p,
-                                                screen_size, units_to_pixels);
-                Vec2 p1 = ProjectGlobalToScreen(tile_p1, camera_p,
-                                                screen_size, units_to_pixels);
-                
-                int coord_x = coord_offset_x0;
-                platform->blit_texture_tile_coord(TextureID_Atlas, coord_x, coord_y,
-                                                  p0.x, p0.y, p1.x, p1.y, false);
-            }
-        } break;
-        
-        case ObstacleLayout_Vertical:
-        {
-            for(int tile_y=0; tile_y < height_in_tiles; ++tile_y)
-            {
-                int coord_offset_x0;
-                if(tile_y == (height_in_tiles - 1)) coord_offset_x0 = 12;
-                else if(tile_y > 0)                 coord_offset_x0 = 13;
-                else                                coord_offset_x0 = 14;
-                
-                Vec2i tile_p0, tile_p1;
-                tile_p0.x = obstacle->p0.x;
-                tile_p0.y = obstacle->p0.y + tile_y * meters_to_units;
-                tile_p1.x = tile_p0.x + meters_to_units;
-                tile_p1.y = tile_p0.y + meters_to_units;
-                
-                Vec2 p0 = ProjectGlobalToScreen(tile_p0, camera_p,
-                                                screen_size, units_to_pixels);
-                Vec2 p1 = ProjectGlobalToScreen(tile_p1, camera_p,
-                                                screen_size, units_to_pixels);
-                
-                int coord_x = coord_offset_x0;
-                platform->blit_texture_tile_coord(TextureID_Atlas, coord_x, coord_y,
-                                                  p0.x, p0.y, p1.x, p1.y, false);
-            }
-        } break;
-        
-        case ObstacleLayout_Dot:
+    Vec2i tile_min, tile_max;
+    if(!LevelTileRange(level, view, &tile_min, &tile_max))
+        return;
+    
+    for(int tile_y = tile_min.y; tile_y <= tile_max.y; ++tile_y)
+    {
+        for(int tile_x = tile_min.x; tile_x <= tile_max.x; ++tile_x)
         {
-            Vec2i tile_p0, tile_p1;
-            tile_p0.x = obstacle->p0.x;
-            tile_p0.y = obstacle->p0.y;
-            tile_p1.x = tile_p0.x + meters_to_units;
-            tile_p1.y = tile_p0.y + meters_to_units;
-            
-            Vec2 p0 = ProjectGlobalToScreen(tile_p0, camera_p,
-                                            screen_size, units_to_pixels);
-            Vec2 p1 = ProjectGlobalToScreen(tile_p1, camera_p,
-                                            screen_size, units_to_pixels);
+            uint8_t tile = 0;
+            if(level->stream)
+                LevelStreamTile(level->stream, tile_x, tile_y, &tile);
+            else
+                tile = LevelTile(level, tile_x, tile_y);
+            if(tile == 0)
+                continue;
             
-            int coord_x = 15;
-            platform->blit_texture_tile_coord(TextureID_Atlas, coord_x, coord_y,
-                                              p0.x, p0.y, p1.x, p1.y, false);
-        } break;
-        
-        default: break;
+            Recti tile_rect = LevelTileRect(level, tile_x, tile_y);
+            Vec2 p0 = ProjectGlobalToScreen(tile_rect.p0, camera_p, screen_size, units_to_pixels);
+            Vec2 p1 = ProjectGlobalToScreen(tile_rect.p1, camera_p, screen_size, units_to_pixels);
+            platform->blit_texture_tile_coord(TextureID_Atlas, tile - 1, LEVEL_ATLAS_ROW,
+                                              (int)p0.x, (int)p0.y, (int)p1.x, (int)p1.y, false);
+        }
     }
 }
 
-PhysicsSpec PhysicsSpecDefault()
-{
-    PhysicsSpec result;
-    result.meters_to_units = 8;
-    
-    result.run_speed = 12;
-    result.run_accel = 128;
-    
-    result.fall_speed = 16;
-    result.fall_accel = 96;
-    result.air_inertia = 0.3f;
-    
-    result.jump_speed = 16;
-    result.jump_time = 0.5f;
-    result.jump_gravity_mult = 0.5f;
-    
-    result.spell_speed = 20;
-    result.spell_time  = 0.4f;
-    return result;
-}
-
 void PlayerRender(Platform *platform, Vec2i screen_size,
-                  Entity *player, Position camera_p, int meters_to_units, int units_to_pixels)
+                  Entity *player, Position camera_p, float units_to_pixels)
 {
     Recti texture_rect = RectiMove(player->texture_rect,
                                    player->p.unit.x,
@@ -266,20 +120,22 @@ void PlayerRender(Platform *platform, Vec2i screen_size,
                                                   screen_size, units_to_pixels);
     
     platform->blit_texture_tile_coord(TextureID_Atlas, 0, 1,
-                                      screen_player_p0.x, screen_player_p0.y,
-                                      screen_player_p1.x, screen_player_p1.y,
+                                      (int)screen_player_p0.x, (int)screen_player_p0.y,
+                                      (int)screen_player_p1.x, (int)screen_player_p1.y,
                                       player->direction < 0);
 }
 
-void PlayerUpdate(GameData *game_data, Entity *player, Input *input, PhysicsSpec *physics_spec, float dt)
+// Quantized the way it goes over the wire, so the input the server steps
+// with is exactly this one
+PlayerInput PlayerInputSample(Input *input)
 {
     InputDevice *keyboard = &input->input_devices[InputDevice_Keyboard];
     InputDevice *controller = &input->input_devices[InputDevice_Controller];
     
-    float move_x = (-keyboard->keys_down[Input_DPadLeft]
-                    + keyboard->keys_down[Input_DPadRight]
-                    - controller->keys_down[Input_DPadLeft]
-                    + controller->keys_down[Input_DPadRight]
+    float move_x = ((float)(-keyboard->keys_down[Input_DPadLeft]
+                            + keyboard->keys_down[Input_DPadRight]
+                            - controller->keys_down[Input_DPadLeft]
+                            + controller->keys_down[Input_DPadRight])
                     + controller->axis_x);
     move_x = CLAMP(-1.0f, move_x, 1.0f);
     
@@ -288,164 +144,14 @@ void PlayerUpdate(GameData *game_data, Entity *player, Input *input, PhysicsSpec
     bool spell_key_down = (keyboard->keys_down[Input_BumperRight]
                            || controller->keys_down[Input_ActionRight]);
     
-    if(move_x != 0)
-        player->direction = SIGN(move_x);
-    
-    bool on_ground = false;
-    {
-        Recti hitbox = RectiMove(player->hitbox,
-                                 player->p.unit.x,
-                                 player->p.unit.y - 1);
-        for(unsigned int idx=0; idx < game_data->obstacle_count; ++idx)
-        {
-            Recti *obstacle = game_data->obstacles + idx;
-            if(RectiCheckOverlap(*obstacle, hitbox))
-            {
-                on_ground = true;;
-                break;
-            }
-        }
-    }
-    
-    // Strafe
-    {
-        float mult = (on_ground ? 1 : physics_spec->air_inertia);
-        player->v.x = Apporach(player->v.x,
-                               move_x * physics_spec->run_speed,
-                               mult * physics_spec->run_accel * dt);
-    }
-    
-    if(on_ground)
-    {
-        if(jump_key_down)
-        {
-            player->jump_timer = physics_spec->jump_time;
-            player->v.y = physics_spec->jump_speed;
-        }
-    }
-    else
-    {
-        if(player->jump_timer > 0)
-        {
-            if(jump_key_down)
-                player->jump_timer -= dt;
-            else
-                player->jump_timer = 0;
-        }
-    }
-    
-    if(!on_ground)
-    {
-        float mult = (player->jump_timer > 0 ? physics_spec->jump_gravity_mult : 1);
-        player->v.y = Apporach(player->v.y,
-                               -physics_spec->fall_speed,
-                               mult * physics_spec->fall_accel * dt);
-    }
-    
-    // MOVE X
-    {
-        float unit_velocity_x = player->v.x * physics_spec->meters_to_units;
-        player->p.rem.x += unit_velocity_x * dt;
-        int move = ROUNDF(player->p.rem.x);
-        
-        if(move != 0)
-        {
-            player->p.rem.x -= move;
-            int sign = SIGN(move);
-            
-            while(move != 0)
-            {
-                Recti hitbox = RectiMove(player->hitbox,
-                                         player->p.unit.x + sign,
-                                         player->p.unit.y);
-                bool colided = false;
-                for(unsigned int idx=0; idx < game_data->obstacle_count; ++idx)
-                {
-                    Recti *obstacle = game_data->obstacles + idx;
-                    if(RectiCheckOverlap(*obstacle, hitbox))
-                    {
-                        colided = true;
-                        break;
-                    }
-                }
-                
-                if(!colided)
-                {
-                    player->p.unit.x += sign;
-                    move -= sign;
-                }
-                else
-                {
-                    player->v.x = 0;
-                    break;
-                }
-            }
-        }
-    }
-    
-    // MOVE Y
-    {
-        float unit_velocity_y = player->v.y * physics_spec->meters_to_units;
-        player->p.rem.y += unit_velocity_y * dt;
-        int move = ROUNDF(player->p.rem.y);
-        
-        if(move != 0)
-        {
-            player->p.rem.y -= move;
-            int sign = SIGN(move);
-            
-            while(move != 0)
-            {
-                Recti hitbox = RectiMove(player->hitbox,
-                                         player->p.unit.x,
-                                         player->p.unit.y + sign);
-                bool colided = false;
-                for(unsigned int idx=0; idx < game_data->obstacle_count; ++idx)
-                {
-                    Recti *obstacle = game_data->obstacles + idx;
-                    if(RectiCheckOverlap(*obstacle, hitbox))
-                    {
-                        colided = true;
-                        break;
-                    }
-                }
-                
-                if(!colided)
-                {
-                    player->p.unit.y += sign;
-                    move -= sign;
-                }
-                else
-                {
-                    player->v.y = 0;
-                    if(player->jump_timer > 0)
-                        player->jump_timer = 0;
-                    break;
-                }
-            }
-        }
-    }
-    
-    if(player->spell_timer > 0)
-    {
-        float spell_velocity = (player->spell_direction
-                                * physics_spec->spell_speed
-                                * physics_spec->meters_to_units);
-        player->spell_p = PositionOffset(player->spell_p, 0, 0, spell_velocity * dt, 0);
-        player->spell_timer -= dt;
-    }
-    else
-    {
-        if(spell_key_down)
-        {
-            player->spell_timer = physics_spec->spell_time;
-            player->spell_direction = player->direction;
-            player->spell_p = player->p;
-        }
-    }
+    PlayerInput result;
+    result.move_x = (int8_t)ROUNDF(move_x * PLAYER_INPUT_MOVE_MAX);
+    result.buttons = (uint8_t)((jump_key_down ? PlayerButton_Jump : 0)
+                               | (spell_key_down ? PlayerButton_Spell : 0));
+    return result;
 }
 
-void CameraUpdate(Position *camera_p, Position *target_p, int meters_to_units, float dt)
+void CameraUpdate(Position *camera_p, Position *target_p, float dt)
 {
     ASSERT(camera_p != 0 && target_p != 0);
     if(camera_p == 0 || target_p == 0)
@@ -463,8 +169,8 @@ void CameraUpdate(Position *camera_p, Position *target_p, int meters_to_units, f
     {
         float move_x = Lerp(0, diff_x, 1-POWF(2, -dt * rate));
         float camera_rem_x = camera_p->rem.x + move_x;
-        int unit_move_x = ROUNDF(camera_rem_x);
-        camera_rem_x -= unit_move_x;
+        int unit_move_x = (int)ROUNDF(camera_rem_x);
+        camera_rem_x -= (float)unit_move_x;
         camera_p->rem.x = camera_rem_x;
         camera_p->unit.x += unit_move_x;
     }
@@ -473,8 +179,8 @@ void CameraUpdate(Position *camera_p, Position *target_p, int meters_to_units, f
     {
         float move_y = Lerp(0, diff_y, 1-POWF(2, -dt * rate));
         float camera_rem_y = camera_p->rem.y + move_y;
-        int unit_move_y = ROUNDF(camera_rem_y);
-        camera_rem_y -= unit_move_y;
+        int unit_move_y = (int)ROUNDF(camera_rem_y);
+        camera_rem_y -= (float)unit_move_y;
         camera_p->rem.y = camera_rem_y;
         camera_p->unit.y += unit_move_y;
     }
@@ -483,12 +189,12 @@ void CameraUpdate(Position *camera_p, Position *target_p, int meters_to_units, f
 void InitMemory(GameMemory *memory, Platform *platform, Input *input, bool *is_running)
 {
     GameData *game_data = (GameData *)memory->permanent_storage;
-    Entity *player = &game_data->player;
     PhysicsSpec *physics_spec = &game_data->physics_spec;
     
     bool success = true;
     unsigned int address = 0;
     int port = 0;
+    char *level_path = LEVEL_DEFAULT_PATH;
     
     if(input->argc >= 4)
     {
@@ -509,18 +215,26 @@ void InitMemory(GameMemory *memory, Platform *platform, Input *input, bool *is_r
             printf("Invalid port: %s\n", input->argv[3]);
             success = false;
         }
+        
+        // the rest may hold options of the platform as well
+        for(int arg_idx = 4; arg_idx + 1 < input->argc; ++arg_idx)
+        {
+            char *argument = input->argv[arg_idx];
+            if(StringCompare(argument, StringLength(argument), "--level", StringLength("--level")))
+                level_path = input->argv[++arg_idx];
+        }
     }
     else
     {
         printf("Not enough arguments to join a server.\n"
-               "Usage:   nisk.out <nickname>   <address>  <port>\n"
+               "Usage:   nisk.out <nickname>   <address>  <port> [--level <path>]\n"
                "Example: nisk.out        Bob 192.168.8.76 12345\n");
         success = false;
     }
     
     if(success)
     {
-        game_data->server_address = AddressFromInt(address, port);
+        game_data->server_address = AddressFromInt(address, (uint16_t)port);
     }
     else
     {
@@ -532,75 +246,418 @@ void InitMemory(GameMemory *memory, Platform *platform, Input *input, bool *is_r
     
     InitializeArena(&game_data->arena,
                     (uint8_t *)memory->permanent_storage + sizeof(GameData),
-                    0);
+                    memory->permanent_storage_size - sizeof(GameData));
     
     *physics_spec = PhysicsSpecDefault();
     
     if(!platform->socket_create(&game_data->socketfd))
         INVALID_CODE_PATH;
     
-    player->p.unit = Vec2iGet(0, 30);
-    
-    int player_w = 8;
-    int player_h = 8;
-    player->direction = 1;
-    player->hitbox =             RectiAbs(-player_w/2, 0, player_w, player_h - 1);
-    player->texture_rect =       RectiAbs(-player_w/2, 0, player_w, player_h);
-    player->spell_hitbox =       RectiAbs(-player_w/2, 0, player_w, player_h);
-    player->spell_texture_rect = RectiAbs(-player_w/2, 0, player_w, player_h);
-    
-    Recti *obstacle = game_data->obstacles + game_data->obstacle_count;
-    *obstacle++ = ObstacleGetMeters(-8, -8, 16, 2, physics_spec->meters_to_units);
-    *obstacle++ = ObstacleGetMeters(-6, -5,  4, 1, physics_spec->meters_to_units);
-    *obstacle++ = ObstacleGetMeters( 0, -5,  2, 1, physics_spec->meters_to_units);
-    *obstacle++ = ObstacleGetMeters( 3, -5,  1, 1, physics_spec->meters_to_units);
-    *obstacle++ = ObstacleGetMeters( 5, -5,  1, 2, physics_spec->meters_to_units);
-    *obstacle++ = ObstacleGetMeters(-1, -1,  2, 2, physics_spec->meters_to_units);
-    game_data->obstacle_count += 6;
+    // the server owns the player, it shows up where it spawns until
+    // the first snapshot says otherwise
+    game_data->player = PlayerSpawn();
+    
+    size_t level_size = 0;
+    void *level_data = platform->map_file(level_path, &level_size);
+    if(level_data == 0 || !LevelLoad(&game_data->level, level_data, level_size,
+                                     physics_spec->meters_to_units))
+    {
+        *is_running = false;
+        return;
+    }
+    
+    // the chunks around the camera live at the start of the transient
+    // storage, without one (like on bots) tiles come from the mapping.
+    // The view around the spawn is asked for up front so the platform
+    // loads it before the first frame.
+    if(platform->stream_level && memory->transient_storage_size >= sizeof(LevelStream))
+    {
+        LevelStream *stream = (LevelStream *)memory->transient_storage;
+        LevelStreamInit(stream, &game_data->level);
+        game_data->level.stream = stream;
+        Recti view = ScreenView(input->screen_size, game_data->player.p, UNITS_TO_PIXELS);
+        LevelStreamView(&game_data->level, view);
+        if(!platform->stream_level(stream, level_path))
+            game_data->level.stream = 0;
+    }
 }
 
-void DoConnect(GameData *game_data, Platform *platform)
+char *DisconnectReasonName(DisconnectReason reason)
 {
-    // SEND PACKETS
+    switch(reason)
+    {
+        case DisconnectReason_Quit:          return "quit";
+        case DisconnectReason_ServerFull:    return "server is full";
+        case DisconnectReason_NicknameTaken: return "nickname is taken";
+        case DisconnectReason_TimedOut:      return "timed out";
+        default:                             return "unknown";
+    }
+}
+
+void ClientDisconnected(GameData *game_data, DisconnectReason reason)
+{
+    printf("Disconnected: %s\n", DisconnectReasonName(reason));
+    game_data->connected = false;
+    game_data->connecting = false;
+    game_data->reconnect_time = game_data->time + 2.0;
+}
+
+// Tells the server we are leaving, so it frees our slot and nickname
+// right away instead of when we time out. There is no time left for a
+// resend, a lost datagram still ends in the timeout.
+void ClientQuit(GameData *game_data, Platform *platform)
+{
+    if(game_data->connecting == false)
+        return;
+    
+    ControlMessage disconnect = {0};
+    disconnect.type = ControlMessage_Disconnect;
+    disconnect.reason = DisconnectReason_Quit;
+    if(ReliableChannelSend(&game_data->channel, &disconnect))
+    {
+        uint8_t buffer_out[PACKET_MAX_SIZE];
+        BitStream stream = BitStreamWriter(buffer_out, sizeof(buffer_out));
+        ReliableChannelWritePacket(&game_data->channel, &stream, CONTROL, game_data->time);
+        platform->socket_send(game_data->socketfd, &game_data->server_address,
+                              buffer_out, (int)BitStreamBytesUsed(&stream));
+    }
+    game_data->connected = false;
+    game_data->connecting = false;
+}
+
+// Estimates the local time server ticks arrive at. Every SNAPSHOT is a
+// sample of it, how much they scatter around the estimate is the jitter.
+void ClientUpdateTickClock(GameData *game_data, uint16_t tick)
+{
+    if(!game_data->has_tick_clock)
+    {
+        game_data->has_tick_clock = true;
+        game_data->newest_tick = tick;
+        game_data->newest_tick_unwrapped = tick;
+        game_data->tick_zero_time = game_data->time - (double)tick * (double)game_data->tick_dt;
+        game_data->jitter = 0.0f;
+        return;
+    }
+    
+    if(SequenceIsNewer(tick, game_data->newest_tick))
+    {
+        game_data->newest_tick_unwrapped += (uint16_t)(tick - game_data->newest_tick);
+        game_data->newest_tick = tick;
+    }
+    
+    int64_t tick_unwrapped = game_data->newest_tick_unwrapped - (uint16_t)(game_data->newest_tick - tick);
+    double sample = game_data->time - (double)tick_unwrapped * (double)game_data->tick_dt;
+    float deviation = (float)(sample - game_data->tick_zero_time);
+    game_data->tick_zero_time += (double)(deviation * 0.05f);
+    game_data->jitter += ((ABS(deviation)) - game_data->jitter) * 0.1f;
+}
+
+// Moves the playout delay towards what the update gap and the jitter
+// call for, slowly so remote entities don't jump when it changes
+void ClientUpdatePlayout(GameData *game_data, float dt)
+{
+    float tick_dt = game_data->tick_dt;
+    float target = (game_data->update_gap + 0.5f) * tick_dt + 3.0f * game_data->jitter;
+    
+    // the states have to still be in the histories
+    float max_delay = (float)(ENTITY_HISTORY_SIZE / 2) * tick_dt;
+    target = CLAMP(tick_dt, target, max_delay);
+    game_data->playout_delay += (target - game_data->playout_delay) * MIN(1.0f, 2.0f * dt);
+}
+
+Position PositionLerp(Position a, Position b, float t)
+{
+    float diff_x = (float)(b.unit.x - a.unit.x) + (b.rem.x - a.rem.x);
+    float diff_y = (float)(b.unit.y - a.unit.y) + (b.rem.y - a.rem.y);
+    Position result = PositionOffset(a, 0, 0, diff_x * t, diff_y * t);
+    return result;
+}
+
+#define MAX_EXTRAPOLATION 0.1f // in seconds
+#define MAX_UPDATE_GAP (ENTITY_HISTORY_SIZE / 4) // in ticks
+
+// State of an entity at render_tick (fractional, unwrapped), in between
+// the two buffered states around it. Past the newest one the entity keeps
+// its velocity for up to MAX_EXTRAPOLATION and stops there.
+bool SnapshotInterpolate(GameData *game_data, EntityHistory *history, double render_tick, Entity *result)
+{
+    Entity *before = 0;
+    Entity *after = 0;
+    int64_t before_tick = 0;
+    int64_t after_tick = 0;
+    for(unsigned int slot = 0; slot < ENTITY_HISTORY_SIZE; ++slot)
     {
-        unsigned char buffer_out[sizeof(PacketHeader) + sizeof(Nickname)];
-        MemoryArena buffer_out_arena;
-        InitializeArena(&buffer_out_arena, buffer_out, sizeof(buffer_out));
-        PacketHeader *header_out = PUSH_STRUCT(&buffer_out_arena, PacketHeader);
-        header_out->protocol = 0;
-        header_out->type = CONNECT;
-        Nickname *nickname = PUSH_STRUCT(&buffer_out_arena, Nickname);
-        MEMORY_COPY(nickname, &game_data->nickname, sizeof(Nickname));
+        if(!history->valid[slot])
+            continue;
         
-        if(!platform->socket_send(game_data->socketfd, &game_data->server_address,
-                                  buffer_out_arena.base, buffer_out_arena.used))
+        int64_t tick = (game_data->newest_tick_unwrapped
+                        - (uint16_t)(game_data->newest_tick - history->ticks[slot]));
+        if((double)tick <= render_tick)
         {
-            INVALID_CODE_PATH;
+            if(before == 0 || tick > before_tick)
+            {
+                before = history->entities + slot;
+                before_tick = tick;
+            }
+        }
+        else if(after == 0 || tick < after_tick)
+        {
+            after = history->entities + slot;
+            after_tick = tick;
         }
     }
     
-    unsigned char buffer_in[2048];
-    while(true)
+    if(before && after)
+    {
+        float t = (float)((render_tick - (double)before_tick) / (double)(after_tick - before_tick));
+        *result = *before;
+        result->p = PositionLerp(before->p, after->p, t);
+        if(before->spell_timer > 0 && after->spell_timer > 0)
+            result->spell_p = PositionLerp(before->spell_p, after->spell_p, t);
+    }
+    else if(before)
+    {
+        float ahead = (float)(render_tick - (double)before_tick) * game_data->tick_dt;
+        ahead = MIN(ahead, MAX_EXTRAPOLATION);
+        float units_per_meter = (float)game_data->physics_spec.meters_to_units;
+        *result = *before;
+        result->p = PositionOffset(before->p, 0, 0,
+                                   before->v.x * units_per_meter * ahead,
+                                   before->v.y * units_per_meter * ahead);
+    }
+    else if(after)
     {
-        Address sender;
-        int bytes_read = platform->socket_recieve(game_data->socketfd, &sender,
-                                                  buffer_in, sizeof(buffer_in));
+        *result = *after;
+    }
+    
+    bool found = (before || after);
+    return found;
+}
+
+// Applies the entity updates of a SNAPSHOT, returns false if some of them
+// could not be applied
+bool ClientReadSnapshot(GameData *game_data, BitStream *stream)
+{
+    SnapshotList remote_list = {0};
+    if(!SerializeSnapshotList(stream, &remote_list))
+        return false;
+    uint16_t tick = remote_list.tick;
+    bool complete = true;
+    ClientUpdateTickClock(game_data, tick);
+    
+    for(unsigned int remote_idx = 0; remote_idx < remote_list.count; ++remote_idx)
+    {
+        EntityUpdate update = {0};
+        Entity fields = {0};
+        if(!SerializeEntityUpdate(stream, tick, &update, &fields))
+        {
+            complete = false;
+            break;
+        }
         
-        if(bytes_read <= 0) break;
-        if(!AddressCompare(game_data->server_address, sender)) continue;
-        if(bytes_read < (int)sizeof(PacketHeader)) continue;
+        unsigned int snapshot_idx = 0;
+        for(; snapshot_idx < game_data->snapshot_count; ++snapshot_idx)
+        {
+            if(game_data->snapshots[snapshot_idx].idx == update.idx)
+                break;
+        }
         
-        MemoryArena buffer_in_arena;
-        InitializeArena(&buffer_in_arena, buffer_in, sizeof(buffer_in));
+        if(snapshot_idx == game_data->snapshot_count)
+        {
+            if(game_data->snapshot_count < ARRAY_SIZE(game_data->snapshots))
+            {
+                Snapshot *new_snapshot = game_data->snapshots + snapshot_idx;
+                MEMORY_SET(new_snapshot, 0, sizeof(Snapshot));
+                MEMORY_SET(game_data->snapshot_histories + snapshot_idx, 0, sizeof(EntityHistory));
+                new_snapshot->idx = update.idx;
+                new_snapshot->sequence = (uint16_t)(tick - 1);
+                game_data->snapshot_count += 1;
+            }
+            else
+            {
+                complete = false;
+                continue;
+            }
+        }
         
-        PacketHeader *header_in = PUSH_STRUCT(&buffer_in_arena, PacketHeader);
+        Snapshot *local_snapshot = game_data->snapshots + snapshot_idx;
+        EntityHistory *history = game_data->snapshot_histories + snapshot_idx;
         
-        switch(header_in->type)
+        Entity entity = global_zero_entity;
+        if(update.flags & EntityUpdate_HasBaseline)
         {
-            case ACCEPT:
+            Entity *baseline = EntityHistoryGet(history, update.baseline_tick);
+            if(baseline == 0)
             {
+                complete = false;
+                continue;
+            }
+            entity = *baseline;
+        }
+        
+        EntityDeltaApply(&entity, update.field_mask, &fields);
+        EntityHistoryPut(history, tick, &entity);
+        
+        if(SequenceIsNewer(tick, local_snapshot->sequence))
+        {
+            // quick to grow so the playout delay covers a slower entity
+            // soon, slow to shrink back. Longer gaps are an entity coming
+            // back into our area, not its update rate.
+            uint16_t gap = (uint16_t)(tick - local_snapshot->sequence);
+            if(update.idx != game_data->player_idx && gap <= MAX_UPDATE_GAP)
+            {
+                float rate = ((float)gap > game_data->update_gap ? 0.2f : 0.02f);
+                game_data->update_gap += ((float)gap - game_data->update_gap) * rate;
+            }
+            
+            local_snapshot->sequence = tick;
+            local_snapshot->entity = entity;
+            local_snapshot->time_since_last_update = 0.0f;
+            
+            if(update.idx == game_data->player_idx && remote_list.has_input_ack)
+            {
+                game_data->reconcile = true;
+                game_data->server_input_ack = remote_list.input_ack;
+                game_data->server_player = entity;
+            }
+        }
+    }
+    
+    return complete;
+}
+
+bool PositionMatches(Position *predicted, Position *server)
+{
+    bool result = (predicted->unit.x == server->unit.x
+                   && predicted->unit.y == server->unit.y
+                   && (ABS(predicted->rem.x - server->rem.x)) <= REM_RESOLUTION
+                   && (ABS(predicted->rem.y - server->rem.y)) <= REM_RESOLUTION);
+    return result;
+}
+
+// Whether the prediction is as close to the server state as the wire
+// precision of the server state tells. The spell counts too, the server
+// ends it early when it hits somebody.
+bool PredictionMatches(Entity *predicted, Entity *server)
+{
+    bool result = (PositionMatches(&predicted->p, &server->p)
+                   && (ABS(predicted->v.x - server->v.x)) <= VELOCITY_RESOLUTION
+                   && (ABS(predicted->v.y - server->v.y)) <= VELOCITY_RESOLUTION
+                   && (ABS(predicted->jump_timer - server->jump_timer)) <= TIMER_RESOLUTION);
+    
+    // an ended spell is left where it was, only a flying one has to match
+    bool predicted_spell = (predicted->spell_timer > 0);
+    bool server_spell = (server->spell_timer > 0);
+    if(predicted_spell || server_spell)
+    {
+        result = (result
+                  && predicted_spell && server_spell
+                  && PositionMatches(&predicted->spell_p, &server->spell_p)
+                  && predicted->spell_direction == server->spell_direction
+                  && (ABS(predicted->spell_timer - server->spell_timer)) <= TIMER_RESOLUTION);
+    }
+    return result;
+}
+
+// Checks the newest server state of our entity against what we predicted
+// for the same input. When they differ the player is put back to the
+// server state and every input the server hasn't applied yet gets
+// replayed on top of it.
+void ClientReconcile(GameData *game_data)
+{
+    if(!game_data->reconcile)
+        return;
+    game_data->reconcile = false;
+    
+    uint16_t ack = game_data->server_input_ack;
+    uint16_t unacked_count = (uint16_t)(game_data->input_sequence - 1 - ack);
+    
+    // inputs the server applied that we didn't send are from before a
+    // reconnect, nothing to compare against
+    if(unacked_count >= game_data->predicted_count)
+        return;
+    
+    PredictedStep *acked_step = game_data->predicted + (ack % PREDICTION_BUFFER_SIZE);
+    ASSERT(acked_step->sequence == ack);
+    if(PredictionMatches(&acked_step->entity, &game_data->server_player))
+        return;
+    
+    ++game_data->correction_count;
+    Entity *player = &game_data->player;
+    *player = game_data->server_player;
+    acked_step->entity = *player;
+    for(uint16_t sequence = (uint16_t)(ack + 1);
+        sequence != game_data->input_sequence;
+        ++sequence)
+    {
+        PredictedStep *step = game_data->predicted + (sequence % PREDICTION_BUFFER_SIZE);
+        PlayerUpdate(&game_data->level, player, &step->input, &game_data->physics_spec, SIM_STEP_DT);
+        step->entity = *player;
+    }
+}
+
+void ClientHandlePacket(GameData *game_data, SocketPacket *packet)
+{
+    if(!AddressCompare(game_data->server_address, packet->address)) return;
+    if(packet->size <= 0) return;
+    
+    BitStream stream = BitStreamReader(packet->data, (size_t)packet->size);
+    PacketHeader header_in = {0};
+    if(!SerializePacketHeader(&stream, &header_in)) return;
+    
+    if(header_in.type == REJECT)
+    {
+        DisconnectReason reason;
+        if(game_data->connecting && SerializeDisconnectReason(&stream, &reason))
+            ClientDisconnected(game_data, reason);
+        return;
+    }
+    
+    if(!game_data->connecting) return;
+    if(header_in.type != CONTROL && header_in.type != SNAPSHOT) return;
+    
+    ControlMessage messages[RELIABLE_MESSAGES_PER_PACKET];
+    unsigned int message_count = 0;
+    if(!SerializeControlMessages(&stream, messages, &message_count)) return;
+    
+    ReliableChannel *channel = &game_data->channel;
+    ReliableChannelProcessPacket(channel, &header_in, messages, message_count, game_data->time);
+    
+    // only acknowledge datagrams we could apply completely, the server
+    // uses every acknowledged entity state as a baseline
+    bool complete = true;
+    if(header_in.type == SNAPSHOT)
+        complete = ClientReadSnapshot(game_data, &stream);
+    if(complete)
+        ReliableChannelAckPacket(channel, header_in.sequence);
+    
+    ControlMessage message;
+    while(ReliableChannelNextMessage(channel, &message))
+    {
+        switch(message.type)
+        {
+            case ControlMessage_Accept:
+            {
+                // the server checks moves against its level, with another
+                // one here every prediction would go wrong
+                if(message.level_hash != game_data->level.hash)
+                {
+                    fprintf(stderr, "[ERROR] The server runs a different level, "
+                            "start with --level <the level file of the server>\n");
+                    game_data->level_mismatch = true;
+                    return;
+                }
+                
                 printf("Connected!\n");
                 game_data->connected = true;
+                game_data->player_idx = message.entity_idx;
+                game_data->tick_dt = 1.0f / (float)MAX(message.tick_rate, 1);
+            } break;
+            
+            case ControlMessage_Disconnect:
+            {
+                ClientDisconnected(game_data, message.reason);
+                return;
             } break;
             
             default: break;
@@ -608,6 +665,52 @@ void DoConnect(GameData *game_data, Platform *platform)
     }
 }
 
+void DoConnect(GameData *game_data, Platform *platform)
+{
+    // datagrams still coming in from a dropped connection get read (and
+    // ignored) while we wait, not taken for answers to the next Connect
+    if(game_data->connecting == false && game_data->time >= game_data->reconnect_time)
+    {
+        // fresh channel, the server starts one for us when it sees the
+        // Connect message with the first id
+        ReliableChannelInit(&game_data->channel);
+        ControlMessage connect = {0};
+        connect.type = ControlMessage_Connect;
+        connect.nickname = game_data->nickname;
+        ReliableChannelSend(&game_data->channel, &connect);
+        game_data->snapshot_count = 0;
+        game_data->sim_accumulator = 0.0f;
+        game_data->input_sequence = 0;
+        game_data->predicted_count = 0;
+        game_data->reconcile = false;
+        game_data->player = PlayerSpawn();
+        game_data->has_tick_clock = false;
+        game_data->update_gap = 1.0f;
+        game_data->connecting = true;
+    }
+    
+    // SEND PACKETS
+    // only while Connect is due, the channel paces the retries
+    if(game_data->connecting && ReliableChannelDueCount(&game_data->channel, game_data->time) > 0)
+    {
+        uint8_t buffer_out[PACKET_MAX_SIZE];
+        BitStream stream = BitStreamWriter(buffer_out, sizeof(buffer_out));
+        ReliableChannelWritePacket(&game_data->channel, &stream, CONTROL, game_data->time);
+        
+        if(!platform->socket_send(game_data->socketfd, &game_data->server_address,
+                                  buffer_out, (int)BitStreamBytesUsed(&stream)))
+        {
+            INVALID_CODE_PATH;
+        }
+    }
+    
+    while(platform->socket_recieve_batch(game_data->socketfd, &game_data->packets_in) > 0)
+    {
+        for(unsigned int packet_idx = 0; packet_idx < game_data->packets_in.count; ++packet_idx)
+            ClientHandlePacket(game_data, game_data->packets_in.packets + packet_idx);
+    }
+}
+
 void DoUpdateAndRender(GameMemory *memory,
                        Platform *platform,
                        Input *input,
@@ -618,87 +721,93 @@ void DoUpdateAndRender(GameMemory *memory,
     Entity *player = &game_data->player;
     Position *camera_p = &game_data->camera_p;
     PhysicsSpec *physics_spec = &game_data->physics_spec;
-    float units_to_pixels = 8;
+    float units_to_pixels = UNITS_TO_PIXELS;
     
     // RECIEVE PACKETS
-    unsigned char buffer_in[2048];
-    while(true)
+    while(platform->socket_recieve_batch(game_data->socketfd, &game_data->packets_in) > 0)
     {
-        Address sender;
-        int bytes_read = platform->socket_recieve(game_data->socketfd, &sender,
-                                                  buffer_in, sizeof(buffer_in));
-        
-        if(bytes_read <= 0) break;
-        if(!AddressCompare(game_data->server_address, sender)) continue;
-        if(bytes_read < (int)sizeof(PacketHeader)) continue;
-        
-        MemoryArena buffer_in_arena;
-        InitializeArena(&buffer_in_arena, buffer_in, sizeof(buffer_in));
-        
-        PacketHeader *header_in = PUSH_STRUCT(&buffer_in_arena, PacketHeader);
-        
-        switch(header_in->type)
+        for(unsigned int packet_idx = 0; packet_idx < game_data->packets_in.count; ++packet_idx)
+            ClientHandlePacket(game_data, game_data->packets_in.packets + packet_idx);
+    }
+    
+    if(game_data->level_mismatch)
+    {
+        ClientQuit(game_data, platform);
+        *is_running = false;
+        return;
+    }
+    
+    // the server dropped us, nothing left to send it
+    if(game_data->connected == false)
+        return;
+    
+    // Forget remote entities the server stopped telling us about, they
+    // left our area of interest or disconnected. Not before the server
+    // is done sending deltas against the states we acknowledged.
+    float forget_time = MAX(1.0f, (float)ENTITY_HISTORY_SIZE * game_data->tick_dt);
+    for(unsigned int snapshot_idx = 0; snapshot_idx < game_data->snapshot_count;)
+    {
+        Snapshot *local_snapshot = game_data->snapshots + snapshot_idx;
+        local_snapshot->time_since_last_update += input->dt;
+        if(local_snapshot->time_since_last_update > forget_time)
         {
-            case SNAPSHOT:
-            {
-                Snapshot *remote_snapshot = PUSH_STRUCT(&buffer_in_arena, Snapshot);
-                Snapshot *local_snapshot = 0;
-                
-                for(unsigned int snapshot_idx = 0;
-                    snapshot_idx < game_data->snapshot_count;
-                    ++snapshot_idx)
-                {
-                    Snapshot *s = game_data->snapshots + snapshot_idx;
-                    if(s->idx == remote_snapshot->idx)
-                    {
-                        local_snapshot = s;
-                        break;
-                    }
-                }
-                
-                if(local_snapshot != 0)
-                {
-                    if(SequenceIsNewer(remote_snapshot->sequence,
-                                       local_snapshot->sequence))
-                    {
-                        MEMORY_COPY(local_snapshot, remote_snapshot, sizeof(Snapshot));
-                        local_snapshot->time_since_last_update = 0.0f;
-                    }
-                }
-                else
-                {
-                    if(game_data->snapshot_count < ARRAY_SIZE(game_data->snapshots))
-                    {
-                        local_snapshot = game_data->snapshots + game_data->snapshot_count;
-                        game_data->snapshot_count += 1;
-                        MEMORY_COPY(local_snapshot, remote_snapshot, sizeof(Snapshot));
-                        local_snapshot->time_since_last_update = 0.0f;
-                    }
-                }
-            } break;
-            
-            default: break;
+            --game_data->snapshot_count;
+            *local_snapshot = game_data->snapshots[game_data->snapshot_count];
+            MEMORY_COPY(game_data->snapshot_histories + snapshot_idx,
+                        game_data->snapshot_histories + game_data->snapshot_count,
+                        sizeof(EntityHistory));
+        }
+        else
+        {
+            ++snapshot_idx;
         }
     }
     
     // GAME UPDATE
-    PlayerUpdate(game_data, player, input, physics_spec, input->dt);
-    CameraUpdate(camera_p, &player->p, physics_spec->meters_to_units, input->dt);
+    ClientReconcile(game_data);
+    
+    // one input per simulation step, a long frame doesn't get to queue up
+    // more than a packet carries
+    game_data->sim_accumulator += input->dt;
+    game_data->sim_accumulator = MIN(game_data->sim_accumulator, MAX_INPUTS_PER_PACKET * SIM_STEP_DT);
+    while(game_data->sim_accumulator >= SIM_STEP_DT)
+    {
+        game_data->sim_accumulator -= SIM_STEP_DT;
+        PredictedStep *step = game_data->predicted + (game_data->input_sequence % PREDICTION_BUFFER_SIZE);
+        step->sequence = game_data->input_sequence++;
+        step->input = PlayerInputSample(input);
+        PlayerUpdate(&game_data->level, player, &step->input, physics_spec, SIM_STEP_DT);
+        step->entity = *player;
+        game_data->predicted_count = MIN(game_data->predicted_count + 1, PREDICTION_BUFFER_SIZE);
+    }
+    CameraUpdate(camera_p, &player->p, input->dt);
+    ClientUpdatePlayout(game_data, input->dt);
     
     // SEND PACKETS
     {
-        unsigned char buffer_out[sizeof(PacketHeader) + sizeof(Snapshot)];
-        MemoryArena buffer_out_arena;
-        InitializeArena(&buffer_out_arena, buffer_out, sizeof(buffer_out));
-        PacketHeader *header_out = PUSH_STRUCT(&buffer_out_arena, PacketHeader);
-        header_out->protocol = 0;
-        header_out->type = SNAPSHOT;
-        Snapshot *local_snapshot = PUSH_STRUCT(&buffer_out_arena, Snapshot);
-        local_snapshot->sequence = game_data->frame_idx;
-        MEMORY_COPY(&local_snapshot->entity, player, sizeof(Entity));
+        uint8_t buffer_out[PACKET_MAX_SIZE];
+        BitStream stream = BitStreamWriter(buffer_out, sizeof(buffer_out));
+        if(game_data->predicted_count > 0)
+        {
+            ReliableChannelWritePacket(&game_data->channel, &stream, INPUT, game_data->time);
+            InputList input_list;
+            input_list.sequence = (uint16_t)(game_data->input_sequence - 1);
+            input_list.count = (uint16_t)MIN(game_data->predicted_count, MAX_INPUTS_PER_PACKET);
+            input_list.view_delay_ms = (uint16_t)ROUNDF(game_data->playout_delay * 1000.0f);
+            SerializeInputList(&stream, &input_list);
+            for(unsigned int input_idx = 0; input_idx < input_list.count; ++input_idx)
+            {
+                uint16_t sequence = (uint16_t)(input_list.sequence - input_idx);
+                SerializePlayerInput(&stream, &game_data->predicted[sequence % PREDICTION_BUFFER_SIZE].input);
+            }
+        }
+        else
+        {
+            ReliableChannelWritePacket(&game_data->channel, &stream, CONTROL, game_data->time);
+        }
         
         if(!platform->socket_send(game_data->socketfd, &game_data->server_address,
-                                  buffer_out_arena.base, buffer_out_arena.used))
+                                  buffer_out, (int)BitStreamBytesUsed(&stream)))
         {
             INVALID_CODE_PATH;
         }
@@ -706,23 +815,26 @@ void DoUpdateAndRender(GameMemory *memory,
     
     // RENDER
     {
-        for(unsigned int obstacle_idx = 0;
-            obstacle_idx < game_data->obstacle_count;
-            ++obstacle_idx)
-        {
-            Recti *obstacle = game_data->obstacles + obstacle_idx;
-            ObstacleRender(memory, platform, input->screen_size, obstacle,
-                           *camera_p, physics_spec->meters_to_units, units_to_pixels);
-        }
-        
+        // the stream loads around the camera ahead of the next frames
+        Recti view = ScreenView(input->screen_size, *camera_p, units_to_pixels);
+        LevelStreamView(&game_data->level, view);
+        LevelRender(platform, &game_data->level, view, input->screen_size, *camera_p, units_to_pixels);
         
+        double render_tick = ((game_data->time - (double)game_data->playout_delay
+                               - game_data->tick_zero_time) / (double)game_data->tick_dt);
         for(unsigned int snapshot_idx = 0;
             snapshot_idx < game_data->snapshot_count;
             ++snapshot_idx)
         {
             Snapshot *local_snapshot = game_data->snapshots + snapshot_idx;
-            PlayerRender(platform, input->screen_size, &local_snapshot->entity,
-                         *camera_p, physics_spec->meters_to_units, units_to_pixels);
+            if(local_snapshot->idx == game_data->player_idx)
+                continue;
+            
+            Entity remote;
+            if(!SnapshotInterpolate(game_data, game_data->snapshot_histories + snapshot_idx,
+                                    render_tick, &remote))
+                continue;
+            PlayerRender(platform, input->screen_size, &remote, *camera_p, units_to_pixels);
         }
         
         if(player->spell_timer > 0.0f)
@@ -737,13 +849,12 @@ void DoUpdateAndRender(GameMemory *memory,
                                                          input->screen_size, units_to_pixels);
             
             platform->blit_texture_tile_coord(TextureID_Atlas, 11, 0,
-                                              screen_spell_p0.x, screen_spell_p0.y,
-                                              screen_spell_p1.x, screen_spell_p1.y,
+                                              (int)screen_spell_p0.x, (int)screen_spell_p0.y,
+                                              (int)screen_spell_p1.x, (int)screen_spell_p1.y,
                                               player->spell_direction < 0);
         }
         
-        PlayerRender(platform, input->screen_size, player, *camera_p,
-                     physics_spec->meters_to_units, units_to_pixels);
+        PlayerRender(platform, input->screen_size, player, *camera_p, units_to_pixels);
     }
 }
 
@@ -766,5 +877,13 @@ void GameUpdateAndRender(GameMemory *memory,
     if(game_data->connected == true)
         DoUpdateAndRender(memory, platform, input, is_running);
     
-    ++game_data->frame_idx;
-}
\ No newline at end of file
+    game_data->time += (double)input->dt;
+}
+
+// Sends the Disconnect of ClientQuit on the way out
+void GameShutdown(GameMemory *memory, Platform *platform)
+{
+    GameData *game_data = (GameData *)memory->permanent_storage;
+    if(memory->is_initialized)
+        ClientQuit(game_data, platform);
+}
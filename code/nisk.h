@@ -9,6 +9,88 @@ typedef struct Nickname
     unsigned int size;
 } Nickname;
 
+typedef enum DisconnectReason
+{
+    DisconnectReason_Quit,
+    DisconnectReason_ServerFull,
+    DisconnectReason_NicknameTaken,
+    DisconnectReason_TimedOut, // also sent to senders the server doesn't know
+    DisconnectReason_COUNT
+} DisconnectReason;
+
+typedef enum ControlMessageType
+{
+    ControlMessage_Connect,
+    ControlMessage_Accept,
+    ControlMessage_Disconnect,
+    ControlMessage_COUNT
+} ControlMessageType;
+
+// Delivered reliably and in order over a ReliableChannel
+typedef struct ControlMessage
+{
+    uint16_t id;
+    ControlMessageType type;
+    Nickname nickname;       // Connect
+    uint16_t entity_idx;     // Accept, the entity the client controls
+    uint16_t tick_rate;      // Accept, server ticks per second
+    uint32_t level_hash;     // Accept, see LevelHash
+    DisconnectReason reason; // Disconnect
+} ControlMessage;
+
+#define RELIABLE_QUEUE_SIZE 32
+#define RELIABLE_MESSAGES_PER_PACKET 8
+
+// Datagrams remembered until their ack comes back. Has to cover every
+// datagram in flight, a SNAPSHOT goes out as several datagrams once a
+// client sees enough entities: a few per tick at 60 ticks a second over
+// a round trip of up to a second. Power of two so it divides the 16 bit
+// sequence numbers.
+#define RELIABLE_SENT_PACKET_COUNT 256
+
+typedef struct ReliableSendEntry
+{
+    bool queued; // not acknowledged yet
+    double last_send_time; // negative until first sent
+    ControlMessage message;
+} ReliableSendEntry;
+
+typedef struct ReliableRecieveEntry
+{
+    bool recieved;
+    ControlMessage message;
+} ReliableRecieveEntry;
+
+typedef struct ReliableSentPacket
+{
+    bool valid;
+    uint16_t sequence;
+    double send_time;
+    unsigned int message_count;
+    uint16_t message_ids[RELIABLE_MESSAGES_PER_PACKET];
+} ReliableSentPacket;
+
+// Both ends of a connection keep one, see reliable_channel.h
+typedef struct ReliableChannel
+{
+    uint16_t next_sequence;
+    uint16_t remote_sequence; // newest datagram recieved
+    uint32_t remote_ack_bits;
+    uint32_t recieved_count; // datagrams recieved so far
+    float rtt; // smoothed, in seconds
+    float packet_loss; // smoothed, share of our datagrams never acknowledged
+    ReliableSentPacket sent_packets[RELIABLE_SENT_PACKET_COUNT];
+    
+    // messages [oldest_unacked_id, next_send_id) wait for an ack
+    uint16_t next_send_id;
+    uint16_t oldest_unacked_id;
+    ReliableSendEntry send_queue[RELIABLE_QUEUE_SIZE];
+    
+    // messages are handed out in id order starting at next_recieve_id
+    uint16_t next_recieve_id;
+    ReliableRecieveEntry recieve_queue[RELIABLE_QUEUE_SIZE];
+} ReliableChannel;
+
 typedef union Recti
 {
     struct { int x0, y0, x1, y1; };
@@ -57,37 +139,171 @@ typedef struct PhysicsSpec
     float spell_time;
 } PhysicsSpec;
 
+typedef struct LevelStream LevelStream;
+
+// A tilemap level mapped from its file, see level.h
+typedef struct Level
+{
+    uint8_t *data;
+    size_t size;
+    uint32_t hash; // see LevelHash
+    int tile_size; // in units
+    Vec2i chunk_p; // chunk coordinates of the first chunk in the index
+    int chunks_wide, chunks_high;
+    uint32_t *chunk_offsets;
+    LevelStream *stream; // chunks around the camera on the client, or 0
+} Level;
+
+typedef enum PlayerButton
+{
+    PlayerButton_Jump  = (1 << 0),
+    PlayerButton_Spell = (1 << 1),
+} PlayerButton;
+
+#define PLAYER_BUTTON_BITS 2
+#define PLAYER_INPUT_MOVE_MAX 127
+
+// What the player pressed during one simulation step, the only thing a
+// client tells the server about its entity
+typedef struct PlayerInput
+{
+    int8_t move_x;   // -PLAYER_INPUT_MOVE_MAX..PLAYER_INPUT_MOVE_MAX
+    uint8_t buttons; // PlayerButton flags
+} PlayerInput;
+
+// INPUT packets carry the newest inputs of the client, the same input
+// goes out in several packets so a lost one doesn't lose it
+#define MAX_INPUTS_PER_PACKET 8
+
+#define MAX_VIEW_DELAY_MS 1000
+
+typedef struct InputList
+{
+    uint16_t sequence; // of the newest input, the ones after it are older
+    uint16_t count;
+    uint16_t view_delay_ms; // playout delay of the remote entities we see
+} InputList;
+
 typedef struct Snapshot
 {
-    uint8_t idx;
-    uint16_t sequence; // newest sequence number recieved
+    uint16_t idx;
+    uint16_t sequence; // newest tick applied
     float time_since_last_update;
     Entity entity;
 } Snapshot;
 
+// SNAPSHOT packets carry a list of entities right after the header,
+// see protocol.h for the wire format
+typedef struct SnapshotList
+{
+    uint16_t tick; // server tick the entity states belong to
+    
+    // newest input of the reciever its own entity had applied at tick
+    bool has_input_ack;
+    uint16_t input_ack;
+    
+    uint16_t count;
+} SnapshotList;
+
+typedef enum EntityUpdateFlags
+{
+    EntityUpdate_HasBaseline = (1 << 0),
+} EntityUpdateFlags;
+
+// Carries the fields in field_mask, see entity_delta.h. Without a
+// baseline the fields are relative to a zeroed Entity.
+typedef struct EntityUpdate
+{
+    uint16_t idx;
+    uint16_t baseline_tick;
+    uint16_t field_mask;
+    uint16_t flags;
+} EntityUpdate;
+
+#define MAX_ENTITY_UPDATES_PER_PACKET 64
+
+// The server sends a client the nearest MAX_VISIBLE_ENTITIES entities
+// in its area of interest. The client has room for twice as many, the
+// ones that just went out of view stay around until it forgets them.
+#define MAX_VISIBLE_ENTITIES 128
+#define MAX_SNAPSHOTS (2 * MAX_VISIBLE_ENTITIES)
+
+// Last ENTITY_HISTORY_SIZE states of an entity keyed by server tick, the
+// baselines for delta compressed snapshots come from here
+#define ENTITY_HISTORY_SIZE 32
+
+typedef struct EntityHistory
+{
+    uint16_t ticks[ENTITY_HISTORY_SIZE];
+    bool valid[ENTITY_HISTORY_SIZE];
+    Entity entities[ENTITY_HISTORY_SIZE];
+} EntityHistory;
+
+// Sampled input of a simulation step and the state of our entity the
+// client predicted after applying it
+#define PREDICTION_BUFFER_SIZE 64
+
+typedef struct PredictedStep
+{
+    uint16_t sequence;
+    PlayerInput input;
+    Entity entity;
+} PredictedStep;
+
 typedef struct GameData
 {
     MemoryArena arena;
     
     int socketfd;
-    bool connected;
+    bool connecting;     // channel is set up and a Connect message queued
+    bool connected;      // the server accepted us
+    bool level_mismatch; // the server runs another level, we quit
+    double reconnect_time;
+    ReliableChannel channel;
+    SocketBatch packets_in;
     
     Nickname nickname;
     Address server_address;
     
-    Snapshot snapshots[128];
+    Snapshot snapshots[MAX_SNAPSHOTS];
+    EntityHistory snapshot_histories[MAX_SNAPSHOTS];
     unsigned int snapshot_count;
     
+    // Remote entities are shown playout_delay behind the server, in
+    // between the states buffered in their histories. The delay follows
+    // how far apart and how unevenly their updates arrive, see
+    // ClientUpdateTickClock and ClientUpdatePlayout.
+    float tick_dt;
+    bool has_tick_clock;
+    uint16_t newest_tick;
+    int64_t newest_tick_unwrapped;
+    double tick_zero_time; // local time server tick zero arrived at
+    float jitter;          // mean deviation from tick_zero_time, in seconds
+    float update_gap;      // ticks between updates of an entity
+    float playout_delay;   // in seconds
+    
     PhysicsSpec physics_spec;
+    Level level;
     
+    // inputs are sampled once per simulation step and applied to player
+    // right away, the newest ones are resent with every packet
+    float sim_accumulator;
+    uint16_t input_sequence; // of the next input
+    unsigned int predicted_count; // up to PREDICTION_BUFFER_SIZE
+    PredictedStep predicted[PREDICTION_BUFFER_SIZE]; // by sequence
+    
+    // newest state of our entity from the server, player gets rewound to
+    // it when the prediction went wrong
+    bool reconcile;
+    uint16_t server_input_ack;
+    Entity server_player;
+    unsigned int correction_count;
+    
+    uint16_t player_idx; // our entity, sent along with Accept
     Entity player;
     Position camera_p;
     
-    Recti obstacles[16];
-    unsigned int obstacle_count;
-    
-    uint16_t frame_idx;
-    float time;
+    double time;
 } GameData;
 
 #endif //NISK_H
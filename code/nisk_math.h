@@ -23,6 +23,15 @@ float Apporach(float a, float b, float x)
     return result;
 }
 
+int FloorDivide(int a, int b)
+{
+    ASSERT(b > 0);
+    int result = a / b;
+    if((a % b) != 0 && a < 0)
+        --result;
+    return result;
+}
+
 typedef union Vec2i
 {
     struct { int x, y; };
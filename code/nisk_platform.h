@@ -75,8 +75,12 @@ typedef bool SocketCreateType(int *sockfd);
 typedef bool SocketCloseType(int sockfd);
 typedef bool SocketSendType(int sockfd, Address *destination, void *data, int size);
 typedef int SocketRecieveType(int sockfd, Address *sender, void *data, int size);
+typedef unsigned int SocketRecieveBatchType(int sockfd, SocketBatch *batch);
+typedef unsigned int SocketSendBatchType(int sockfd, SocketBatch *batch);
 
 typedef unsigned int InetAddrWrapType(char *addr);
+typedef void *MapFileType(char *filename, size_t *size);
+typedef bool StreamLevelType(LevelStream *stream, char *filename);
 
 typedef struct Platform
 {
@@ -91,7 +95,11 @@ typedef struct Platform
     SocketCloseType          *socket_close;
     SocketSendType           *socket_send;
     SocketRecieveType        *socket_recieve;
+    SocketRecieveBatchType   *socket_recieve_batch;
+    SocketSendBatchType      *socket_send_batch;
     InetAddrWrapType         *inet_addr_wrap;
+    MapFileType              *map_file;
+    StreamLevelType          *stream_level;
 } Platform;
 
 typedef struct ServerInfo
@@ -149,5 +157,6 @@ typedef void GameUpdateAndRenderType(GameMemory *memory,
                                      Platform *platform,
                                      Input *input,
                                      bool *running);
+typedef void GameShutdownType(GameMemory *memory, Platform *platform);
 
 #endif //NISK_PLATFORM_H
@@ -0,0 +1,197 @@
+/* date = October 17th 2026 11:20 pm */
+
+#ifndef PACKET_CAPTURE_H
+#define PACKET_CAPTURE_H
+
+// Append-only file of the datagrams a server worker recieved, so the same
+// traffic can be fed through the server again without clients. All values
+// are little endian.
+//
+//   header: magic u32 | version u16 | update_hz u16 | worker_count u16 | worker_idx u16
+//   record: delta_us u32 | address u32 | port u16 | size u16 | data[size]
+//
+// delta_us is the arrival time since the previous record, the first one
+// counts from a tick before the first tick deadline of the server. A
+// record with size 0 only moves the time along, it is written when the
+// gap since the previous datagram doesn't fit in delta_us.
+
+#define PACKET_CAPTURE_MAGIC 0x5041434Eu // "NCAP"
+#define PACKET_CAPTURE_VERSION 1
+#define PACKET_CAPTURE_HEADER_SIZE 12
+#define PACKET_CAPTURE_RECORD_SIZE 12
+
+typedef struct PacketCaptureHeader
+{
+    uint16_t version;
+    uint16_t update_hz;
+    uint16_t worker_count;
+    uint16_t worker_idx;
+} PacketCaptureHeader;
+
+typedef struct PacketCapture
+{
+    FILE *file;
+    int64_t last_ns;
+    uint64_t packet_count;
+} PacketCapture;
+
+typedef struct PacketRecord
+{
+    int64_t time_ns; // since the start of the capture
+    Address address;
+    int size;
+    uint8_t *data;
+} PacketRecord;
+
+// Reads a capture held in memory
+typedef struct PacketReplay
+{
+    PacketCaptureHeader header;
+    uint8_t *data;
+    size_t size;
+    size_t at;
+    int64_t time_ns;
+} PacketReplay;
+
+void PacketCapturePutU16(uint8_t *at, uint16_t value)
+{
+    at[0] = (uint8_t)(value);
+    at[1] = (uint8_t)(value >> 8);
+}
+
+void PacketCapturePutU32(uint8_t *at, uint32_t value)
+{
+    at[0] = (uint8_t)(value);
+    at[1] = (uint8_t)(value >> 8);
+    at[2] = (uint8_t)(value >> 16);
+    at[3] = (uint8_t)(value >> 24);
+}
+
+uint16_t PacketCaptureGetU16(uint8_t *at)
+{
+    uint16_t result = (uint16_t)(at[0] | (at[1] << 8));
+    return result;
+}
+
+uint32_t PacketCaptureGetU32(uint8_t *at)
+{
+    uint32_t result = ((uint32_t)at[0]
+                       | ((uint32_t)at[1] << 8)
+                       | ((uint32_t)at[2] << 16)
+                       | ((uint32_t)at[3] << 24));
+    return result;
+}
+
+// start_ns is the time the first record counts from
+bool PacketCaptureOpen(PacketCapture *capture, char *path, PacketCaptureHeader *header, int64_t start_ns)
+{
+    capture->file = fopen(path, "wb");
+    if(capture->file == 0)
+    {
+        fprintf(stderr, "[ERROR] Open capture file %s\n", path);
+        return false;
+    }
+    capture->last_ns = start_ns;
+    capture->packet_count = 0;
+    
+    uint8_t bytes[PACKET_CAPTURE_HEADER_SIZE];
+    PacketCapturePutU32(bytes, PACKET_CAPTURE_MAGIC);
+    PacketCapturePutU16(bytes + 4, PACKET_CAPTURE_VERSION);
+    PacketCapturePutU16(bytes + 6, header->update_hz);
+    PacketCapturePutU16(bytes + 8, header->worker_count);
+    PacketCapturePutU16(bytes + 10, header->worker_idx);
+    bool result = (fwrite(bytes, sizeof(bytes), 1, capture->file) == 1);
+    return result;
+}
+
+void PacketCaptureWrite(PacketCapture *capture, int64_t now_ns, Address address, uint8_t *data, int size)
+{
+    ASSERT(size >= 0 && size <= PACKET_MAX_SIZE);
+    uint8_t bytes[PACKET_CAPTURE_RECORD_SIZE];
+    
+    // whole microseconds only, the rest carries over to the next record
+    int64_t delta_us = MAX(now_ns - capture->last_ns, 0) / 1000;
+    capture->last_ns += delta_us * 1000;
+    while(delta_us > UINT32_MAX)
+    {
+        MEMORY_SET(bytes, 0, sizeof(bytes));
+        PacketCapturePutU32(bytes, UINT32_MAX);
+        fwrite(bytes, sizeof(bytes), 1, capture->file);
+        delta_us -= UINT32_MAX;
+    }
+    
+    PacketCapturePutU32(bytes, (uint32_t)delta_us);
+    PacketCapturePutU32(bytes + 4, address.address);
+    PacketCapturePutU16(bytes + 8, address.port);
+    PacketCapturePutU16(bytes + 10, (uint16_t)size);
+    fwrite(bytes, sizeof(bytes), 1, capture->file);
+    fwrite(data, (size_t)size, 1, capture->file);
+    ++capture->packet_count;
+}
+
+bool PacketReplayInit(PacketReplay *replay, uint8_t *data, size_t size)
+{
+    if(size < PACKET_CAPTURE_HEADER_SIZE || PacketCaptureGetU32(data) != PACKET_CAPTURE_MAGIC)
+    {
+        fprintf(stderr, "[ERROR] Not a packet capture\n");
+        return false;
+    }
+    
+    replay->header.version = PacketCaptureGetU16(data + 4);
+    replay->header.update_hz = PacketCaptureGetU16(data + 6);
+    replay->header.worker_count = PacketCaptureGetU16(data + 8);
+    replay->header.worker_idx = PacketCaptureGetU16(data + 10);
+    if(replay->header.version != PACKET_CAPTURE_VERSION)
+    {
+        fprintf(stderr, "[ERROR] Packet capture version %u, expected %u\n",
+                replay->header.version, PACKET_CAPTURE_VERSION);
+        return false;
+    }
+    
+    replay->data = data;
+    replay->size = size;
+    replay->at = PACKET_CAPTURE_HEADER_SIZE;
+    replay->time_ns = 0;
+    return true;
+}
+
+// Next datagram, false at the end. A record cut short by a server that
+// got killed while writing it ends the capture.
+bool PacketReplayNext(PacketReplay *replay, PacketRecord *record)
+{
+    while(replay->at + PACKET_CAPTURE_RECORD_SIZE <= replay->size)
+    {
+        uint8_t *bytes = replay->data + replay->at;
+        int size = PacketCaptureGetU16(bytes + 10);
+        if(size > PACKET_MAX_SIZE || replay->at + PACKET_CAPTURE_RECORD_SIZE + (size_t)size > replay->size)
+            break;
+        
+        replay->time_ns += (int64_t)PacketCaptureGetU32(bytes) * 1000;
+        replay->at += PACKET_CAPTURE_RECORD_SIZE + (size_t)size;
+        if(size == 0)
+            continue;
+        
+        record->time_ns = replay->time_ns;
+        record->address.address = PacketCaptureGetU32(bytes + 4);
+        record->address.port = PacketCaptureGetU16(bytes + 8);
+        record->size = size;
+        record->data = bytes + PACKET_CAPTURE_RECORD_SIZE;
+        return true;
+    }
+    return false;
+}
+
+// Arrival time of the last datagram, walks the whole capture
+int64_t PacketReplayDuration(PacketReplay *replay)
+{
+    PacketReplay walk = *replay;
+    walk.at = PACKET_CAPTURE_HEADER_SIZE;
+    walk.time_ns = 0;
+    PacketRecord record;
+    int64_t result = 0;
+    while(PacketReplayNext(&walk, &record))
+        result = record.time_ns;
+    return result;
+}
+
+#endif //PACKET_CAPTURE_H
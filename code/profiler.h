@@ -0,0 +1,251 @@
+/* date = October 17th 2026 11:55 pm */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+// Nested timing zones read from the cycle counter of the CPU. A zone
+// opened while another one is open becomes its child, its time counts
+// towards the total of the parent but not the self time. Every zone keeps
+// a histogram of how long it took in the current window, so a rare 30ms
+// tick shows up in the tail percentiles instead of vanishing into the
+// average. The window is whatever lies between two ProfilerPrint calls.
+//
+// A Profiler is not thread safe, every thread that profiles needs its own.
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h> // __rdtsc()
+#endif
+
+#define PROFILER_MAX_ZONES 32
+#define PROFILER_MAX_DEPTH 16
+
+// Log-linear buckets: values below 8 get one each, after that every power
+// of two is split into 8, so a bucket is at most 1/8 wider than its start
+#define PROFILER_SUB_BUCKET_BITS 3
+#define PROFILER_SUB_BUCKETS (1 << PROFILER_SUB_BUCKET_BITS)
+#define PROFILER_BUCKET_COUNT ((64 - PROFILER_SUB_BUCKET_BITS + 1) * PROFILER_SUB_BUCKETS)
+
+typedef struct ProfileZone
+{
+    int parent; // -1 for a zone opened with nothing else open
+    uint64_t last_cycles;
+    
+    // over the current window
+    uint64_t count;
+    uint64_t total_cycles;
+    uint64_t child_cycles;
+    uint64_t max_cycles;
+    uint32_t histogram[PROFILER_BUCKET_COUNT];
+} ProfileZone;
+
+typedef struct ProfileOpenZone
+{
+    unsigned int zone;
+    uint64_t start;
+    uint64_t child_cycles;
+} ProfileOpenZone;
+
+typedef struct Profiler
+{
+    ProfileZone zones[PROFILER_MAX_ZONES];
+    ProfileOpenZone stack[PROFILER_MAX_DEPTH];
+    unsigned int depth;
+    uint64_t window_start;
+} Profiler;
+
+// set once by ProfilerCalibrate, read by every thread after that
+global double global_profiler_cycles_per_ms;
+
+uint64_t ProfilerReadCounter(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+    uint64_t result = __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t result;
+    __asm__ volatile("mrs %0, cntvct_el0" : "=r"(result));
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    uint64_t result = (uint64_t)now.tv_sec * 1000000000ull + (uint64_t)now.tv_nsec;
+#endif
+    return result;
+}
+
+// How fast the counter runs, measured against the monotonic clock
+void ProfilerCalibrate(void)
+{
+    struct timespec start_time, end_time;
+    struct timespec wait = { 0, 20 * 1000000 };
+    clock_gettime(CLOCK_MONOTONIC, &start_time);
+    uint64_t start = ProfilerReadCounter();
+    nanosleep(&wait, 0);
+    uint64_t end = ProfilerReadCounter();
+    clock_gettime(CLOCK_MONOTONIC, &end_time);
+    
+    double ms = (1000.0 * (double)(end_time.tv_sec - start_time.tv_sec)
+                 + (double)(end_time.tv_nsec - start_time.tv_nsec) / 1000000.0);
+    global_profiler_cycles_per_ms = (double)(end - start) / ms;
+}
+
+void ProfilerInit(Profiler *profiler)
+{
+    MEMORY_SET(profiler, 0, sizeof(Profiler));
+    for(unsigned int zone_idx = 0; zone_idx < PROFILER_MAX_ZONES; ++zone_idx)
+        profiler->zones[zone_idx].parent = -1;
+    profiler->window_start = ProfilerReadCounter();
+}
+
+unsigned int ProfilerBucket(uint64_t cycles)
+{
+    if(cycles < PROFILER_SUB_BUCKETS)
+        return (unsigned int)cycles;
+    
+    unsigned int exponent = 63 - (unsigned int)__builtin_clzll(cycles);
+    unsigned int shift = exponent - PROFILER_SUB_BUCKET_BITS;
+    unsigned int sub_bucket = (unsigned int)(cycles >> shift) & (PROFILER_SUB_BUCKETS - 1);
+    unsigned int result = (shift + 1) * PROFILER_SUB_BUCKETS + sub_bucket;
+    return result;
+}
+
+// Largest value that lands in the bucket
+uint64_t ProfilerBucketTop(unsigned int bucket)
+{
+    if(bucket < PROFILER_SUB_BUCKETS)
+        return bucket;
+    
+    unsigned int shift = bucket / PROFILER_SUB_BUCKETS - 1;
+    uint64_t sub_bucket = bucket % PROFILER_SUB_BUCKETS;
+    uint64_t result = ((PROFILER_SUB_BUCKETS + sub_bucket + 1) << shift) - 1;
+    return result;
+}
+
+void ProfilerBegin(Profiler *profiler, unsigned int zone)
+{
+    ASSERT(zone < PROFILER_MAX_ZONES && profiler->depth < PROFILER_MAX_DEPTH);
+    ProfileOpenZone *open = profiler->stack + profiler->depth++;
+    open->zone = zone;
+    open->child_cycles = 0;
+    open->start = ProfilerReadCounter();
+}
+
+void ProfilerEnd(Profiler *profiler, unsigned int zone)
+{
+    uint64_t end = ProfilerReadCounter();
+    ASSERT(profiler->depth > 0);
+    ProfileOpenZone *open = profiler->stack + --profiler->depth;
+    ASSERT(open->zone == zone);
+    
+    uint64_t cycles = end - open->start;
+    ProfileZone *profile_zone = profiler->zones + zone;
+    profile_zone->last_cycles = cycles;
+    profile_zone->count += 1;
+    profile_zone->total_cycles += cycles;
+    profile_zone->child_cycles += open->child_cycles;
+    profile_zone->max_cycles = MAX(profile_zone->max_cycles, cycles);
+    profile_zone->histogram[ProfilerBucket(cycles)] += 1;
+    
+    if(profiler->depth > 0)
+    {
+        ProfileOpenZone *parent = profiler->stack + profiler->depth - 1;
+        parent->child_cycles += cycles;
+        profile_zone->parent = (int)parent->zone;
+    }
+}
+
+float ProfilerMs(uint64_t cycles)
+{
+    float result = (float)((double)cycles / global_profiler_cycles_per_ms);
+    return result;
+}
+
+// How long the zone took the last time it closed
+float ProfilerLastMs(Profiler *profiler, unsigned int zone)
+{
+    float result = ProfilerMs(profiler->zones[zone].last_cycles);
+    return result;
+}
+
+// Smallest value at least fraction of the samples don't go over, as far
+// as the buckets can tell
+uint64_t ProfileZonePercentile(ProfileZone *zone, double fraction)
+{
+    uint64_t rank = (uint64_t)(fraction * (double)zone->count);
+    rank = CLAMP(1, rank, zone->count);
+    uint64_t seen = 0;
+    for(unsigned int bucket = 0; bucket < PROFILER_BUCKET_COUNT; ++bucket)
+    {
+        seen += zone->histogram[bucket];
+        if(seen >= rank)
+            return MIN(ProfilerBucketTop(bucket), zone->max_cycles);
+    }
+    return zone->max_cycles;
+}
+
+void ProfilerPrintZone(Profiler *profiler, char **zone_names, unsigned int zone_idx,
+                       unsigned int depth, uint64_t window_cycles, FILE *out)
+{
+    ProfileZone *zone = profiler->zones + zone_idx;
+    if(zone->count > 0)
+    {
+        uint64_t self_cycles = zone->total_cycles - zone->child_cycles;
+        fprintf(out, "  %*s%-*s %8lu %7.1f%% %7.1f%% %8.3f %8.3f %8.3f %8.3f %8.3f\n",
+                (int)depth * 2, "", 16 - (int)depth * 2, zone_names[zone_idx],
+                (unsigned long)zone->count,
+                100.0 * (double)zone->total_cycles / (double)window_cycles,
+                100.0 * (double)self_cycles / (double)window_cycles,
+                (double)ProfilerMs(zone->total_cycles / zone->count),
+                (double)ProfilerMs(ProfileZonePercentile(zone, 0.5)),
+                (double)ProfilerMs(ProfileZonePercentile(zone, 0.99)),
+                (double)ProfilerMs(ProfileZonePercentile(zone, 0.999)),
+                (double)ProfilerMs(zone->max_cycles));
+    }
+    
+    for(unsigned int child_idx = 0; child_idx < PROFILER_MAX_ZONES; ++child_idx)
+    {
+        if(profiler->zones[child_idx].parent == (int)zone_idx && child_idx != zone_idx)
+            ProfilerPrintZone(profiler, zone_names, child_idx, depth + 1, window_cycles, out);
+    }
+}
+
+// Prints every zone of the window as a tree, times in milliseconds and
+// percentages of the window, then starts the next window. zone_names has
+// a name for every zone below zone_count.
+void ProfilerPrint(Profiler *profiler, char *title, char **zone_names, unsigned int zone_count)
+{
+    ASSERT(zone_count <= PROFILER_MAX_ZONES);
+    uint64_t now = ProfilerReadCounter();
+    uint64_t window_cycles = MAX(now - profiler->window_start, 1);
+    
+    // one write so the summaries of several threads don't interleave, a
+    // full stream isn't terminated so the last byte is kept for that
+    char buffer[8192];
+    buffer[sizeof(buffer) - 1] = 0;
+    FILE *out = fmemopen(buffer, sizeof(buffer) - 1, "w");
+    if(out)
+    {
+        fprintf(out, "%s, %.1fs window\n", title, (double)ProfilerMs(window_cycles) / 1000.0);
+        fprintf(out, "  %-16s %8s %8s %8s %8s %8s %8s %8s %8s\n",
+                "zone", "count", "total", "self", "avg ms", "p50", "p99", "p99.9", "max");
+        for(unsigned int zone_idx = 0; zone_idx < zone_count; ++zone_idx)
+        {
+            if(profiler->zones[zone_idx].parent < 0)
+                ProfilerPrintZone(profiler, zone_names, zone_idx, 0, window_cycles, out);
+        }
+        fclose(out);
+        fputs(buffer, stdout);
+        fflush(stdout);
+    }
+    
+    for(unsigned int zone_idx = 0; zone_idx < PROFILER_MAX_ZONES; ++zone_idx)
+    {
+        ProfileZone *zone = profiler->zones + zone_idx;
+        zone->count = 0;
+        zone->total_cycles = 0;
+        zone->child_cycles = 0;
+        zone->max_cycles = 0;
+        MEMORY_SET(zone->histogram, 0, sizeof(zone->histogram));
+    }
+    profiler->window_start = now;
+}
+
+#endif //PROFILER_H
@@ -0,0 +1,259 @@
+/* date = October 17th 2026 3:40 pm */
+
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+// Wire format of every message, one Serialize* function per message used
+// by both the writing and the reading side (see bitstream.h). Datagrams
+// start with a PacketHeader:
+//     CONTROL:  PacketHeader | ControlMessages
+//     SNAPSHOT: PacketHeader | ControlMessages | SnapshotList | EntityUpdate[count] (server -> client)
+//     INPUT:    PacketHeader | ControlMessages | InputList | PlayerInput[count]     (client -> server)
+//     REJECT:   PacketHeader | DisconnectReason
+// Every EntityUpdate starts on a byte boundary so the server can encode
+// it once and send the same bytes to everybody (see EntityUpdateCache).
+
+#define PROTOCOL_ID 0x4E53
+
+// Ranges the entity state is quantized to, values outside get clamped
+#define WORLD_UNIT_LIMIT     (1 << 20)
+#define RECT_UNIT_LIMIT      256
+#define REM_RESOLUTION       (1.0f/256.0f)
+#define VELOCITY_LIMIT       32.0f // meters per second
+#define VELOCITY_RESOLUTION  (1.0f/128.0f)
+#define TIMER_MIN            -0.25f
+#define TIMER_MAX            1.0f
+#define TIMER_RESOLUTION     (1.0f/1024.0f)
+
+// enough for MAX_ENTITY_UPDATES_PER_PACKET
+#define SNAPSHOT_LIST_COUNT_BITS 7
+
+bool SerializePacketHeader(BitStream *stream, PacketHeader *header)
+{
+    uint32_t protocol = header->protocol;
+    int32_t type = (int32_t)header->type;
+    SerializeBits(stream, &protocol, 16);
+    SerializeInt(stream, &type, 0, PacketType_COUNT - 1);
+    header->protocol = protocol;
+    header->type = (PacketType)type;
+    
+    SerializeUint16(stream, &header->sequence);
+    SerializeUint16(stream, &header->ack);
+    SerializeUint32(stream, &header->ack_bits);
+    
+    bool result = (!stream->error && header->protocol == PROTOCOL_ID);
+    return result;
+}
+
+bool SerializeNickname(BitStream *stream, Nickname *nickname)
+{
+    int32_t size = (int32_t)nickname->size;
+    int32_t max_size = (int32_t)ARRAY_SIZE(nickname->str) - 1;
+    SerializeInt(stream, &size, 0, max_size);
+    nickname->size = (unsigned int)size;
+    SerializeBytes(stream, (uint8_t *)nickname->str, nickname->size);
+    nickname->str[nickname->size] = 0;
+    return !stream->error;
+}
+
+bool SerializeDisconnectReason(BitStream *stream, DisconnectReason *reason)
+{
+    int32_t value = (int32_t)*reason;
+    SerializeInt(stream, &value, 0, DisconnectReason_COUNT - 1);
+    *reason = (DisconnectReason)value;
+    return !stream->error;
+}
+
+bool SerializeControlMessage(BitStream *stream, ControlMessage *message)
+{
+    SerializeUint16(stream, &message->id);
+    int32_t type = (int32_t)message->type;
+    SerializeInt(stream, &type, 0, ControlMessage_COUNT - 1);
+    message->type = (ControlMessageType)type;
+    
+    switch(message->type)
+    {
+        case ControlMessage_Connect:    SerializeNickname(stream, &message->nickname); break;
+        case ControlMessage_Accept:
+        {
+            SerializeUint16(stream, &message->entity_idx);
+            SerializeUint16(stream, &message->tick_rate);
+            SerializeUint32(stream, &message->level_hash);
+        } break;
+        case ControlMessage_Disconnect: SerializeDisconnectReason(stream, &message->reason); break;
+        default: break;
+    }
+    return !stream->error;
+}
+
+bool SerializeControlMessages(BitStream *stream, ControlMessage *messages, unsigned int *count)
+{
+    int32_t count32 = (int32_t)*count;
+    SerializeInt(stream, &count32, 0, RELIABLE_MESSAGES_PER_PACKET);
+    *count = (unsigned int)count32;
+    for(unsigned int message_idx = 0; message_idx < *count; ++message_idx)
+        SerializeControlMessage(stream, messages + message_idx);
+    return !stream->error;
+}
+
+bool SerializeSnapshotList(BitStream *stream, SnapshotList *list)
+{
+    SerializeUint16(stream, &list->tick);
+    SerializeBool(stream, &list->has_input_ack);
+    if(list->has_input_ack)
+        SerializeUint16(stream, &list->input_ack);
+    else
+        list->input_ack = 0;
+    
+    // count goes last so the writer can patch it in once it is known,
+    // see SnapshotListPatchCount
+    uint32_t count = list->count;
+    SerializeBits(stream, &count, SNAPSHOT_LIST_COUNT_BITS);
+    if(count > MAX_ENTITY_UPDATES_PER_PACKET)
+        stream->error = true;
+    list->count = (uint16_t)count;
+    return !stream->error;
+}
+
+void SnapshotListPatchCount(BitStream *stream, size_t list_end_bit_idx, uint16_t count)
+{
+    ASSERT(count <= MAX_ENTITY_UPDATES_PER_PACKET);
+    BitStreamPatchBits(stream, list_end_bit_idx - SNAPSHOT_LIST_COUNT_BITS,
+                       count, SNAPSHOT_LIST_COUNT_BITS);
+}
+
+// Newest input first
+bool SerializeInputList(BitStream *stream, InputList *list)
+{
+    SerializeUint16(stream, &list->sequence);
+    int32_t count = (int32_t)list->count;
+    SerializeInt(stream, &count, 1, MAX_INPUTS_PER_PACKET);
+    list->count = (uint16_t)count;
+    
+    int32_t view_delay_ms = MIN((int32_t)list->view_delay_ms, MAX_VIEW_DELAY_MS);
+    SerializeInt(stream, &view_delay_ms, 0, MAX_VIEW_DELAY_MS);
+    list->view_delay_ms = (uint16_t)view_delay_ms;
+    return !stream->error;
+}
+
+bool SerializePlayerInput(BitStream *stream, PlayerInput *input)
+{
+    int32_t move_x = input->move_x;
+    uint32_t buttons = input->buttons;
+    SerializeInt(stream, &move_x, -PLAYER_INPUT_MOVE_MAX, PLAYER_INPUT_MOVE_MAX);
+    SerializeBits(stream, &buttons, PLAYER_BUTTON_BITS);
+    input->move_x = (int8_t)move_x;
+    input->buttons = (uint8_t)buttons;
+    return !stream->error;
+}
+
+void SerializePosition(BitStream *stream, Position *position)
+{
+    int32_t unit_x = position->unit.x;
+    int32_t unit_y = position->unit.y;
+    SerializeInt(stream, &unit_x, -WORLD_UNIT_LIMIT, WORLD_UNIT_LIMIT);
+    SerializeInt(stream, &unit_y, -WORLD_UNIT_LIMIT, WORLD_UNIT_LIMIT);
+    position->unit.x = unit_x;
+    position->unit.y = unit_y;
+    
+    // the remainder is kept in [-0.5, 0.5] by rounding, see PositionOffset
+    SerializeFloatQuantized(stream, &position->rem.x, -0.5f, 0.5f, REM_RESOLUTION);
+    SerializeFloatQuantized(stream, &position->rem.y, -0.5f, 0.5f, REM_RESOLUTION);
+}
+
+void SerializeRecti(BitStream *stream, Recti *recti)
+{
+    int32_t coords[4] = { recti->x0, recti->y0, recti->x1, recti->y1 };
+    for(unsigned int coord_idx = 0; coord_idx < ARRAY_SIZE(coords); ++coord_idx)
+        SerializeInt(stream, coords + coord_idx, -RECT_UNIT_LIMIT, RECT_UNIT_LIMIT);
+    recti->x0 = coords[0];
+    recti->y0 = coords[1];
+    recti->x1 = coords[2];
+    recti->y1 = coords[3];
+}
+
+void SerializeDirection(BitStream *stream, int *direction)
+{
+    int32_t value = *direction;
+    SerializeInt(stream, &value, -1, 1);
+    *direction = value;
+}
+
+void SerializeTimer(BitStream *stream, float *timer)
+{
+    SerializeFloatQuantized(stream, timer, TIMER_MIN, TIMER_MAX, TIMER_RESOLUTION);
+}
+
+void SerializeEntityField(BitStream *stream, EntityFieldIndex field_idx, Entity *entity)
+{
+    switch(field_idx)
+    {
+        case EntityField_P:                SerializePosition(stream, &entity->p); break;
+        case EntityField_Hitbox:           SerializeRecti(stream, &entity->hitbox); break;
+        case EntityField_TextureRect:      SerializeRecti(stream, &entity->texture_rect); break;
+        case EntityField_JumpTimer:        SerializeTimer(stream, &entity->jump_timer); break;
+        case EntityField_Direction:        SerializeDirection(stream, &entity->direction); break;
+        case EntityField_SpellP:           SerializePosition(stream, &entity->spell_p); break;
+        case EntityField_SpellHitbox:      SerializeRecti(stream, &entity->spell_hitbox); break;
+        case EntityField_SpellTextureRect: SerializeRecti(stream, &entity->spell_texture_rect); break;
+        case EntityField_SpellTimer:       SerializeTimer(stream, &entity->spell_timer); break;
+        case EntityField_SpellDirection:   SerializeDirection(stream, &entity->spell_direction); break;
+        
+        case EntityField_V:
+        {
+            SerializeFloatQuantized(stream, &entity->v.x, -VELOCITY_LIMIT, VELOCITY_LIMIT, VELOCITY_RESOLUTION);
+            SerializeFloatQuantized(stream, &entity->v.y, -VELOCITY_LIMIT, VELOCITY_LIMIT, VELOCITY_RESOLUTION);
+        } break;
+        
+        default: INVALID_CODE_PATH; break;
+    }
+}
+
+// Only the fields in field_mask, the rest of entity is left untouched
+void SerializeEntityFields(BitStream *stream, uint16_t field_mask, Entity *entity)
+{
+    for(unsigned int field_idx = 0; field_idx < EntityField_COUNT; ++field_idx)
+    {
+        if(field_mask & (1u << field_idx))
+            SerializeEntityField(stream, (EntityFieldIndex)field_idx, entity);
+    }
+}
+
+bool SerializeEntity(BitStream *stream, Entity *entity)
+{
+    SerializeEntityFields(stream, ENTITY_FIELD_MASK_ALL, entity);
+    return !stream->error;
+}
+
+// The baseline is sent as its age relative to the tick of the list, which
+// BaselineIsUsable keeps below ENTITY_HISTORY_SIZE. When reading, fields
+// only gets the fields in update->field_mask, EntityDeltaApply puts them
+// on top of the baseline.
+bool SerializeEntityUpdate(BitStream *stream, uint16_t tick, EntityUpdate *update, Entity *fields)
+{
+    SerializeAlign(stream);
+    SerializeUint16(stream, &update->idx);
+    
+    bool has_baseline = (update->flags & EntityUpdate_HasBaseline) != 0;
+    SerializeBool(stream, &has_baseline);
+    update->flags = (has_baseline ? EntityUpdate_HasBaseline : 0);
+    if(has_baseline)
+    {
+        int32_t age = (int32_t)(uint16_t)(tick - update->baseline_tick);
+        SerializeInt(stream, &age, 1, ENTITY_HISTORY_SIZE - 1);
+        update->baseline_tick = (uint16_t)(tick - age);
+    }
+    else
+    {
+        update->baseline_tick = 0;
+    }
+    
+    uint32_t field_mask = update->field_mask;
+    SerializeBits(stream, &field_mask, EntityField_COUNT);
+    update->field_mask = (uint16_t)field_mask;
+    
+    SerializeEntityFields(stream, update->field_mask, fields);
+    return !stream->error;
+}
+
+#endif //PROTOCOL_H
@@ -0,0 +1,179 @@
+/* date = October 17th 2026 5:15 pm */
+
+#ifndef RELIABLE_CHANNEL_H
+#define RELIABLE_CHANNEL_H
+
+// Reliable, ordered ControlMessages on top of the unreliable datagrams
+// both ends already exchange. Every datagram gets a sequence number and
+// acknowledges the ones recieved from the other side (PacketHeader). A
+// message stays queued and is put in the next datagram again whenever it
+// goes unacknowledged for longer than the resend time, which follows the
+// round trip time measured from those acks. Messages only cost space in
+// datagrams that are sent anyway, a SNAPSHOT carries them in front of the
+// entity states.
+
+#define RELIABLE_INITIAL_RTT 0.1f
+#define RELIABLE_MIN_RESEND_TIME 0.1f
+
+void ReliableChannelInit(ReliableChannel *channel)
+{
+    MEMORY_SET(channel, 0, sizeof(ReliableChannel));
+    // nothing recieved yet, make sure we don't acknowledge sequence 0
+    channel->remote_sequence = 0xFFFF;
+    channel->rtt = RELIABLE_INITIAL_RTT;
+}
+
+// Queues a message, its id gets assigned here
+bool ReliableChannelSend(ReliableChannel *channel, ControlMessage *message)
+{
+    uint16_t in_flight = (uint16_t)(channel->next_send_id - channel->oldest_unacked_id);
+    if(in_flight >= RELIABLE_QUEUE_SIZE)
+    {
+        fprintf(stderr, "[ERROR] Reliable send queue is full\n");
+        return false;
+    }
+    
+    ReliableSendEntry *entry = channel->send_queue + (channel->next_send_id % RELIABLE_QUEUE_SIZE);
+    entry->queued = true;
+    entry->last_send_time = -1.0;
+    entry->message = *message;
+    entry->message.id = channel->next_send_id++;
+    return true;
+}
+
+float ReliableChannelResendTime(ReliableChannel *channel)
+{
+    float result = MAX(RELIABLE_MIN_RESEND_TIME, 2.0f * channel->rtt);
+    return result;
+}
+
+bool ReliableChannelMessageIsDue(ReliableChannel *channel, ReliableSendEntry *entry, double time)
+{
+    bool result = (entry->queued
+                   && (entry->last_send_time < 0.0
+                       || time - entry->last_send_time >= (double)ReliableChannelResendTime(channel)));
+    return result;
+}
+
+unsigned int ReliableChannelDueCount(ReliableChannel *channel, double time)
+{
+    unsigned int result = 0;
+    for(uint16_t id = channel->oldest_unacked_id; id != channel->next_send_id; ++id)
+    {
+        ReliableSendEntry *entry = channel->send_queue + (id % RELIABLE_QUEUE_SIZE);
+        if(ReliableChannelMessageIsDue(channel, entry, time))
+            ++result;
+    }
+    return result;
+}
+
+// Writes the PacketHeader of the next datagram followed by the messages
+// that are due, returns how many of them went in
+unsigned int ReliableChannelWritePacket(ReliableChannel *channel, BitStream *stream,
+                                        PacketType type, double time)
+{
+    uint16_t sequence = channel->next_sequence++;
+    PacketHeader header = { PROTOCOL_ID, type, sequence,
+        channel->remote_sequence, channel->remote_ack_bits };
+    SerializePacketHeader(stream, &header);
+    
+    // a datagram still waiting for its ack RELIABLE_SENT_PACKET_COUNT
+    // datagrams later counts as lost
+    ReliableSentPacket *sent_packet = channel->sent_packets + (sequence % RELIABLE_SENT_PACKET_COUNT);
+    float lost = (sent_packet->valid ? 1.0f : 0.0f);
+    channel->packet_loss += 0.05f * (lost - channel->packet_loss);
+    sent_packet->valid = true;
+    sent_packet->sequence = sequence;
+    sent_packet->send_time = time;
+    sent_packet->message_count = 0;
+    
+    ControlMessage messages[RELIABLE_MESSAGES_PER_PACKET];
+    unsigned int message_count = 0;
+    for(uint16_t id = channel->oldest_unacked_id;
+        id != channel->next_send_id && message_count < RELIABLE_MESSAGES_PER_PACKET;
+        ++id)
+    {
+        ReliableSendEntry *entry = channel->send_queue + (id % RELIABLE_QUEUE_SIZE);
+        if(!ReliableChannelMessageIsDue(channel, entry, time))
+            continue;
+        
+        entry->last_send_time = time;
+        messages[message_count++] = entry->message;
+        sent_packet->message_ids[sent_packet->message_count++] = id;
+    }
+    
+    SerializeControlMessages(stream, messages, &message_count);
+    return message_count;
+}
+
+// Takes in the acks and the messages of a datagram from the other side
+void ReliableChannelProcessPacket(ReliableChannel *channel, PacketHeader *header,
+                                  ControlMessage *messages, unsigned int message_count,
+                                  double time)
+{
+    for(unsigned int bit_idx = 0; bit_idx <= 32; ++bit_idx)
+    {
+        if(bit_idx > 0 && !(header->ack_bits & (1u << (bit_idx - 1))))
+            continue;
+        
+        uint16_t sequence = (uint16_t)(header->ack - bit_idx);
+        ReliableSentPacket *sent_packet = channel->sent_packets + (sequence % RELIABLE_SENT_PACKET_COUNT);
+        if(!sent_packet->valid || sent_packet->sequence != sequence)
+            continue;
+        
+        sent_packet->valid = false;
+        float rtt_sample = (float)(time - sent_packet->send_time);
+        channel->rtt += 0.1f * (rtt_sample - channel->rtt);
+        
+        for(unsigned int idx = 0; idx < sent_packet->message_count; ++idx)
+        {
+            uint16_t id = sent_packet->message_ids[idx];
+            ReliableSendEntry *entry = channel->send_queue + (id % RELIABLE_QUEUE_SIZE);
+            if(entry->queued && entry->message.id == id)
+                entry->queued = false;
+        }
+    }
+    
+    while(channel->oldest_unacked_id != channel->next_send_id
+          && !channel->send_queue[channel->oldest_unacked_id % RELIABLE_QUEUE_SIZE].queued)
+        ++channel->oldest_unacked_id;
+    
+    for(unsigned int message_idx = 0; message_idx < message_count; ++message_idx)
+    {
+        ControlMessage *message = messages + message_idx;
+        
+        // already handed out, or too far ahead to hold on to
+        uint16_t offset = (uint16_t)(message->id - channel->next_recieve_id);
+        if(offset >= RELIABLE_QUEUE_SIZE)
+            continue;
+        
+        ReliableRecieveEntry *entry = channel->recieve_queue + (message->id % RELIABLE_QUEUE_SIZE);
+        if(!entry->recieved)
+        {
+            entry->recieved = true;
+            entry->message = *message;
+        }
+    }
+}
+
+// Marks a datagram as recieved, the next one we send acknowledges it
+void ReliableChannelAckPacket(ReliableChannel *channel, uint16_t sequence)
+{
+    AckRecieved(&channel->remote_sequence, &channel->remote_ack_bits, sequence);
+    ++channel->recieved_count;
+}
+
+// Hands out recieved messages in the order they were sent
+bool ReliableChannelNextMessage(ReliableChannel *channel, ControlMessage *message)
+{
+    ReliableRecieveEntry *entry = channel->recieve_queue + (channel->next_recieve_id % RELIABLE_QUEUE_SIZE);
+    if(!entry->recieved || entry->message.id != channel->next_recieve_id)
+        return false;
+    
+    *message = entry->message;
+    entry->recieved = false;
+    ++channel->next_recieve_id;
+    return true;
+}
+
+#endif //RELIABLE_CHANNEL_H
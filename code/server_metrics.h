@@ -0,0 +1,120 @@
+/* date = October 18th 2026 0:30 am */
+
+#ifndef SERVER_METRICS_H
+#define SERVER_METRICS_H
+
+// Live counters of a running server in a file mapped by the server and
+// any number of readers, normally somewhere under /dev/shm. Every worker
+// rewrites its own block once per tick with plain stores, no syscalls and
+// no locks. A block is guarded by a sequence number like a seqlock: the
+// worker makes it odd before writing and even again after, a reader that
+// saw the same even number before and after its copy got a consistent
+// block, otherwise it tries again.
+//
+//   ServerMetricsHeader | worker_count * worker_stride bytes, each a
+//   WorkerMetrics followed by worker_capacity MetricsClients
+
+#define SERVER_METRICS_MAGIC 0x4D53494Eu // "NISM"
+#define SERVER_METRICS_VERSION 1
+#define SERVER_METRICS_MAX_ZONES 16
+#define SERVER_METRICS_ZONE_NAME_SIZE 16
+
+typedef struct ServerMetricsHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t worker_count;
+    uint32_t worker_capacity;
+    uint32_t worker_stride; // in bytes
+    uint32_t update_hz;
+    uint32_t zone_count;
+    char zone_names[SERVER_METRICS_MAX_ZONES][SERVER_METRICS_ZONE_NAME_SIZE];
+} ServerMetricsHeader;
+
+typedef struct MetricsClient
+{
+    Address address;
+    uint16_t entity_idx;
+    char nickname[32];
+    float rtt;      // in seconds
+    float loss_in;  // share of its last 32 datagrams we didn't get
+    float loss_out; // share of ours it didn't acknowledge, smoothed
+} MetricsClient;
+
+// Counters only go up, rates are what a reader sees them grow by
+typedef struct PacketCounters
+{
+    uint64_t packets[PacketType_COUNT];
+    uint64_t bytes[PacketType_COUNT];
+} PacketCounters;
+
+typedef struct WorkerMetrics
+{
+    uint32_t sequence; // odd while the worker writes
+    uint32_t tick;
+    float tick_ms;
+    float zone_ms[SERVER_METRICS_MAX_ZONES]; // of the last tick
+    PacketCounters in;
+    PacketCounters out;
+    uint32_t client_count;
+    MetricsClient clients[]; // worker_capacity of them
+} WorkerMetrics;
+
+void PacketCountersAdd(PacketCounters *counters, PacketType type, size_t size)
+{
+    ASSERT(type < PacketType_COUNT);
+    counters->packets[type] += 1;
+    counters->bytes[type] += size;
+}
+
+size_t ServerMetricsWorkerStride(unsigned int worker_capacity)
+{
+    // blocks of different workers don't share a cache line
+    size_t size = sizeof(WorkerMetrics) + worker_capacity * sizeof(MetricsClient);
+    size_t result = (size + 63) & ~(size_t)63;
+    return result;
+}
+
+size_t ServerMetricsSize(unsigned int worker_count, unsigned int worker_capacity)
+{
+    size_t header_size = (sizeof(ServerMetricsHeader) + 63) & ~(size_t)63;
+    size_t result = header_size + worker_count * ServerMetricsWorkerStride(worker_capacity);
+    return result;
+}
+
+WorkerMetrics *ServerMetricsWorker(ServerMetricsHeader *header, unsigned int worker_idx)
+{
+    size_t header_size = (sizeof(ServerMetricsHeader) + 63) & ~(size_t)63;
+    uint8_t *base = (uint8_t *)header + header_size;
+    WorkerMetrics *result = (WorkerMetrics *)(base + worker_idx * header->worker_stride);
+    return result;
+}
+
+void WorkerMetricsWriteBegin(WorkerMetrics *metrics)
+{
+    uint32_t sequence = __atomic_load_n(&metrics->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&metrics->sequence, sequence + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+void WorkerMetricsWriteEnd(WorkerMetrics *metrics)
+{
+    uint32_t sequence = __atomic_load_n(&metrics->sequence, __ATOMIC_RELAXED);
+    __atomic_store_n(&metrics->sequence, sequence + 1, __ATOMIC_RELEASE);
+}
+
+// Copies size bytes of the block, false if the worker wrote to it
+// meanwhile and the copy can't be trusted
+bool WorkerMetricsRead(WorkerMetrics *metrics, void *result, size_t size)
+{
+    uint32_t sequence = __atomic_load_n(&metrics->sequence, __ATOMIC_ACQUIRE);
+    if(sequence & 1)
+        return false;
+    
+    MEMORY_COPY(result, metrics, size);
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    bool unchanged = (__atomic_load_n(&metrics->sequence, __ATOMIC_RELAXED) == sequence);
+    return unchanged;
+}
+
+#endif //SERVER_METRICS_H
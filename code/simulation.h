@@ -0,0 +1,393 @@
+/* date = October 17th 2026 9:25 pm */
+
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+// Player movement shared by the client and the server. The server owns
+// the entities of its players and steps them from the inputs the clients
+// send, SIM_STEP_HZ times a second on both ends.
+//
+// Players are kept as structure-of-arrays, one column per field, so a
+// step runs a handful of passes over plain arrays (ground check, velocity,
+// jump, spell) the compiler can vectorize. Only the obstacle queries are
+// done player by player. They go through the grid of the Level, and a
+// move along an axis is swept in one query rather than walked unit by unit.
+
+#define SIM_STEP_HZ 60
+#define SIM_STEP_DT (1.0f / SIM_STEP_HZ)
+
+Position PositionOffset(Position position,
+                        int offset_unit_x, int offset_unit_y,
+                        float offset_rem_x, float offset_rem_y)
+{
+    Position result;
+    float rem_x = position.rem.x + offset_rem_x;
+    float rem_y = position.rem.y + offset_rem_y;
+    result.unit.x = position.unit.x + offset_unit_x + (int)ROUNDF(rem_x);
+    result.unit.y = position.unit.y + offset_unit_y + (int)ROUNDF(rem_y);
+    result.rem.x = position.rem.x + offset_rem_x - ROUNDF(rem_x);
+    result.rem.y = position.rem.y + offset_rem_y - ROUNDF(rem_y);
+    return result;
+}
+
+Recti RectiMove(Recti recti, int move_x, int move_y)
+{
+    Recti result;
+    result.x0 = recti.x0 + move_x;
+    result.y0 = recti.y0 + move_y;
+    result.x1 = recti.x1 + move_x;
+    result.y1 = recti.y1 + move_y;
+    return result;
+}
+
+Recti RectiAbs(int pos_x, int pos_y, int width, int height)
+{
+    Recti result = {{ pos_x, pos_y, pos_x + width, pos_y + height }};
+    return result;
+}
+
+PhysicsSpec PhysicsSpecDefault()
+{
+    PhysicsSpec result;
+    result.meters_to_units = 8;
+    
+    result.run_speed = 12;
+    result.run_accel = 128;
+    
+    result.fall_speed = 16;
+    result.fall_accel = 96;
+    result.air_inertia = 0.3f;
+    
+    result.jump_speed = 16;
+    result.jump_time = 0.5f;
+    result.jump_gravity_mult = 0.5f;
+    
+    result.spell_speed = 20;
+    result.spell_time  = 0.4f;
+    return result;
+}
+
+Entity PlayerSpawn(void)
+{
+    Entity result = {0};
+    result.p.unit = Vec2iGet(0, 30);
+    
+    int player_w = 8;
+    int player_h = 8;
+    result.direction = 1;
+    result.hitbox =             RectiAbs(-player_w/2, 0, player_w, player_h - 1);
+    result.texture_rect =       RectiAbs(-player_w/2, 0, player_w, player_h);
+    result.spell_hitbox =       RectiAbs(-player_w/2, 0, player_w, player_h);
+    result.spell_texture_rect = RectiAbs(-player_w/2, 0, player_w, player_h);
+    return result;
+}
+
+// One column per changing field of Entity, indexed the same way. The
+// rects are the same for every player and stay out of the columns.
+typedef struct SimPlayers
+{
+    unsigned int count;
+    unsigned int capacity;
+    Recti hitbox;
+    Recti spell_hitbox;
+    
+    int *unit_x;
+    int *unit_y;
+    float *rem_x;
+    float *rem_y;
+    float *v_x;
+    float *v_y;
+    float *jump_timer;
+    int *direction;
+    
+    int *spell_unit_x;
+    int *spell_unit_y;
+    float *spell_rem_x;
+    float *spell_rem_y;
+    float *spell_timer;
+    int *spell_direction;
+    
+    // input of the step, see SimPlayersSetInput
+    float *move_x;
+    uint32_t *buttons;
+    
+    int *on_ground; // scratch
+} SimPlayers;
+
+// every column holds 4 byte values
+#define SIM_PLAYER_COLUMN_COUNT 17
+#define SIM_PLAYER_SIZE (SIM_PLAYER_COLUMN_COUNT * 4)
+
+size_t SimPlayersMemorySize(unsigned int capacity)
+{
+    size_t result = (size_t)capacity * SIM_PLAYER_SIZE;
+    return result;
+}
+
+void SimPlayersInit(SimPlayers *players, MemoryArena *arena, unsigned int capacity)
+{
+    MEMORY_SET(players, 0, sizeof(SimPlayers));
+    players->capacity = capacity;
+    players->hitbox = PlayerSpawn().hitbox;
+    players->spell_hitbox = PlayerSpawn().spell_hitbox;
+    
+    players->unit_x =          PUSH_ARRAY(arena, int, capacity);
+    players->unit_y =          PUSH_ARRAY(arena, int, capacity);
+    players->rem_x =           PUSH_ARRAY(arena, float, capacity);
+    players->rem_y =           PUSH_ARRAY(arena, float, capacity);
+    players->v_x =             PUSH_ARRAY(arena, float, capacity);
+    players->v_y =             PUSH_ARRAY(arena, float, capacity);
+    players->jump_timer =      PUSH_ARRAY(arena, float, capacity);
+    players->direction =       PUSH_ARRAY(arena, int, capacity);
+    players->spell_unit_x =    PUSH_ARRAY(arena, int, capacity);
+    players->spell_unit_y =    PUSH_ARRAY(arena, int, capacity);
+    players->spell_rem_x =     PUSH_ARRAY(arena, float, capacity);
+    players->spell_rem_y =     PUSH_ARRAY(arena, float, capacity);
+    players->spell_timer =     PUSH_ARRAY(arena, float, capacity);
+    players->spell_direction = PUSH_ARRAY(arena, int, capacity);
+    players->move_x =          PUSH_ARRAY(arena, float, capacity);
+    players->buttons =         PUSH_ARRAY(arena, uint32_t, capacity);
+    players->on_ground =       PUSH_ARRAY(arena, int, capacity);
+}
+
+void SimPlayersSet(SimPlayers *players, unsigned int idx, Entity *entity)
+{
+    ASSERT(idx < players->count);
+    players->unit_x[idx] =          entity->p.unit.x;
+    players->unit_y[idx] =          entity->p.unit.y;
+    players->rem_x[idx] =           entity->p.rem.x;
+    players->rem_y[idx] =           entity->p.rem.y;
+    players->v_x[idx] =             entity->v.x;
+    players->v_y[idx] =             entity->v.y;
+    players->jump_timer[idx] =      entity->jump_timer;
+    players->direction[idx] =       entity->direction;
+    players->spell_unit_x[idx] =    entity->spell_p.unit.x;
+    players->spell_unit_y[idx] =    entity->spell_p.unit.y;
+    players->spell_rem_x[idx] =     entity->spell_p.rem.x;
+    players->spell_rem_y[idx] =     entity->spell_p.rem.y;
+    players->spell_timer[idx] =     entity->spell_timer;
+    players->spell_direction[idx] = entity->spell_direction;
+    players->move_x[idx] = 0.0f;
+    players->buttons[idx] = 0;
+}
+
+// Only writes the fields that have a column, the rects of entity stay
+void SimPlayersGet(SimPlayers *players, unsigned int idx, Entity *entity)
+{
+    ASSERT(idx < players->count);
+    entity->p.unit.x =        players->unit_x[idx];
+    entity->p.unit.y =        players->unit_y[idx];
+    entity->p.rem.x =         players->rem_x[idx];
+    entity->p.rem.y =         players->rem_y[idx];
+    entity->v.x =             players->v_x[idx];
+    entity->v.y =             players->v_y[idx];
+    entity->jump_timer =      players->jump_timer[idx];
+    entity->direction =       players->direction[idx];
+    entity->spell_p.unit.x =  players->spell_unit_x[idx];
+    entity->spell_p.unit.y =  players->spell_unit_y[idx];
+    entity->spell_p.rem.x =   players->spell_rem_x[idx];
+    entity->spell_p.rem.y =   players->spell_rem_y[idx];
+    entity->spell_timer =     players->spell_timer[idx];
+    entity->spell_direction = players->spell_direction[idx];
+}
+
+Vec2i SimPlayersP(SimPlayers *players, unsigned int idx)
+{
+    Vec2i result = Vec2iGet(players->unit_x[idx], players->unit_y[idx]);
+    return result;
+}
+
+// Appends a player, returns its index
+unsigned int SimPlayersAdd(SimPlayers *players, Entity *entity)
+{
+    ASSERT(players->count < players->capacity);
+    unsigned int result = players->count++;
+    SimPlayersSet(players, result, entity);
+    return result;
+}
+
+// Moves the last player into idx, the same swap ClientTableRemove does
+// with its active list
+void SimPlayersRemove(SimPlayers *players, unsigned int idx)
+{
+    ASSERT(idx < players->count);
+    unsigned int last_idx = --players->count;
+    if(idx == last_idx)
+        return;
+    
+    players->unit_x[idx] =          players->unit_x[last_idx];
+    players->unit_y[idx] =          players->unit_y[last_idx];
+    players->rem_x[idx] =           players->rem_x[last_idx];
+    players->rem_y[idx] =           players->rem_y[last_idx];
+    players->v_x[idx] =             players->v_x[last_idx];
+    players->v_y[idx] =             players->v_y[last_idx];
+    players->jump_timer[idx] =      players->jump_timer[last_idx];
+    players->direction[idx] =       players->direction[last_idx];
+    players->spell_unit_x[idx] =    players->spell_unit_x[last_idx];
+    players->spell_unit_y[idx] =    players->spell_unit_y[last_idx];
+    players->spell_rem_x[idx] =     players->spell_rem_x[last_idx];
+    players->spell_rem_y[idx] =     players->spell_rem_y[last_idx];
+    players->spell_timer[idx] =     players->spell_timer[last_idx];
+    players->spell_direction[idx] = players->spell_direction[last_idx];
+    players->move_x[idx] =          players->move_x[last_idx];
+    players->buttons[idx] =         players->buttons[last_idx];
+}
+
+void SimPlayersSetInput(SimPlayers *players, unsigned int idx, PlayerInput *input)
+{
+    ASSERT(idx < players->count);
+    int move_x = CLAMP(-PLAYER_INPUT_MOVE_MAX, (int)input->move_x, PLAYER_INPUT_MOVE_MAX);
+    players->move_x[idx] = (float)move_x / (float)PLAYER_INPUT_MOVE_MAX;
+    players->buttons[idx] = input->buttons;
+}
+
+void SimPlayersStep(SimPlayers *players, Level *level, PhysicsSpec *spec, float dt)
+{
+    unsigned int count = players->count;
+    Recti hitbox = players->hitbox;
+    float units_per_meter = (float)spec->meters_to_units;
+    
+    int *unit_x = players->unit_x;
+    int *unit_y = players->unit_y;
+    float *rem_x = players->rem_x;
+    float *rem_y = players->rem_y;
+    float *v_x = players->v_x;
+    float *v_y = players->v_y;
+    float *jump_timer = players->jump_timer;
+    int *direction = players->direction;
+    float *move_x = players->move_x;
+    uint32_t *buttons = players->buttons;
+    int *on_ground = players->on_ground;
+    
+    for(unsigned int idx = 0; idx < count; ++idx)
+    {
+        if(move_x[idx] != 0)
+            direction[idx] = SIGN(move_x[idx]);
+    }
+    
+    for(unsigned int idx = 0; idx < count; ++idx)
+        on_ground[idx] = LevelCheckOverlap(level, RectiMove(hitbox, unit_x[idx], unit_y[idx] - 1));
+    
+    // Strafe
+    for(unsigned int idx = 0; idx < count; ++idx)
+    {
+        float mult = (on_ground[idx] ? 1 : spec->air_inertia);
+        v_x[idx] = Apporach(v_x[idx],
+                            move_x[idx] * spec->run_speed,
+                            mult * spec->run_accel * dt);
+    }
+    
+    // Jump and fall
+    for(unsigned int idx = 0; idx < count; ++idx)
+    {
+        bool jump_key_down = (buttons[idx] & PlayerButton_Jump) != 0;
+        if(on_ground[idx])
+        {
+            if(jump_key_down)
+            {
+                jump_timer[idx] = spec->jump_time;
+                v_y[idx] = spec->jump_speed;
+            }
+        }
+        else
+        {
+            if(jump_timer[idx] > 0)
+                jump_timer[idx] = (jump_key_down ? jump_timer[idx] - dt : 0);
+            
+            float mult = (jump_timer[idx] > 0 ? spec->jump_gravity_mult : 1);
+            v_y[idx] = Apporach(v_y[idx],
+                                -spec->fall_speed,
+                                mult * spec->fall_accel * dt);
+        }
+    }
+    
+    for(unsigned int idx = 0; idx < count; ++idx)
+    {
+        rem_x[idx] += v_x[idx] * units_per_meter * dt;
+        rem_y[idx] += v_y[idx] * units_per_meter * dt;
+    }
+    
+    // MOVE X, then Y
+    for(unsigned int idx = 0; idx < count; ++idx)
+    {
+        int move = (int)ROUNDF(rem_x[idx]);
+        if(move != 0)
+        {
+            rem_x[idx] -= (float)move;
+            int moved = LevelSweepAxis(level, RectiMove(hitbox, unit_x[idx], unit_y[idx]), move, 0);
+            unit_x[idx] += moved;
+            if(moved != move)
+                v_x[idx] = 0;
+        }
+        
+        move = (int)ROUNDF(rem_y[idx]);
+        if(move != 0)
+        {
+            rem_y[idx] -= (float)move;
+            int moved = LevelSweepAxis(level, RectiMove(hitbox, unit_x[idx], unit_y[idx]), move, 1);
+            unit_y[idx] += moved;
+            if(moved != move)
+            {
+                v_y[idx] = 0;
+                if(jump_timer[idx] > 0)
+                    jump_timer[idx] = 0;
+            }
+        }
+    }
+    
+    int *spell_unit_x = players->spell_unit_x;
+    int *spell_unit_y = players->spell_unit_y;
+    float *spell_rem_x = players->spell_rem_x;
+    float *spell_rem_y = players->spell_rem_y;
+    float *spell_timer = players->spell_timer;
+    int *spell_direction = players->spell_direction;
+    Recti spell_hitbox = players->spell_hitbox;
+    for(unsigned int idx = 0; idx < count; ++idx)
+    {
+        if(spell_timer[idx] > 0)
+        {
+            float spell_velocity = ((float)spell_direction[idx]
+                                    * spec->spell_speed
+                                    * units_per_meter);
+            float rem = spell_rem_x[idx] + spell_velocity * dt;
+            int unit_move = (int)ROUNDF(rem);
+            Recti spell_rect = RectiMove(spell_hitbox, spell_unit_x[idx], spell_unit_y[idx]);
+            int moved = LevelSweepAxis(level, spell_rect, unit_move, 0);
+            spell_unit_x[idx] += moved;
+            spell_rem_x[idx] = rem - (float)unit_move;
+            spell_timer[idx] -= dt;
+            
+            // a spell that runs into an obstacle ends there
+            if(moved != unit_move)
+                spell_timer[idx] = 0;
+        }
+        else if(buttons[idx] & PlayerButton_Spell)
+        {
+            spell_timer[idx] = spec->spell_time;
+            spell_direction[idx] = direction[idx];
+            spell_unit_x[idx] = unit_x[idx];
+            spell_unit_y[idx] = unit_y[idx];
+            spell_rem_x[idx] = rem_x[idx];
+            spell_rem_y[idx] = rem_y[idx];
+        }
+    }
+}
+
+// Steps a single entity through the same code the server runs
+void PlayerUpdate(Level *level, Entity *player, PlayerInput *input, PhysicsSpec *spec, float dt)
+{
+    uint32_t memory[SIM_PLAYER_COLUMN_COUNT];
+    MemoryArena arena;
+    InitializeArena(&arena, (uint8_t *)memory, sizeof(memory));
+    
+    SimPlayers players;
+    SimPlayersInit(&players, &arena, 1);
+    players.hitbox = player->hitbox;
+    players.spell_hitbox = player->spell_hitbox;
+    SimPlayersAdd(&players, player);
+    SimPlayersSetInput(&players, 0, input);
+    SimPlayersStep(&players, level, spec, dt);
+    SimPlayersGet(&players, 0, player);
+}
+
+#endif //SIMULATION_H
@@ -0,0 +1,140 @@
+/* date = October 17th 2026 8:40 pm */
+
+#ifndef UPDATE_CACHE_H
+#define UPDATE_CACHE_H
+
+// Wire bytes of the entity updates a worker sends during a tick. An
+// update only depends on the entity, the tick and the baseline it is
+// relative to, and most clients share the baseline of an entity, so each
+// one is encoded the first time a packet asks for it and every other
+// packet sends the same bytes through a SocketSpan. Encodings live in an
+// arena that gets reset once nothing that points into it is in flight.
+
+#define UPDATE_CACHE_WAYS 4 // baselines cached per entity and tick
+#define UPDATE_CACHE_BYTES (4 * 1024 * 1024)
+#define UPDATE_CACHE_SPANS (256 * 1024)
+
+// upper bound of one update, every field included and byte aligned
+#define MAX_ENTITY_UPDATE_SIZE 64
+
+typedef struct UpdateEncoding
+{
+    uint32_t generation; // stale when behind the one of the cache
+    uint16_t baseline_tick;
+    bool has_baseline;
+    SocketSpan span;
+} UpdateEncoding;
+
+typedef struct EntityUpdateCache
+{
+    uint32_t generation;
+    unsigned int capacity; // entities
+    UpdateEncoding *encodings; // UPDATE_CACHE_WAYS per entity
+    
+    MemoryArena bytes;
+    MemoryArena spans; // SocketSpans of the packets being gathered
+    
+    unsigned int hit_count;
+    unsigned int miss_count;
+} EntityUpdateCache;
+
+size_t EntityUpdateCacheMemorySize(unsigned int capacity)
+{
+    size_t result = (capacity * UPDATE_CACHE_WAYS * sizeof(UpdateEncoding)
+                     + UPDATE_CACHE_BYTES
+                     + UPDATE_CACHE_SPANS * sizeof(SocketSpan));
+    return result;
+}
+
+void EntityUpdateCacheInit(EntityUpdateCache *cache, MemoryArena *arena, unsigned int capacity)
+{
+    MEMORY_SET(cache, 0, sizeof(EntityUpdateCache));
+    cache->generation = 1;
+    cache->capacity = capacity;
+    cache->encodings = PUSH_ARRAY(arena, UpdateEncoding, capacity * UPDATE_CACHE_WAYS);
+    MEMORY_SET(cache->encodings, 0, capacity * UPDATE_CACHE_WAYS * sizeof(UpdateEncoding));
+    InitializeArena(&cache->spans, (uint8_t *)PUSH_ARRAY(arena, SocketSpan, UPDATE_CACHE_SPANS),
+                    UPDATE_CACHE_SPANS * sizeof(SocketSpan));
+    InitializeArena(&cache->bytes, (uint8_t *)PUSH_ARRAY(arena, uint8_t, UPDATE_CACHE_BYTES),
+                    UPDATE_CACHE_BYTES);
+}
+
+// Drops every encoding, only call it once the packets pointing at them
+// have been sent
+void EntityUpdateCacheReset(EntityUpdateCache *cache)
+{
+    ++cache->generation;
+    cache->bytes.used = 0;
+    cache->spans.used = 0;
+}
+
+// Whether a whole packet worth of updates still fits
+bool EntityUpdateCacheHasRoom(EntityUpdateCache *cache)
+{
+    size_t span_size = (MAX_ENTITY_UPDATES_PER_PACKET + 1) * sizeof(SocketSpan);
+    size_t byte_size = MAX_ENTITY_UPDATES_PER_PACKET * MAX_ENTITY_UPDATE_SIZE;
+    bool result = (cache->spans.used + span_size <= cache->spans.size
+                   && cache->bytes.used + byte_size <= cache->bytes.size);
+    return result;
+}
+
+// Bytes of the update of entity src_idx at tick, relative to baseline
+// (0 for a full update), encoded on the first call of the generation
+SocketSpan EntityUpdateCacheGet(EntityUpdateCache *cache, uint16_t tick, uint16_t src_idx,
+                                Entity *entity, Entity *baseline, uint16_t baseline_tick)
+{
+    ASSERT(src_idx < cache->capacity);
+    bool has_baseline = (baseline != 0);
+    UpdateEncoding *ways = cache->encodings + (size_t)src_idx * UPDATE_CACHE_WAYS;
+    UpdateEncoding *free_way = 0;
+    for(unsigned int way_idx = 0; way_idx < UPDATE_CACHE_WAYS; ++way_idx)
+    {
+        UpdateEncoding *way = ways + way_idx;
+        if(way->generation != cache->generation)
+        {
+            if(free_way == 0)
+                free_way = way;
+            continue;
+        }
+        
+        if(way->has_baseline == has_baseline
+           && (!has_baseline || way->baseline_tick == baseline_tick))
+        {
+            ++cache->hit_count;
+            return way->span;
+        }
+    }
+    ++cache->miss_count;
+    
+    EntityUpdate update;
+    update.idx = src_idx;
+    update.baseline_tick = (has_baseline ? baseline_tick : 0);
+    update.flags = (has_baseline ? EntityUpdate_HasBaseline : 0);
+    update.field_mask = EntityDeltaMask((has_baseline ? baseline : &global_zero_entity), entity);
+    
+    uint8_t *data = PUSH_ARRAY(&cache->bytes, uint8_t, MAX_ENTITY_UPDATE_SIZE);
+    BitStream stream = BitStreamWriter(data, MAX_ENTITY_UPDATE_SIZE);
+    if(!SerializeEntityUpdate(&stream, tick, &update, entity))
+        INVALID_CODE_PATH;
+    
+    // give back what the update didn't need
+    size_t size = BitStreamBytesUsed(&stream);
+    cache->bytes.used -= MAX_ENTITY_UPDATE_SIZE - size;
+    
+    SocketSpan result;
+    result.data = data;
+    result.size = size;
+    
+    // all ways taken by other baselines, the bytes still stay valid
+    // until the reset, they just don't get shared
+    if(free_way)
+    {
+        free_way->generation = cache->generation;
+        free_way->baseline_tick = update.baseline_tick;
+        free_way->has_baseline = has_baseline;
+        free_way->span = result;
+    }
+    return result;
+}
+
+#endif //UPDATE_CACHE_H
@@ -0,0 +1,241 @@
+/* date = October 17th 2026 7:05 pm */
+
+#ifndef WORLD_H
+#define WORLD_H
+
+// State shared by the server workers. Every worker runs on its own thread
+// with its own SO_REUSEPORT socket, so the kernel spreads clients across
+// workers and each worker owns the clients that land on its socket.
+// Clients get a global entity index, the block of worker_capacity indices
+// starting at worker_idx * worker_capacity belongs to the worker.
+//
+// Every tick each worker publishes its entities into the entry list for
+// the tick parity and waits on tick_barrier, then reads everybody's list
+// to send snapshots to its own clients. The barrier of the next tick keeps
+// a worker from writing a list the others could still be reading.
+// Entity states go into histories, which only the owning worker writes to
+// and only in the slot of the tick it publishes (see BaselineIsUsable).
+//
+// Positions also go into rewind_frames, one column per coordinate and
+// tick, which is all lag compensated hit tests read (see
+// ServerResolveSpellHits). Same as with the histories the oldest frame is
+// off limits, it is the one being overwritten.
+
+#define REWIND_FRAME_COUNT 32 // ticks
+#define MAX_REWIND_TICKS (REWIND_FRAME_COUNT - 2)
+
+typedef struct WorldEntry
+{
+    uint16_t idx;
+    Vec2i p;
+} WorldEntry;
+
+// Positions of every entity at one tick, by entity index. A position is
+// only there if ticks holds the tick of the frame for it.
+typedef struct RewindFrame
+{
+    uint16_t *ticks;
+    int *x;
+    int *y;
+} RewindFrame;
+
+typedef struct World
+{
+    unsigned int worker_count;
+    unsigned int worker_capacity;
+    unsigned int capacity; // worker_count * worker_capacity
+    
+    EntityHistory *histories; // by entity index
+    
+    // double buffered by tick parity, worker w writes its entries at
+    // w * worker_capacity and their count at entry_counts[parity][w]
+    WorldEntry *entries[2];
+    unsigned int *entry_counts[2];
+    
+    RewindFrame rewind_frames[REWIND_FRAME_COUNT]; // by tick
+    
+    pthread_barrier_t tick_barrier;
+    int64_t first_tick_ns; // deadline every worker starts ticking at
+    unsigned int stop_tick_count; // 0, or when a worker failed, see ServerWorkerStop
+    
+    // nicknames are unique across workers, slots hold entity index + 1
+    pthread_mutex_t nickname_mutex;
+    Nickname *nicknames; // by entity index
+    uint32_t *nickname_slots;
+    unsigned int nickname_slot_count; // power of two
+    unsigned int nickname_tombstone_count;
+    unsigned int nickname_count;
+} World;
+
+size_t WorldMemorySize(unsigned int capacity, unsigned int worker_count)
+{
+    size_t result = (capacity * sizeof(EntityHistory)
+                     + 2 * capacity * sizeof(WorldEntry)
+                     + 2 * worker_count * sizeof(unsigned int)
+                     + REWIND_FRAME_COUNT * capacity * (sizeof(uint16_t) + 2 * sizeof(int))
+                     + capacity * sizeof(Nickname)
+                     + ClientTableSlotCount(capacity) * sizeof(uint32_t));
+    return result;
+}
+
+bool WorldInit(World *world, MemoryArena *arena, unsigned int worker_count, unsigned int worker_capacity)
+{
+    MEMORY_SET(world, 0, sizeof(World));
+    world->worker_count = worker_count;
+    world->worker_capacity = worker_capacity;
+    world->capacity = worker_count * worker_capacity;
+    ASSERT(world->capacity <= CLIENT_TABLE_MAX_CAPACITY);
+    
+    world->histories = PUSH_ARRAY(arena, EntityHistory, world->capacity);
+    MEMORY_SET(world->histories, 0, world->capacity * sizeof(EntityHistory));
+    for(unsigned int buffer_idx = 0; buffer_idx < 2; ++buffer_idx)
+    {
+        world->entries[buffer_idx] = PUSH_ARRAY(arena, WorldEntry, world->capacity);
+        world->entry_counts[buffer_idx] = PUSH_ARRAY(arena, unsigned int, worker_count);
+        MEMORY_SET(world->entry_counts[buffer_idx], 0, worker_count * sizeof(unsigned int));
+    }
+    
+    for(unsigned int frame_idx = 0; frame_idx < REWIND_FRAME_COUNT; ++frame_idx)
+    {
+        RewindFrame *frame = world->rewind_frames + frame_idx;
+        frame->x = PUSH_ARRAY(arena, int, world->capacity);
+        frame->y = PUSH_ARRAY(arena, int, world->capacity);
+        frame->ticks = PUSH_ARRAY(arena, uint16_t, world->capacity);
+        
+        // a tick that doesn't map to the frame, so nothing reads as valid
+        for(unsigned int idx = 0; idx < world->capacity; ++idx)
+            frame->ticks[idx] = (uint16_t)(frame_idx + 1);
+    }
+    
+    world->nicknames = PUSH_ARRAY(arena, Nickname, world->capacity);
+    world->nickname_slot_count = ClientTableSlotCount(world->capacity);
+    world->nickname_slots = PUSH_ARRAY(arena, uint32_t, world->nickname_slot_count);
+    MEMORY_SET(world->nickname_slots, 0, world->nickname_slot_count * sizeof(uint32_t));
+    
+    if(pthread_barrier_init(&world->tick_barrier, 0, worker_count) != 0
+       || pthread_mutex_init(&world->nickname_mutex, 0) != 0)
+    {
+        fprintf(stderr, "[ERROR] Initialize world synchronization\n");
+        return false;
+    }
+    return true;
+}
+
+void WorldRewindPut(World *world, uint16_t tick, uint16_t entity_idx, Vec2i p)
+{
+    RewindFrame *frame = world->rewind_frames + (tick % REWIND_FRAME_COUNT);
+    frame->x[entity_idx] = p.x;
+    frame->y[entity_idx] = p.y;
+    frame->ticks[entity_idx] = tick;
+}
+
+// Position of the entity at tick, false if it wasn't around back then
+bool WorldRewindGet(World *world, uint16_t tick, uint16_t entity_idx, Vec2i *p)
+{
+    RewindFrame *frame = world->rewind_frames + (tick % REWIND_FRAME_COUNT);
+    bool result = (frame->ticks[entity_idx] == tick);
+    if(result)
+        *p = Vec2iGet(frame->x[entity_idx], frame->y[entity_idx]);
+    return result;
+}
+
+// Same probing as ClientTableNicknameProbe, the caller holds nickname_mutex
+uint32_t *WorldNicknameProbe(World *world, Nickname *nickname, bool *found)
+{
+    uint32_t mask = world->nickname_slot_count - 1;
+    uint32_t slot_idx = NicknameHash(nickname) & mask;
+    uint32_t *insert_slot = 0;
+    *found = false;
+    
+    for(unsigned int probe = 0; probe < world->nickname_slot_count; ++probe)
+    {
+        uint32_t *slot = world->nickname_slots + slot_idx;
+        if(*slot == CLIENT_SLOT_EMPTY)
+        {
+            if(insert_slot == 0)
+                insert_slot = slot;
+            break;
+        }
+        else if(*slot == CLIENT_SLOT_TOMBSTONE)
+        {
+            if(insert_slot == 0)
+                insert_slot = slot;
+        }
+        else
+        {
+            Nickname *taken = world->nicknames + (*slot - 1);
+            if(StringCompare(taken->str, taken->size, nickname->str, nickname->size))
+            {
+                *found = true;
+                return slot;
+            }
+        }
+        slot_idx = (slot_idx + 1) & mask;
+    }
+    
+    return insert_slot;
+}
+
+void WorldNicknameRehash(World *world)
+{
+    MEMORY_SET(world->nickname_slots, 0, world->nickname_slot_count * sizeof(uint32_t));
+    world->nickname_tombstone_count = 0;
+    for(unsigned int idx = 0; idx < world->capacity; ++idx)
+    {
+        Nickname *nickname = world->nicknames + idx;
+        if(nickname->size == 0)
+            continue;
+        
+        bool found;
+        uint32_t *slot = WorldNicknameProbe(world, nickname, &found);
+        ASSERT(!found && slot != 0);
+        *slot = idx + 1;
+    }
+}
+
+// Returns false when another client already goes by the nickname
+bool WorldClaimNickname(World *world, uint16_t entity_idx, Nickname *nickname)
+{
+    ASSERT(entity_idx < world->capacity && nickname->size > 0);
+    pthread_mutex_lock(&world->nickname_mutex);
+    
+    if(world->nickname_count + world->nickname_tombstone_count >= (world->nickname_slot_count / 4) * 3)
+        WorldNicknameRehash(world);
+    
+    bool found;
+    uint32_t *slot = WorldNicknameProbe(world, nickname, &found);
+    bool result = !found;
+    if(result)
+    {
+        ASSERT(slot != 0);
+        if(*slot == CLIENT_SLOT_TOMBSTONE)
+            --world->nickname_tombstone_count;
+        *slot = (uint32_t)entity_idx + 1;
+        world->nicknames[entity_idx] = *nickname;
+        ++world->nickname_count;
+    }
+    
+    pthread_mutex_unlock(&world->nickname_mutex);
+    return result;
+}
+
+void WorldReleaseNickname(World *world, uint16_t entity_idx)
+{
+    pthread_mutex_lock(&world->nickname_mutex);
+    
+    Nickname *nickname = world->nicknames + entity_idx;
+    bool found;
+    uint32_t *slot = WorldNicknameProbe(world, nickname, &found);
+    ASSERT(found && *slot == (uint32_t)entity_idx + 1);
+    if(found)
+    {
+        *slot = CLIENT_SLOT_TOMBSTONE;
+        ++world->nickname_tombstone_count;
+        --world->nickname_count;
+    }
+    nickname->size = 0;
+    
+    pthread_mutex_unlock(&world->nickname_mutex);
+}
+
+#endif //WORLD_H